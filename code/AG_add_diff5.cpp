@@ -40,6 +40,9 @@
 #include <cmath>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
 
 #include "fitsio.h"
 #include "pil.h"
@@ -59,6 +62,69 @@ int AG_findindex(double emin, double * raeffenergy, int numaeffenergies) {
 }
 */
 
+/// A diffuse component of the list, read by the prefetch thread
+struct DiffuseComponent {
+	string name;
+	vector<double> pixels;
+	long naxes[3];
+	double elow, ehigh, index;
+	int status;
+};
+
+static void ReadComponent(DiffuseComponent* comp)
+{
+	int status = 0;
+	long pixel[2] = { 1, 1 };
+	int bitpix, naxis;
+	comp->naxes[0] = comp->naxes[1] = comp->naxes[2] = 0;
+	fitsfile * diffuseFits;
+	if ( fits_open_file(&diffuseFits, comp->name.c_str(), READONLY, &status) != 0 ) {
+		printf("Errore in apertura file '%s'\n", comp->name.c_str());
+		comp->status = status;
+		return;
+	}
+	fits_movabs_hdu(diffuseFits, 2, NULL, &status);
+	fits_get_img_param(diffuseFits, 3, &bitpix, &naxis, comp->naxes, &status);
+	if (!status) {
+		comp->pixels.resize(comp->naxes[0] * comp->naxes[1]);
+		if ( fits_read_pix(diffuseFits, TDOUBLE, pixel, comp->pixels.size(), NULL, &comp->pixels[0], NULL, &status) != 0)
+			printf("Error reading array from '%s'\n", comp->name.c_str());
+	}
+	fits_read_key(diffuseFits,TDOUBLE,"E_MIN",&comp->elow,NULL,&status);
+	fits_read_key(diffuseFits,TDOUBLE,"E_MAX",&comp->ehigh,NULL,&status);
+	fits_read_key(diffuseFits,TDOUBLE,"INDEX",&comp->index,NULL,&status);
+	fits_close_file(diffuseFits, &status);
+	comp->status = status;
+}
+
+/// The average effective area of a band and spectral index, computed by
+/// AeffGridAverage as before
+struct BandArea {
+	double elow, ehigh, index;
+	double area;
+};
+
+/// The AeffGridAverage area at (30, 0) of a component. AeffGridAverage
+/// loads the SAR file itself, so the file is read once for the output band
+/// and once more for each distinct band and spectral index of the list.
+static double ComponentArea(vector<BandArea>& areas, char * sarfile, const DiffuseComponent& comp)
+{
+	for (size_t i = 0; i < areas.size(); i++)
+		if (areas[i].elow == comp.elow && areas[i].ehigh == comp.ehigh && areas[i].index == comp.index)
+			return areas[i].area;
+	AeffGridAverage raeff2(sarfile, comp.elow, comp.ehigh, comp.index);
+	BandArea band = { comp.elow, comp.ehigh, comp.index, raeff2.AvgVal(30,0) };
+	areas.push_back(band);
+	return band.area;
+}
+
+/// y += a x
+static void Axpy(long n, double a, const double* __restrict x, double* __restrict y)
+{
+	for (long i = 0; i < n; i++)
+		y[i] += a * x[i];
+}
+
 int AG_add_diff(char * diffusefilelist, char * sarfile, char * edpfile, char *  outfile, double emin, double emax){
 
 	EdpGrid edpgrid(edpfile);
@@ -72,6 +138,14 @@ int AG_add_diff(char * diffusefilelist, char * sarfile, char * edpfile, char *
 	infile >> bigindex >> numdiffs;
 	cout << "Index = " << bigindex << endl;
 
+	vector<DiffuseComponent> comps(numdiffs > 0 ? numdiffs : 0);
+	for (int diffi = 0; diffi < numdiffs ; ++diffi)
+		infile >> comps[diffi].name;
+	if (comps.empty() || !infile) {
+		printf("Errore in lettura file '%s'\n", diffusefilelist);
+		return 104;
+	}
+
 	/// AlikeAeffGridClass3 raeff(sarfile, edpfile, emin, emax, bigindex);
 	AeffGridAverage raeff(sarfile, emin, emax, bigindex);
 	raeff.LoadEdp(edpfile);
@@ -81,120 +155,95 @@ int AG_add_diff(char * diffusefilelist, char * sarfile, char * edpfile, char *
 
 	cout << bigarea << endl;
 
-
-	/**
-	int numaeffenergies = raeff.energies().GetNoElements();
-	double * raeffenergies = new double[numaeffenergies];
-	for (int eind = 0 ; eind < numaeffenergies ; eind++)
-	    raeffenergies[eind] = raeff.energies()[eind];
-	int eminind = AG_findindex(emin, raeffenergies, numaeffenergies);
-	int emaxind = AG_findindex(emax, raeffenergies, numaeffenergies);
-	*/
 	const VecF& raeffenergies = raeff.Energies();
 	int numaeffenergies = raeffenergies.Size();
 	int eminind = raeffenergies.GeomIndex(emin);
 	int emaxind = raeffenergies.GeomIndex(emax);
 
+	/// The EDP summed over the observed energies of the output band, for
+	/// each true energy, shared by all the components
+	vector<double> edpsum(numaeffenergies, 0.0);
+	for (int etrue = 0; etrue < numaeffenergies-1; etrue++)
+		for (int eobs = eminind;  eobs <= emaxind; eobs++)
+			edpsum[etrue] += edpgrid.Val(raeffenergies[etrue], raeffenergies[eobs], 30, 0);
 
-	string diffusefilename;
-	double * diffuseout = 0;
-
-	int bitpix   =  DOUBLE_IMG;
-	int naxis;
-	long naxes[3] ;
-
+	/// The output keeps the headers of the first component
 	fitsfile * outFits;
 	if ( fits_create_file(&outFits, outfile, &status) != 0 ) {
 		printf("Errore in apertura file '%s'\n", outfile);
 		return status;
 	}
-
-	for (int diffi = 0; diffi < numdiffs ; ++diffi){
-	  infile >> diffusefilename;
-	  fitsfile * diffuseFits;
-	  if ( fits_open_file(&diffuseFits, diffusefilename.c_str(), READONLY, &status) != 0 ) {
-		printf("Errore in apertura file '%s'\n", diffusefilename.c_str());
+	fitsfile * firstFits;
+	if ( fits_open_file(&firstFits, comps[0].name.c_str(), READONLY, &status) != 0 ) {
+		printf("Errore in apertura file '%s'\n", comps[0].name.c_str());
+		fits_close_file(outFits, &status);
 		return status;
-		}
-	  else {
-	    fits_movabs_hdu(diffuseFits, 2, NULL, &status);
-	    fits_get_img_param(diffuseFits, 3, &bitpix, &naxis, naxes, &status);
-	    cout << diffusefilename << ": " << naxis << " axes: (" << naxes[0] << ", " << naxes[1] << ", " << naxes[2] << ")" << endl;
-	    if (diffi == 0) {
-		fits_copy_file(diffuseFits+diffi, outFits, 1, 1, 1, &status);
-		diffuseout = new double[naxes[0] * naxes[1]];
-		for (long i=0 ; i < naxes[0] * naxes[1] ; i++)
-		    diffuseout[i] = 0;
-	    }
-
-	    double * diffuse = new double[naxes[0] * naxes[1]];
-	    if ( fits_read_pix(diffuseFits, TDOUBLE, pixel, naxes[0]*naxes[1], NULL, diffuse, NULL, &status) != 0) {
-		printf("Error reading array from '%s'\n", diffusefilename.c_str());
-		delete []diffuseout;
+	}
+	fits_copy_file(firstFits, outFits, 1, 1, 1, &status);
+	fits_close_file(firstFits, &status);
+	if (status) {
+		fits_close_file(outFits, &status);
 		return status;
-	    }
-	    else {
-		cout << "Diffuse array " << diffi << " for " << diffusefilename << " successfully created" << endl;
-
-		double elow;
-		double ehigh;
-		double index;
-		fits_read_key(diffuseFits,TDOUBLE,"E_MIN",&elow,NULL,&status);
-		fits_read_key(diffuseFits,TDOUBLE,"E_MAX",&ehigh,NULL,&status);
-		fits_read_key(diffuseFits,TDOUBLE,"INDEX",&index,NULL,&status);
-		/**
-		int elowind = AG_findindex(elow, raeffenergies, numaeffenergies);
-		int ehighind = AG_findindex(ehigh, raeffenergies, numaeffenergies);
-		*/
-		int elowind = raeffenergies.GeomIndex(elow);
-		int ehighind = raeffenergies.GeomIndex(ehigh);
-
-		cout << "Elow = " << elow << ", Ehigh = " << ehigh << ", index = " << index << endl;
-
-		/// AlikeAeffGridClass2 raeff2(sarfile, elow, ehigh, index);
-		AeffGridAverage raeff2(sarfile, elow, ehigh, index);
+	}
 
+	/// The next component is read while the current one is accumulated
+	vector<double> diffuseout;
+	long npixels = 0;
+	long naxes[3] = { 0, 0, 0 };
+	vector<BandArea> areas;
+	thread reader(ReadComponent, &comps[0]);
+	for (int diffi = 0; diffi < numdiffs ; ++diffi) {
+		reader.join();
+		DiffuseComponent& comp = comps[diffi];
+		/// AeffGridAverage reads the SAR file, before the next read starts
+		double area = status || comp.status ? 0 : ComponentArea(areas, sarfile, comp);
+		if (diffi+1 < numdiffs)
+			reader = thread(ReadComponent, &comps[diffi+1]);
+		if (!status && comp.status)
+			status = comp.status;
+		if (status)
+			continue;
+		cout << comp.name << ": (" << comp.naxes[0] << ", " << comp.naxes[1] << ", " << comp.naxes[2] << ")" << endl;
+		if (diffi == 0) {
+			naxes[0] = comp.naxes[0];
+			naxes[1] = comp.naxes[1];
+			npixels = naxes[0] * naxes[1];
+			diffuseout.assign(npixels, 0.0);
+		}
+		else if (comp.naxes[0] != naxes[0] || comp.naxes[1] != naxes[1]) {
+			printf("Error: '%s' has a different size\n", comp.name.c_str());
+			status = BAD_DIMEN;
+			continue;
+		}
 
+		int elowind = raeffenergies.GeomIndex(comp.elow);
+		int ehighind = raeffenergies.GeomIndex(comp.ehigh);
+		cout << "Elow = " << comp.elow << ", Ehigh = " << comp.ehigh << ", index = " << comp.index << endl;
 
 		double specwttotal = 0;
 		double edparr = 0;
 		for (int etrue = elowind; etrue < ehighind; etrue++) {
-		    cout << etrue << " " << raeffenergies[etrue] << endl;
-		    double specwt;
-		    if (etrue >= numaeffenergies)
-			/// specwt = pow((double) raeffenergies[etrue] ,(double) (1.0 - index));
-			specwt = pow(double(raeffenergies[etrue]), 1.0-index);
-		    else
-			/// specwt = pow((double) raeffenergies[etrue] ,(double) (1.0 - index)) - pow((double)raeffenergies[etrue+1], (double) (1.0 - index)) ;
-			specwt = pow(double(raeffenergies[etrue]),1.0-index) - pow(double(raeffenergies[etrue+1]), 1.0 - index);
-
-
-		    specwttotal += specwt;
-		    for (int eobs = eminind;  eobs <= emaxind; eobs++) {
-			edparr += specwt * edpgrid.Val(raeffenergies[etrue], raeffenergies[eobs], 30, 0);
-		    cout << eobs << " " << raeffenergies[eobs] << " " << specwt << " " << edpgrid.Val(raeffenergies[etrue], raeffenergies[eobs], 30, 0) << endl;
-		    }
+			double specwt = pow(double(raeffenergies[etrue]),1.0-comp.index) - pow(double(raeffenergies[etrue+1]), 1.0 - comp.index);
+			specwttotal += specwt;
+			edparr += specwt * edpsum[etrue];
 		}
-		cout << edparr / specwttotal << " " << raeff2.AvgVal(30,0) << endl;
-		edparr *= raeff2.AvgVal(30,0) / specwttotal / bigarea;
+		cout << edparr / specwttotal << " " << area << endl;
+		edparr *= area / specwttotal / bigarea;
 		cout << edparr << endl;
-		for (long i=0 ; i < naxes[0] * naxes[1] ; i++) {
-		    diffuseout[i] += edparr * diffuse[i];
-		}
-		delete [] diffuse;
-	    }
-	  }
-	  fits_close_file(diffuseFits, &status);
+		Axpy(npixels, edparr, &comp.pixels[0], &diffuseout[0]);
+		vector<double>().swap(comp.pixels);
 	}
 
-	fits_movabs_hdu(outFits, 2, NULL, &status);
-	fits_write_pix(outFits, TDOUBLE, pixel, naxes[0]*naxes[1], diffuseout, &status);
-	fits_update_key(outFits, TDOUBLE, "E_MIN", &emin, NULL, &status);
-	fits_update_key(outFits, TDOUBLE, "E_MAX", &emax, NULL, &status);
-	fits_update_key(outFits, TDOUBLE, "INDEX", &bigindex, NULL, &status);
-	fits_close_file(outFits, &status);
-	delete [] diffuseout;
-	return status;
+	if (!status) {
+		fits_movabs_hdu(outFits, 2, NULL, &status);
+		fits_write_pix(outFits, TDOUBLE, pixel, npixels, &diffuseout[0], &status);
+		fits_update_key(outFits, TDOUBLE, "E_MIN", &emin, NULL, &status);
+		fits_update_key(outFits, TDOUBLE, "E_MAX", &emax, NULL, &status);
+		fits_update_key(outFits, TDOUBLE, "INDEX", &bigindex, NULL, &status);
+	}
+	int closeStatus = 0;
+	fits_close_file(outFits, &closeStatus);
+	return status ? status : closeStatus;
 }
 
 int main(int argc,char **argv)
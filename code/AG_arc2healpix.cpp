@@ -29,40 +29,159 @@
 
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <fitsio.h>
 
 #include "AgileMap.h"
 #include "HealpixMap.h"
+#include "HealpixReprojector.h"
 
 
 using std::cerr;
 using std::cout;
 using std::endl;
+using std::string;
+using std::vector;
 
 
+/// An input map with its exposure map, read by the loading threads
+struct InputMap {
+	string ctsName;
+	string expName;
+	AgileMap cts;
+	AgileMap exp;
+	int status;
+};
+
+/// The statistics of an input for the summary table
+struct InputStats {
+	string name;
+	int rows, cols;
+	double total;
+	double exposure;
+	long outside;
+	bool cached;
+	int status;
+};
+
+
+static bool ReadList(const char* listName, vector<InputMap>& inputs)
+{
+std::ifstream list(listName);
+if (!list.is_open())
+	return false;
+string line;
+while (std::getline(list, line)) {
+	std::istringstream fields(line);
+	InputMap input;
+	if (!(fields >> input.ctsName) || input.ctsName[0]=='#')
+		continue;
+	fields >> input.expName;
+	input.status = 0;
+	inputs.push_back(input);
+	}
+return true;
+}
+
+static void ReadWindow(vector<InputMap>* inputs, int first, int count, std::atomic<int>* next)
+{
+for (int k=(*next)++; k<count; k=(*next)++) {
+	InputMap& input = (*inputs)[first+k];
+	input.status = input.cts.Read(input.ctsName.c_str());
+	if (!input.status && !input.expName.empty()) {
+		input.status = input.exp.Read(input.expName.c_str());
+		if (!input.status && (input.exp.Rows()!=input.cts.Rows() || input.exp.Cols()!=input.cts.Cols()))
+			input.status = -1;
+		}
+	}
+}
+
+static void WriteSummary(std::ostream& out, const vector<InputStats>& stats)
+{
+out << std::left << std::setw(40) << "# map" << std::right << std::setw(12) << "size"
+    << std::setw(16) << "total" << std::setw(16) << "exposure" << std::setw(12) << "outside"
+    << std::setw(8) << "cache" << endl;
+for (size_t i=0; i<stats.size(); ++i) {
+	const InputStats& s = stats[i];
+	std::ostringstream size;
+	size << s.rows << "x" << s.cols;
+	out << std::left << std::setw(40) << s.name << std::right << std::setw(12) << size.str()
+	    << std::setw(16) << s.total << std::setw(16) << s.exposure << std::setw(12) << s.outside
+	    << std::setw(8) << (s.status ? "error" : s.cached ? "yes" : "no") << endl;
+	}
+}
 
 
 static int Help()
 {
-cout << "Usage: cts2healpix [+/-] <input_name> <output_name> [<nside>=512] [<rowOrder>=32]" << endl;
+cout << "Usage: cts2healpix [options] [+/-/*] <input_name> <output_name> [<nside>=512] [<rowOrder>=32]" << endl;
 cout << "+ sum (default)" << endl;
 cout << "- average" << endl;
+cout << "* exposure weighted average, with --list only" << endl;
+cout << "Options:" << endl;
+cout << "--list the input is a list of maps, each optionally followed by its exposure map, all accumulated into the output" << endl;
+cout << "--summary=<file> write the table of the statistics of the input maps" << endl;
+cout << "--drizzle=<n> split each input pixel in n x n parts shared among the HEALPix pixels (default 1, nearest pixel)" << endl;
+cout << "--cache=<dir> keep the pixel mappings in the directory dir" << endl;
+cout << "--threads=<n> threads placing the drizzle samples and reading the list (default 0, all the cores)" << endl;
 return -1;
 }
 
-int main(int argC, char* argV[])
+int main(int argc, char* argv[])
 {
+/// The options are taken out, the positional arguments keep their order
+int subsamples = 1;
+const char* cacheDir = 0;
+int threads = 0;
+bool isList = false;
+const char* summaryFile = 0;
+std::vector<char*> args;
+for (int i=0; i<argc; ++i) {
+	if (i && !strcmp(argv[i], "--list"))
+		isList = true;
+	else if (i && !strncmp(argv[i], "--summary=", 10))
+		summaryFile = argv[i]+10;
+	else if (i && !strncmp(argv[i], "--drizzle=", 10))
+		subsamples = atoi(argv[i]+10);
+	else if (i && !strncmp(argv[i], "--cache=", 8))
+		cacheDir = argv[i]+8;
+	else if (i && !strncmp(argv[i], "--threads=", 10))
+		threads = atoi(argv[i]+10);
+	else if (i && !strncmp(argv[i], "--", 2))
+		return Help();
+	else
+		args.push_back(argv[i]);
+	}
+int argC = args.size();
+char** argV = &args[0];
 if (argC<3 || argC>6)
 	return Help();
+if (subsamples<1) {
+	cout << "Warning: The drizzle option should be an integer greater than 0. 1 assumed" << endl;
+	subsamples = 1;
+	}
 
 bool sum = true;
+bool expWeighted = false;
 bool hasMode = false;
 const char* mode = argV[1];
-if ((mode[0]=='+' || mode[0]=='-') && mode[1]==0) {
+if ((mode[0]=='+' || mode[0]=='-' || mode[0]=='*') && mode[1]==0) {
 	hasMode = true;
 	if (argC<4)
 		return Help();
 	sum = mode[0]=='+';
+	expWeighted = mode[0]=='*';
+	if (expWeighted && !isList)
+		return Help();
 	}
 else if (argC>5)
 	return Help();
@@ -80,6 +199,8 @@ if (sum) {
 	cout << " to the output file";
 	cout << endl;
 	}
+else if (expWeighted)
+	cout << "Writing exposure weighted average values to the output file" << endl;
 else
 	cout << "Writing average values to the output file" << endl;
 
@@ -104,52 +225,154 @@ if (argC>=5+hasMode) {
 		}
 	}
 	
-AgileMap gm;
-
-if (gm.Read(iFile)==0) {
-	cout << "File "  << iFile << " loaded:" << endl;
-	cout << "Size: " << gm.Rows() << "x" << gm.Cols() << " = " << gm.Rows()*gm.Cols() << endl;
-	cout << "Center l, b: " << gm.GetMapCenterL() << ", " << gm.GetMapCenterB() << endl;
-	cout << "Xbin, Ybin: " << gm.GetXbin() << ", " << gm.GetYbin() << endl;
-	cout << "X0, Y0: " << gm.GetX0() << ", " << gm.GetY0() << endl;
-	cout << "Lonpole: " << gm.GetLonpole() << endl << endl;
+vector<InputMap> inputs;
+if (isList) {
+	if (!ReadList(iFile, inputs) || inputs.empty()) {
+		cerr << "File " << iFile << " missing or empty" << endl;
+		return -1;
+		}
+	if (expWeighted)
+		for (size_t i=0; i<inputs.size(); ++i)
+			if (inputs[i].expName.empty()) {
+				cerr << "The exposure map of " << inputs[i].ctsName << " is missing" << endl;
+				return -1;
+				}
+	cout << inputs.size() << " maps listed" << endl;
 	}
 else {
-	cerr << "Failed opening file cts" << endl;
-	return -1;
+	InputMap input;
+	input.ctsName = iFile;
+	input.status = 0;
+	inputs.push_back(input);
 	}
-		
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1)
+	threads = 1;
+
 HealpixMap hMap(nside);
 
 int positions = hMap.Count();
 
-int* used = new int[positions];
-for (int i=0; i<positions; ++i)
-	used[i] = 0;
-
-double l, b;
-/// double theta, phi;
-long ipring;
-for (int row=0; row<gm.Rows(); ++row)
-	for (int col=0; col<gm.Cols(); ++col) {
-		gm.GetCoords(row, col, &l, &b);
-		ipring = hMap.Gal2Hpx(l, b);
-		if (ipring>=positions || ipring<0)
-			cerr << "ipring(" << row << ", " << col << ")=" << ipring << endl;
-		else {
-			hMap.AddVal(ipring, gm(row, col));
-			++used[ipring];
+if (subsamples>1)
+	cout << "Drizzle with " << subsamples << "x" << subsamples << " parts per input pixel" << endl;
+
+/// The maps are read a window at a time, in parallel if cfitsio allows
+/// it, and accumulated in the order of the list
+int window = isList && fits_is_reentrant() ? threads : 1;
+HealpixReprojector reprojector;
+vector<double> sums(positions, 0.0);
+vector<double> weights(positions, 0.0);
+vector<double> expSums;
+vector<double> product;
+if (expWeighted)
+	expSums.assign(positions, 0.0);
+vector<int> used(positions, 0);
+vector<InputStats> stats;
+long totalPixels = 0;
+long outside = 0;
+for (size_t first=0; first<inputs.size(); first+=window) {
+	int count = std::min(window, int(inputs.size()-first));
+	std::atomic<int> next(0);
+	vector<std::thread> readers;
+	for (int t=1; t<count; ++t)
+		readers.push_back(std::thread(ReadWindow, &inputs, first, count, &next));
+	ReadWindow(&inputs, first, count, &next);
+	for (size_t t=0; t<readers.size(); ++t)
+		readers[t].join();
+
+	for (int k=0; k<count; ++k) {
+		InputMap& input = inputs[first+k];
+		InputStats stat;
+		stat.name = input.ctsName;
+		stat.rows = input.cts.Rows();
+		stat.cols = input.cts.Cols();
+		stat.total = stat.exposure = 0;
+		stat.outside = 0;
+		stat.cached = false;
+		stat.status = input.status;
+		if (input.status) {
+			if (isList)
+				cerr << "Failed opening file " << input.ctsName;
+			else
+				cerr << "Failed opening file cts";
+			if (!input.expName.empty())
+				cerr << " or " << input.expName;
+			cerr << endl;
+			if (!isList)
+				return -1;
+			stats.push_back(stat);
+			continue;
+			}
+		const AgileMap& gm = input.cts;
+		if (!isList) {
+			cout << "File "  << iFile << " loaded:" << endl;
+			cout << "Size: " << gm.Rows() << "x" << gm.Cols() << " = " << gm.Rows()*gm.Cols() << endl;
+			cout << "Center l, b: " << gm.GetMapCenterL() << ", " << gm.GetMapCenterB() << endl;
+			cout << "Xbin, Ybin: " << gm.GetXbin() << ", " << gm.GetYbin() << endl;
+			cout << "X0, Y0: " << gm.GetX0() << ", " << gm.GetY0() << endl;
+			cout << "Lonpole: " << gm.GetLonpole() << endl << endl;
+			}
+		reprojector.Prepare(gm, hMap, subsamples, threads, cacheDir);
+		if (cacheDir && !isList)
+			cout << "Pixel mapping " << (reprojector.FromCache() ? "read from" : "written to") << " the cache "
+			     << HealpixReprojector::CacheFileName(cacheDir, gm, nside, subsamples) << endl;
+		long size = long(gm.Rows())*gm.Cols();
+		const double* values = gm.Buffer();
+		for (long i=0; i<size; ++i)
+			stat.total += values[i];
+		if (input.expName.size()) {
+			const double* exposures = input.exp.Buffer();
+			for (long i=0; i<size; ++i)
+				stat.exposure += exposures[i];
 			}
+		if (expWeighted) {
+			const double* exposures = input.exp.Buffer();
+			product.resize(size);
+			for (long i=0; i<size; ++i)
+				product[i] = values[i]*exposures[i];
+			reprojector.Scatter(&product[0], &sums[0], &weights[0], &used[0]);
+			reprojector.Scatter(exposures, &expSums[0]);
+			}
+		else
+			reprojector.Scatter(values, &sums[0], &weights[0], &used[0]);
+		stat.outside = reprojector.Outside();
+		stat.cached = reprojector.FromCache();
+		totalPixels += size;
+		outside += stat.outside;
+		stats.push_back(stat);
+		/// Only the maps of a window are in memory
+		input.cts = AgileMap();
+		input.exp = AgileMap();
+		}
+	}
+if (outside)
+	cerr << "Warning: " << outside << " input pixels (or parts) outside the HEALPix range" << endl;
+
+for (int i=0; i<positions; ++i)
+	if (sums[i]!=0) {
+		if (sum)
+			hMap.Val(i) = sums[i];
+		else if (expWeighted)
+			hMap.Val(i) = expSums[i]>0 ? sums[i]/expSums[i] : 0.0;
+		else
+			hMap.Val(i) = weights[i]>0 ? sums[i]/weights[i] : sums[i];
 		}
-cerr << "Step 1" << endl;
-if (!sum)
-	for (int i=0; i<positions; ++i)
-		if (used[i]>1 && hMap.Val(i)!=0)
-			hMap.Val(i) = hMap.Val(i)/used[i];
-cerr << "Step 2" << endl;
+
+if (isList) {
+	cout << endl << "Input maps:" << endl;
+	WriteSummary(cout, stats);
+	cout << endl;
+	}
+if (summaryFile) {
+	std::ofstream summary(summaryFile);
+	WriteSummary(summary, stats);
+	if (!summary)
+		cerr << "Error writing " << summaryFile << endl;
+	}
 
 int maxUsed = -1;
-int minUsed = gm.Rows()*gm.Cols()+1;
+int minUsed = totalPixels+1;
 int zeros = 0;
 int firstUsed = positions+1;
 int lastUsed = -1;
@@ -167,7 +390,6 @@ for (int i=0; i<positions; ++i) {
 	else
 		++zeros;
 	}
-delete[] used;
 
 cout << "Output map info:" << endl;
 cout << "Pixels: " << positions << endl;
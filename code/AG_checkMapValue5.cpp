@@ -28,6 +28,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "PilParams.h"
 #include "AgileMap.h"
@@ -39,6 +52,9 @@ const PilDescription c_params[] = {
 	{ PilString, "filename", "Map file name" },
 	{ PilReal,   "l", "Longitude l in degrees (galactic)" },
 	{ PilReal,   "b", "Latitude b in degrees (galactic)" },
+	{ PilString, "queries", "File of queries (map l b per line) answered in a batch, - for a service reading stdin, or none" },
+	{ PilString, "socket", "UNIX socket path of the service mode, or none" },
+	{ PilInt,    "cachesize", "Maps kept in memory by the service mode" },
 	{ PilNone,   "",   "" }
 	};
 
@@ -51,6 +67,227 @@ public:
 };
 
 
+/// A query of the batch and service modes, l and b kept also as written
+/// to echo them in the answer
+struct Query {
+	std::string fileName;
+	std::string lText;
+	std::string bText;
+	double l;
+	double b;
+};
+
+static bool ParseQuery(const std::string& line, Query& query)
+{
+std::istringstream fields(line);
+if (!(fields >> query.fileName >> query.lText >> query.bText))
+	return false;
+char* end;
+query.l = strtod(query.lText.c_str(), &end);
+if (*end)
+	return false;
+query.b = strtod(query.bText.c_str(), &end);
+return !*end;
+}
+
+/// The answer printed by the single query mode: the value of the pixel,
+/// -1 if the point falls outside the map, -2 if the map can't be read
+static std::string Answer(AgileMap* map, const Query& query)
+{
+std::ostringstream answer;
+answer << query.fileName << " " << query.lText << " " << query.bText << " ";
+int row, col;
+if (!map)
+	answer << -2;
+else if (!map->GetRowCol(query.l, query.b, &row, &col))
+	answer << -1;
+else
+	answer << (*map)(row, col);
+return answer.str();
+}
+
+
+/// The maps used by the service mode, the least recently used being
+/// dropped when the cache is full. A map is read again when its file
+/// is modified.
+class MapCache {
+public:
+	MapCache(int size): m_size(size<1 ? 1 : size) {}
+	~MapCache()
+	{
+	for (std::list<Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it)
+		delete it->map;
+	}
+
+	/// The map, null if it can't be read
+	AgileMap* Get(const std::string& fileName)
+	{
+	struct stat info;
+	time_t mtime = stat(fileName.c_str(), &info) ? 0 : info.st_mtime;
+	for (std::list<Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it)
+		if (it->fileName==fileName) {
+			if (it->mtime==mtime) {
+				m_entries.splice(m_entries.begin(), m_entries, it);
+				return it->map;
+				}
+			delete it->map;
+			m_entries.erase(it);
+			break;
+			}
+	AgileMap* map = new AgileMap;
+	if (map->Read(fileName.c_str())) {
+		delete map;
+		return 0;
+		}
+	if (int(m_entries.size())>=m_size) {
+		delete m_entries.back().map;
+		m_entries.pop_back();
+		}
+	Entry entry = { fileName, mtime, map };
+	m_entries.push_front(entry);
+	return map;
+	}
+
+private:
+	struct Entry {
+		std::string fileName;
+		time_t mtime;
+		AgileMap* map;
+	};
+	std::list<Entry> m_entries;
+	int m_size;
+};
+
+
+/// Answer the queries of a file, reading each map once
+static int AnswerBatch(const char* fileName)
+{
+ifstream file(fileName);
+if (!file.is_open()) {
+	cerr << "ERROR accessing file " << fileName << endl;
+	return -2;
+	}
+std::vector<Query> queries;
+std::map<std::string, std::vector<int> > groups;
+std::string line;
+while (std::getline(file, line)) {
+	Query query;
+	if (line.empty() || line[0]=='#')
+		continue;
+	if (!ParseQuery(line, query)) {
+		cerr << "ERROR in the query: " << line << endl;
+		return -1;
+		}
+	groups[query.fileName].push_back(queries.size());
+	queries.push_back(query);
+	}
+std::vector<std::string> answers(queries.size());
+for (std::map<std::string, std::vector<int> >::const_iterator it=groups.begin(); it!=groups.end(); ++it) {
+	AgileMap map;
+	bool loaded = !map.Read(it->first.c_str());
+	if (!loaded)
+		cerr << "ERROR accessing file " << it->first << endl;
+	for (size_t k=0; k<it->second.size(); ++k)
+		answers[it->second[k]] = Answer(loaded ? &map : 0, queries[it->second[k]]);
+	}
+for (size_t i=0; i<answers.size(); ++i)
+	cout << answers[i] << "\n";
+cout.flush();
+cerr << queries.size() << " queries on " << groups.size() << " maps" << endl;
+return 0;
+}
+
+
+/// Answer the queries of a stream, one line at a time, until its end or
+/// the quit command. The shutdown command also stops the socket service.
+/// \return true on shutdown.
+static bool ServeStream(FILE* in, FILE* out, MapCache& cache)
+{
+char* buffer = 0;
+size_t size = 0;
+bool shutdown = false;
+while (getline(&buffer, &size, in)>=0) {
+	std::string line(buffer);
+	while (!line.empty() && (line[line.size()-1]=='\n' || line[line.size()-1]=='\r'))
+		line.erase(line.size()-1);
+	if (line.empty() || line[0]=='#')
+		continue;
+	if (line=="quit")
+		break;
+	if (line=="shutdown") {
+		shutdown = true;
+		break;
+		}
+	Query query;
+	std::string answer = ParseQuery(line, query) ? Answer(cache.Get(query.fileName), query) : "ERROR "+line;
+	/// A client gone before reading its answer ends the connection
+	if (fprintf(out, "%s\n", answer.c_str())<0 || fflush(out))
+		break;
+	}
+free(buffer);
+return shutdown;
+}
+
+/// Serve the clients of a UNIX socket, one at a time
+static int ServeSocket(const char* path, MapCache& cache)
+{
+int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+if (fd<0) {
+	cerr << "ERROR creating the socket: " << strerror(errno) << endl;
+	return -1;
+	}
+sockaddr_un addr;
+memset(&addr, 0, sizeof(addr));
+addr.sun_family = AF_UNIX;
+if (strlen(path)>=sizeof(addr.sun_path)) {
+	cerr << "ERROR the socket path " << path << " is too long" << endl;
+	close(fd);
+	return -1;
+	}
+strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+/// Only the socket left by a previous service is removed
+struct stat st;
+if (!lstat(path, &st)) {
+	if (!S_ISSOCK(st.st_mode)) {
+		cerr << "ERROR " << path << " exists and is not a socket" << endl;
+		close(fd);
+		return -1;
+		}
+	unlink(path);
+	}
+if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || listen(fd, 8)) {
+	cerr << "ERROR binding the socket " << path << ": " << strerror(errno) << endl;
+	close(fd);
+	return -1;
+	}
+cerr << "Serving on " << path << endl;
+bool shutdown = false;
+while (!shutdown) {
+	int client = accept(fd, 0, 0);
+	if (client<0) {
+		if (errno==EINTR)
+			continue;
+		cerr << "ERROR accepting a client: " << strerror(errno) << endl;
+		break;
+		}
+	FILE* in = fdopen(client, "r");
+	FILE* out = fdopen(dup(client), "w");
+	if (in && out)
+		shutdown = ServeStream(in, out, cache);
+	if (in)
+		fclose(in);
+	else
+		close(client);
+	if (out)
+		fclose(out);
+	}
+close(fd);
+if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+	unlink(path);
+return 0;
+}
+
+
 /**
 static int DoPIL(
 	int argc,
@@ -70,11 +307,70 @@ return status;
 }
 */
 
+/// True if the command line selects the batch or the service mode
+static bool IsServiceMode(int argc, char* argv[])
+{
+for (int i=1; i<argc; ++i)
+	if ((!strncmp(argv[i], "queries=", 8) && strcmp(argv[i]+8, "none") && argv[i][8])
+	    || (!strncmp(argv[i], "socket=", 7) && strcmp(argv[i]+7, "none") && argv[i][7]))
+		return true;
+return false;
+}
+
+static bool HasParam(int argc, char* argv[], const char* name)
+{
+size_t len = strlen(name);
+for (int i=1; i<argc; ++i)
+	if (!strncmp(argv[i], name, len) && argv[i][len]=='=')
+		return true;
+return false;
+}
+
+
 int main(int argC, char* argV[])
 {
+/// In the batch and service modes filename, l and b are not used: they
+/// are given on the command line so that PIL does not prompt for them,
+/// reading the queries of stdin
+static char noFile[] = "filename=none";
+static char noL[] = "l=0";
+static char noB[] = "b=0";
+std::vector<char*> args(argV, argV+argC);
+if (IsServiceMode(argC, argV)) {
+	if (!HasParam(argC, argV, "filename"))
+		args.push_back(noFile);
+	if (!HasParam(argC, argV, "l"))
+		args.push_back(noL);
+	if (!HasParam(argC, argV, "b"))
+		args.push_back(noB);
+	}
+args.push_back(0);
+
 CheckMapParams params;
-if (!params.Load(argC, argV))
+if (!params.Load(args.size()-1, &args[0]))
+	return -1;
+
+std::string queries = params.GetStrValue("queries");
+std::string socketPath = params.GetStrValue("socket");
+if (socketPath!="" && socketPath!="none" && queries!="" && queries!="none") {
+	cerr << "ERROR socket and queries can not be used together" << endl;
 	return -1;
+	}
+/// A closed client or output is reported by the writes, it must not kill
+/// a long running service
+if ((socketPath!="" && socketPath!="none") || queries=="-")
+	signal(SIGPIPE, SIG_IGN);
+if (socketPath!="" && socketPath!="none") {
+	MapCache cache(params["cachesize"]);
+	return ServeSocket(socketPath.c_str(), cache);
+	}
+if (queries=="-") {
+	MapCache cache(params["cachesize"]);
+	ServeStream(stdin, stdout, cache);
+	return 0;
+	}
+if (queries!="" && queries!="none")
+	return AnswerBatch(queries.c_str());
 
 const char* filename = params["filename"];
 double l = params["l"];
@@ -33,9 +33,13 @@
 ////////////////////////////////////////////////////////////////////////////////////
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <cstdlib>
 #include <PilParams.h>
 #include <AgileMap.h>
+#include "CapMask.h"
 
 using std::cout;
 using std::cerr;
@@ -59,9 +63,36 @@ const PilDescription paramsDescr[] = {
     { PilReal,   "l", "Circle center longitude l in degrees (galactic)" },
     { PilReal,   "b", "Circle center latitude b in degrees (galactic)" },
     { PilReal,   "radius", "Radius of the circle in degrees" },
+    { PilString, "circles", "File of more circles, one per line: rule (+ union, * intersection, - exclusion) l b radius, or none" },
     { PilNone,   "",   "" }
 };
 
+/// Apply the circles of a file to the mask, in their order
+static bool ApplyCircles(const char* fileName, CapMask& mask)
+{
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        cerr << "Error accessing file " << fileName << endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string rule;
+        if (!(fields >> rule) || rule[0]=='#')
+            continue;
+        double l, b, radius;
+        CapMaskRule capRule;
+        if (rule.size()!=1 || !CapMask::RuleFromChar(rule[0], &capRule) || !(fields >> l >> b >> radius)) {
+            cerr << "Error in the line: " << line << endl;
+            return false;
+        }
+        cout << rule << " l " << l << "   b " << b << "   radius " << radius << endl;
+        mask.Apply(l, b, radius, capRule);
+    }
+    return true;
+}
+
 int main(int argc, char *argv[]) {
     cout << startString << endl;
 
@@ -89,15 +120,13 @@ int main(int argc, char *argv[]) {
     cout << "Circle coordinates:" << endl;
     cout << "l " << l   << "   b " << b << endl;
     cout << "y " << row << "   x " << col << endl;
-    for (int y=0; y<map.Dim(0); ++y) {
-        for (int x=0; x<map.Dim(1); ++x) {
-            double dist = map.SrcDist(y, x, l, b);
-            if(dist < radius)
-                map(y, x) = 1.;
-            else
-                map(y, x) = 0.;
-        }
-    }
+    CapMask mask(map);
+    mask.Apply(l, b, radius);
+    std::string circles = params.GetStrValue("circles");
+    if (circles!="" && circles!="none" && !ApplyCircles(circles.c_str(), mask))
+        return EXIT_FAILURE;
+    mask.CopyTo(map);
+    cout << "Pixels inside: " << mask.Count() << " (" << mask.Evaluations() << " distances evaluated)" << endl;
 
     if(map.Write(outMapFilename))
         return EXIT_FAILURE;
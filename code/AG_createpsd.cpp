@@ -34,6 +34,8 @@
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "pil.h"
 #include "fitsio.h"
@@ -47,6 +49,15 @@ using namespace std;
 		return params[0] * f1 + params[3] * f2;
 	}
 
+/// The distinct values of a column, in increasing order
+static vector<float> uniqueaxis(const vector<float>& column)
+{
+	vector<float> axis(column);
+	sort(axis.begin(), axis.end());
+	axis.erase(unique(axis.begin(), axis.end()), axis.end());
+	return axis;
+}
+
 int AG_createpsd(char *  outfilename, char *  psdtemplate, char *  paramfilename){
 
 	int status = 0;
@@ -92,41 +103,44 @@ int AG_createpsd(char *  outfilename, char *  psdtemplate, char *  paramfilename
 	fits_get_colnum(paramfile, CASEINSEN, (char*)"THETA", &thetacol, &status);
 	int phicol;
 	fits_get_colnum(paramfile, CASEINSEN, (char*)"PHI", &phicol, &status);
-	float energies[1000];
-	float thetas[1000];
-	float phis[360];
-	long nenergies = 0;
-	long nthetas = 0;
-	long nphis = 0;
-	float oldenergy = -1;
-	float oldtheta = -1;
-	float oldphi = -1;
-	for (long row=1; row<nrows; row++) {
-		if (oldenergy != -2) {
-			fits_read_col(paramfile, TFLOAT, energycol, row, 1, 1, NULL, &energies[nenergies], NULL, &status);
-			if (energies[nenergies] < oldenergy) {
-				oldenergy = -2;
-			} else if (energies[nenergies] > oldenergy) {
-				oldenergy = energies[nenergies++];
-			}
-		}
-		if (oldtheta != -2) {
-			fits_read_col(paramfile, TFLOAT, thetacol, row, 1, 1, NULL, &thetas[nthetas], NULL, &status);
-			if (thetas[nthetas] < oldtheta) {
-				oldtheta = -2;
-			} else if (thetas[nthetas] > oldtheta) {
-				oldtheta = thetas[nthetas++];
-			}
-		}
-		if (oldphi != -2) {
-			fits_read_col(paramfile, TFLOAT, phicol, row, 1, 1, NULL, &phis[nphis], NULL, &status);
-			if (phis[nphis] < oldphi) {
-				oldphi = -2;
-			} else if (phis[nphis] > oldphi) {
-				oldphi = phis[nphis++];
-			}
+
+// Read the three axis columns in full and derive the sorted axes
+	vector<float> energycolumn(nrows);
+	vector<float> thetacolumn(nrows);
+	vector<float> phicolumn(nrows);
+	if (nrows > 0) {
+		fits_read_col(paramfile, TFLOAT, energycol, 1, 1, nrows, NULL, &energycolumn[0], NULL, &status);
+		fits_read_col(paramfile, TFLOAT, thetacol, 1, 1, nrows, NULL, &thetacolumn[0], NULL, &status);
+		fits_read_col(paramfile, TFLOAT, phicol, 1, 1, nrows, NULL, &phicolumn[0], NULL, &status);
+	}
+	if (status) {
+		cerr << "Cannot read the ENERGY, THETA and PHI columns of the parameter file" << endl;
+		fits_report_error(stderr, status);
+		return status;
+	}
+	vector<float> energies = uniqueaxis(energycolumn);
+	vector<float> thetas = uniqueaxis(thetacolumn);
+	vector<float> phis = uniqueaxis(phicolumn);
+	long nenergies = energies.size();
+	long nthetas = thetas.size();
+	long nphis = phis.size();
+	cout << "Parameter table grid: " << nenergies << " energies, " << nthetas << " thetas, " << nphis << " phis" << endl;
+
+// The table must hold the complete grid, with the energy varying slowest and phi fastest
+	if (nrows == 0 || nrows != nenergies * nthetas * nphis) {
+		cerr << "The parameter table has " << nrows << " rows instead of " << nenergies * nthetas * nphis << endl;
+		return BAD_DIMEN;
+	}
+	for (long row=0; row<nrows; row++) {
+		long phiind = row % nphis;
+		long thetaind = (row / nphis) % nthetas;
+		long energyind = row / (nphis * nthetas);
+		if (energycolumn[row] != energies[energyind] || thetacolumn[row] != thetas[thetaind] || phicolumn[row] != phis[phiind]) {
+			cerr << "Row " << row+1 << " of the parameter table is out of the (energy, theta, phi) grid order" << endl;
+			return BAD_DIMEN;
 		}
 	}
+
 	long nnewphis = 4 * nphis;
 	float  * newphis = new float[nnewphis];
 	for (int i=0; i<4; i++) for (int phiind=0; phiind<nphis; phiind++)
@@ -170,25 +184,47 @@ int AG_createpsd(char *  outfilename, char *  psdtemplate, char *  paramfilename
 		return status;
 	}
 
+// Read the whole parameter table, one row for each (energy, theta, phi) in this order
+	long ncells = nenergies * nthetas * nphis;
+	float * norms = new float[ncells];
+	float * angs = new float[ncells];
+	float * gammas = new float[ncells];
+	fits_read_col(paramfile, TFLOAT, normcol, 1, 1, ncells, NULL, norms, NULL, &status);
+	fits_read_col(paramfile, TFLOAT, angcol, 1, 1, ncells, NULL, angs, NULL, &status);
+	fits_read_col(paramfile, TFLOAT, gammacol, 1, 1, ncells, NULL, gammas, NULL, &status);
+
+// The King profile of each cell is evaluated once over rho and copied to all
+// the psi values and to the four phi quadrants of the in memory cube
+	long psisize = nrhos;
+	long energysize = psisize * npsis;
+	long thetasize = energysize * nenergies;
+	long phisize = thetasize * nthetas;
+	long cubesize = phisize * nnewphis;
+	float * cube = new float[cubesize];
+	float * kings = new float[nrhos];
 	float params[6]={0.0,0.0,0.0,0.0,1.0,1.0};
-	long row=1;
-	long fpixel[5];
-	for (fpixel[2]=1; fpixel[2]<=nenergies; fpixel[2]++)
-		for (fpixel[3]=1; fpixel[3]<=nthetas; fpixel[3]++)
-			for (int phiind=1; phiind<=nphis; phiind++){
-				fits_read_col(paramfile, TFLOAT, normcol, row, 1, 1, NULL, &params[0], NULL, &status);
-				fits_read_col(paramfile, TFLOAT, angcol, row, 1, 1, NULL, &params[1], NULL, &status);
-				fits_read_col(paramfile, TFLOAT, gammacol, row++, 1, 1, NULL, &params[2], NULL, &status);
-				for (int rhoind=0; rhoind<nrhos; rhoind++){
-					float king = fitking(&rhos[rhoind],params);
-					fpixel[0] = rhoind+1;
-					for (fpixel[1] = 1; fpixel[1]<=npsis; fpixel[1]++)
-						for(int quad=0; quad<4; quad++) {
-							fpixel[4] = quad*nphis+phiind;
-							fits_write_pix(outfile, TFLOAT, fpixel, 1, &king, &status);
-					}
+	long row=0;
+	for (long energyind=0; energyind<nenergies && !status; energyind++)
+		for (long thetaind=0; thetaind<nthetas; thetaind++)
+			for (long phiind=0; phiind<nphis; phiind++, row++) {
+				params[0] = norms[row];
+				params[1] = angs[row];
+				params[2] = gammas[row];
+				for (int rhoind=0; rhoind<nrhos; rhoind++)
+					kings[rhoind] = fitking(&rhos[rhoind],params);
+				for (int quad=0; quad<4; quad++) {
+					float * plane = cube + (quad*nphis+phiind) * phisize + thetaind * thetasize + energyind * energysize;
+					for (long psiind=0; psiind<npsis; psiind++)
+						memcpy(plane + psiind * psisize, kings, nrhos * sizeof(float));
 				}
-	}
+			}
+	delete [] kings;
+	delete [] gammas;
+	delete [] angs;
+	delete [] norms;
+
+	fits_write_img(outfile, TFLOAT, 1, cubesize, cube, &status);
+	delete [] cube;
 	if (status) {
 		cerr << "Problems filling PSD matrix" << endl;
 		fits_report_error(stderr, status);
@@ -257,11 +293,11 @@ int AG_createpsd(char *  outfilename, char *  psdtemplate, char *  paramfilename
 
 	fits_get_colnum(outfile, CASEINSEN, (char*)"ENERGY", &colnum, &status);
 	fits_modify_vector_len(outfile, colnum, nenergies, &status);
-	fits_write_col(outfile, TFLOAT, colnum, 1, 1, nenergies, energies, &status);
+	fits_write_col(outfile, TFLOAT, colnum, 1, 1, nenergies, &energies[0], &status);
 	
 	fits_get_colnum(outfile, CASEINSEN, (char*)"POLAR_ANGLE", &colnum, &status);
 	fits_modify_vector_len(outfile, colnum, nthetas, &status);
-	fits_write_col(outfile, TFLOAT, colnum, 1, 1, nthetas, thetas, &status);
+	fits_write_col(outfile, TFLOAT, colnum, 1, 1, nthetas, &thetas[0], &status);
 
 	fits_get_colnum(outfile, CASEINSEN, (char*)"AZIMUTH_ANGLE", &colnum, &status);
 	fits_modify_vector_len(outfile, colnum, nnewphis, &status);
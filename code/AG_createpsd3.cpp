@@ -31,7 +31,10 @@
 
 #include <cstdio>
 #include <cmath>
+#include <cstring>
 #include <vector>
+#include <map>
+#include <utility>
 #include <iostream>
 #include <fstream>
 
@@ -39,7 +42,7 @@
 #include "fitsio.h"
 #include "TH1F.h"
 #include "TF1.h"
-#include "TGraph.h"
+#include "KingFitTable.h"
 
 using namespace std;
 
@@ -54,9 +57,8 @@ const double fthetas[] = {1.0, 30.0, 35.0, 45.0, 50.0, 60.0};
 const char * phis[] = {"00","45"};
 const int numthetas = 6;
 const int numphis = 2;
-const float dtheta = 5.0;
 const float dphi = 45.0;
-const float numdthetas = 19;
+const float maxtheta = 90.0;
 //const float numdphis = 8;
 
 double fitking(double *x, double *params) {
@@ -136,12 +138,73 @@ public:
 	FitResultList(const char * filename){ Read(filename); }
 };
 
+/// Interpolation in theta of a parameter sampled on fthetas: linear as TGraph::Eval,
+/// or a monotone cubic Hermite spline with the Fritsch-Carlson slopes. Below the
+/// first sample the first segment is extrapolated, above the last one the last
+/// value is kept.
+class ThetaInterp{
+public:
+	double y[numthetas];
+	double slope[numthetas];
+	bool monotone;
+
+	ThetaInterp():monotone(false){}
+
+	void Set(const double * values, bool _monotone){
+		monotone = _monotone;
+		for (int t=0; t<numthetas; t++) {
+			y[t] = values[t];
+			slope[t] = 0.0;
+		}
+		if (!monotone)
+			return;
+		double delta[numthetas-1];
+		for (int t=0; t<numthetas-1; t++)
+			delta[t] = (y[t+1]-y[t]) / (fthetas[t+1]-fthetas[t]);
+		slope[0] = delta[0];
+		slope[numthetas-1] = delta[numthetas-2];
+		for (int t=1; t<numthetas-1; t++)
+			slope[t] = delta[t-1]*delta[t] <= 0 ? 0.0 : (delta[t-1]+delta[t]) / 2.0;
+		for (int t=0; t<numthetas-1; t++) {
+			if (delta[t] == 0) {
+				slope[t] = slope[t+1] = 0.0;
+				continue;
+			}
+			double a = slope[t] / delta[t];
+			double b = slope[t+1] / delta[t];
+			double h = a*a + b*b;
+			if (h > 9.0) {
+				double tau = 3.0 / sqrt(h);
+				slope[t] = tau * a * delta[t];
+				slope[t+1] = tau * b * delta[t];
+			}
+		}
+	}
+
+	double Eval(double theta) const {
+		if (theta > fthetas[numthetas-1])
+			return y[numthetas-1];
+		int t = 0;
+		for ( ; t < numthetas-2 && fthetas[t+1] < theta ; t++){}
+		double h = fthetas[t+1]-fthetas[t];
+		if (!monotone || theta < fthetas[0])
+			return y[t] + (theta-fthetas[t]) * (y[t+1]-y[t]) / h;
+		double s = (theta-fthetas[t]) / h;
+		double s2 = s*s;
+		double s3 = s2*s;
+		return (2*s3-3*s2+1)*y[t] + (s3-2*s2+s)*h*slope[t] + (-2*s3+3*s2)*y[t+1] + (s3-s2)*h*slope[t+1];
+	}
+};
+
 class ParamGrid{
 public:
 
 	FitResultList fitlists[numthetas * numphis];
 	TString _filterev;
 	double rhos[numrhos];
+	vector<ThetaInterp> angtables;
+	vector<ThetaInterp> gammatables;
+	map<pair<float, float>, double> norms;
 	
 	ParamGrid():_filterev("_FMG"){}
 	~ParamGrid(){}
@@ -186,31 +249,44 @@ public:
 		return t;
 	}
 	
-	double angle(int e, int p, float theta){
-		double angles[numthetas];
-		for (int t=0; t<numthetas; t++)
-			angles[t] = fitlists[ind(t,p)].fitresults[e].ang;
-		if (theta > fthetas[numthetas-1])
-			return angles[numthetas-1];
-		else {
-			TGraph anggraph(numthetas, fthetas, angles);
-			return anggraph.Eval(theta);
+	/// The interpolation tables of ang and gamma in theta, for each energy and phi
+	void Prepare(bool monotone){
+		int numenergies = fitlists[0].energies.size();
+		angtables.assign(numenergies * numphis, ThetaInterp());
+		gammatables.assign(numenergies * numphis, ThetaInterp());
+		norms.clear();
+		for (int e=0; e<numenergies; e++) for (int p=0; p<numphis; p++) {
+			double angles[numthetas];
+			double gammas[numthetas];
+			for (int t=0; t<numthetas; t++) {
+				angles[t] = fitlists[ind(t,p)].fitresults[e].ang;
+				gammas[t] = fitlists[ind(t,p)].fitresults[e].gamma;
+			}
+			angtables[e*numphis+p].Set(angles, monotone);
+			gammatables[e*numphis+p].Set(gammas, monotone);
 		}
 	}
 
+	double angle(int e, int p, float theta){
+		return angtables[e*numphis+p].Eval(theta);
+	}
+
 	double gamma(int e, int p, float theta){
-		double gammas[numthetas];
-		for (int t=0; t<numthetas; t++)
-			gammas[t] = fitlists[ind(t,p)].fitresults[e].gamma;
-		if (theta > fthetas[numthetas-1])
-			return gammas[numthetas-1];
-		else {
-			TGraph gammagraph(numthetas, fthetas, gammas);
-			return gammagraph.Eval(theta);
-		}
+		return gammatables[e*numphis+p].Eval(theta);
+	}
+
+	/// The normalization is computed once for each (gamma, ang) pair
+	double norm(float gamma, float ang){
+		pair<float, float> key(gamma, ang);
+		map<pair<float, float>, double>::const_iterator it = norms.find(key);
+		if (it != norms.end())
+			return it->second;
+		double val = kingnorm(gamma, ang);
+		norms[key] = val;
+		return val;
 	}
 
-	double norm(double_t gamma, Double_t ang){
+	double kingnorm(double gamma, double ang){
 		double params[3];
 		params[0] = 1.0;
 		params[1] = ang;
@@ -224,108 +300,40 @@ public:
 		return 1.0 / (psfcoeff * psfsum);
 	}
 	
-	int Write(const char * outfilename){
-		int tfields = 11;
-		char ** ttype = new char*[tfields];
-		char ** tform = new char*[tfields];
-		char ** tunit = new char*[tfields];
-		for (int i=0; i<tfields; i++) {
-			ttype[i] = new char[FLEN_FILENAME];
-			tform[i] = new char[FLEN_FILENAME];
-			tunit[i] = new char[FLEN_FILENAME];
-		}
-		strcpy(ttype[0],"ENERGY");
-		strcpy(tform[0],"1E");
-		strcpy(tunit[0],"MeV");
-		strcpy(ttype[1],"THETA");
-		strcpy(tform[1],"1E");
-		strcpy(tunit[1],"degrees");
-		strcpy(ttype[2],"PHI");
-		strcpy(tform[2],"1E");
-		strcpy(tunit[2],"degrees");
-		strcpy(ttype[3],"NORM");
-		strcpy(tform[3],"1E");
-		strcpy(tunit[3],"degrees^-1");
-		strcpy(ttype[4],"NORM_ERR");
-		strcpy(tform[4],"1E");
-		strcpy(tunit[4],"degrees^-1");
-		strcpy(ttype[5],"ANG");
-		strcpy(tform[5],"1E");
-		strcpy(tunit[5],"degrees");
-		strcpy(ttype[6],"ANG_ERR");
-		strcpy(tform[6],"1E");
-		strcpy(tunit[6],"degrees");
-		strcpy(ttype[7],"GAMMA");
-		strcpy(tform[7],"1E");
-		strcpy(tunit[7],"");
-		strcpy(ttype[8],"GAMMA_ERR");
-		strcpy(tform[8],"1E");
-		strcpy(tunit[8],"");
-		strcpy(ttype[9],"CHI2");
-		strcpy(tform[9],"1E");
-		strcpy(tunit[9],"");
-		strcpy(ttype[10],"NDF");
-		strcpy(tform[10],"1J");
-		strcpy(tunit[10],"");
-		
-		fitsfile * fp;
-		int status=0;
-		fits_create_file(&fp, outfilename, &status);
-		if (status==0) 
-			fits_create_tbl(fp, BINARY_TBL, 0, tfields, ttype, tform, tunit, "PSDPARAMS", &status);
-		else
-			cerr << "File not created : status = " << status << endl;
-		long rownum = 0;
-		cout << fitlists[0].energies.size() << " " ;
-		if (status==0) for (unsigned int e=0; e < fitlists[0].energies.size(); e++) {
+	int Write(const char * outfilename, float dtheta){
+		int numdthetas = int(maxtheta / dtheta + 0.5) + 1;
+		KingFitTable table;
+		table.Reserve(fitlists[0].energies.size() * numdthetas * numphis);
+		cout << fitlists[0].energies.size() << " energies, " << numdthetas << " thetas, " << numphis << " phis" << endl;
+		for (unsigned int e=0; e < fitlists[0].energies.size(); e++) {
 			float energy = fitlists[0].energies[e];
-			for (float tt=0; tt<numdthetas; tt++) {
+			for (int tt=0; tt<numdthetas; tt++) {
 				float theta = 0.0 + tt * dtheta;
 				int t = findt(theta);
 				for (int pp=0; pp<numphis; pp++) {
 					float phi = 0.0 + pp * dphi;
 					int p = pp % 2;
-					cout << energy << " " << theta << " " << phi << " ";
-					cout << e << " " << t << " " << p << " ";
-					if (status==0) fits_write_col(fp, TFLOAT, 1, ++rownum, 1, 1, &energy, &status);
-					if (status==0) fits_write_col(fp, TFLOAT, 2, rownum, 1, 1, &theta, &status);
-					if (status==0) fits_write_col(fp, TFLOAT, 3, rownum, 1, 1, &phi, &status);
+					const FitResults& fit = fitlists[ind(t,p)].fitresults[e];
 					float angval = angle(e, p, theta);
-					if (status==0) fits_write_col(fp, TFLOAT, 6, rownum, 1, 1, &angval, &status);
-					cout << angval << endl;
-					float value = angval * fitlists[ind(t,p)].fitresults[e].ang_err / fitlists[ind(t,p)].fitresults[e].ang;
-					if (status==0) fits_write_col(fp, TFLOAT, 7, rownum, 1, 1, &value, &status);
 					float gammaval = gamma(e, p, theta);
-					if (status==0) fits_write_col(fp, TFLOAT, 8, rownum, 1, 1, &gammaval, &status);
-					value = gammaval * fitlists[ind(t,p)].fitresults[e].gamma_err / fitlists[ind(t,p)].fitresults[e].gamma;
-					if (status==0) fits_write_col(fp, TFLOAT, 9, rownum, 1, 1, &value, &status);
 					float normval = norm(gammaval, angval);
-					if (status==0) fits_write_col(fp, TFLOAT, 4, rownum, 1, 1, &normval, &status);
-					value = normval * fitlists[ind(t,p)].fitresults[e].norm_err / fitlists[ind(t,p)].fitresults[e].norm;
-					if (status==0) fits_write_col(fp, TFLOAT, 5, rownum, 1, 1, &value, &status);
-					value = fitlists[ind(t,p)].fitresults[e].chi2;
-					if (status==0) fits_write_col(fp, TFLOAT, 10, rownum, 1, 1, &value, &status);
-					value = fitlists[ind(t,p)].fitresults[e].ndf;
-					if (status==0) fits_write_col(fp, TLONG, 11, rownum, 1, 1, &value, &status);
+					table.Append(energy, theta, phi,
+						normval, normval * fit.norm_err / fit.norm,
+						angval, angval * fit.ang_err / fit.ang,
+						gammaval, gammaval * fit.gamma_err / fit.gamma,
+						fit.chi2, int(fit.ndf));
 				}
 			}
-		} else
-			cerr << "Table not created: status = " << status << endl;
-		if (status==0) fits_close_file(fp, &status);
-		for (int i=0; i<tfields; i++) {
-			delete [] ttype[i];
-			delete [] tform[i];
-			delete [] tunit[i];
 		}
-		delete [] ttype;
-		delete [] tform;
-		delete [] tunit;
+		int status = table.Write(outfilename);
+		if (status)
+			cerr << "Table not created: status = " << status << endl;
 		return status;
 	}
 };
 
 
-int AG_createpsd3(const char *  dataprefix, const char * outprefix) {
+int AG_createpsd3(const char *  dataprefix, const char * outprefix, float dtheta, bool monotone) {
 	
 	TString opre(outprefix);
 	int status=0;
@@ -338,8 +346,9 @@ int AG_createpsd3(const char *  dataprefix, const char * outprefix) {
 		TString filterev = filter[f] + evtype[ev];
 		TString outfilename = opre + filterev + "_table.fits.gz";
 		ParamGrid paramgrid(dataprefix, filterev.Data());
+		paramgrid.Prepare(monotone);
 		cout << "Writing to " << outfilename << endl;
-		status = paramgrid.Write(outfilename.Data());
+		status = paramgrid.Write(outfilename.Data(), dtheta);
 	}
 	return status;
 }
@@ -357,6 +366,13 @@ int main(int argc,char **argv)
 	status = PILGetNumParameters(&numpar);
 	status = PILGetString("dataprefix", dataprefix);
 	status = PILGetString("outprefix", outprefix);
+	double dtheta = 5.0;
+	if (PILGetReal("dtheta", &dtheta) || dtheta <= 0)
+		dtheta = 5.0;
+	char interpolation[FLEN_FILENAME] = "linear";
+	if (PILGetString("interpolation", interpolation))
+		strcpy(interpolation, "linear");
+	bool monotone = !strcmp(interpolation, "monotone");
 
 	status = PILClose(status);
 
@@ -370,10 +386,12 @@ int main(int argc,char **argv)
 	cout << " "<< endl;
 	cout << "Data filename prefix : "<< dataprefix << endl;
 	cout << "Output filename prefix : " <<  outprefix << endl;
+	cout << "Theta step : " <<  dtheta << endl;
+	cout << "Theta interpolation : " <<  (monotone ? "monotone" : "linear") << endl;
 	
 
 	cout << "AG_createpsd3...............................starting"<< endl;		
-	status = AG_createpsd3(dataprefix, outprefix);
+	status = AG_createpsd3(dataprefix, outprefix, dtheta, monotone);
 	if (status == 0)
 		cout << "AG_createpsd3............................... exiting"<< endl;		
 	else {
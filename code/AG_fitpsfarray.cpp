@@ -33,262 +33,319 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include <fstream>
+#include <sstream>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "pil.h"
 #include "fitsio.h"
 #include "CalibUtils.h"
 #include "MathUtils.h"
 #include "TCanvas.h"
-#include "TH1F.h"
 #include "TH2F.h"
 #include "TH2I.h"
-#include "TF1.h"
-#include "TH3F.h"
 #include "TStyle.h"
 #include "TFile.h"
+#include "KingFit.h"
+#include "KingFitTable.h"
+#include "KingFitPlot.h"
+#include "ResponsePack.h"
 
 using namespace std;
 
-	Double_t fitking(Double_t *x, Double_t *params) {
-//		TFormula f("kingfunction", "(1. - 1./[1]) * std::pow(1. +  ((x/[0])**2.)/(2.0*[1]), -[1])");
-		Double_t f1 = (1. - 1./params[2]) * pow(1. +  (x[0]*x[0]/params[1]/params[1])/(2.0 * params[2]), -params[2]);
-		Double_t f2 = (1. - 1./params[5]) * pow(1. +  (x[0]*x[0]/params[4]/params[4])/(2.0 * params[5]), -params[5]);
-		return params[0] * f1 + params[3] * f2;
+/// The profile of one (energy, theta, phi) cell, scaled to 100 in its second
+/// sample as the first bin of the former histograms, and its King parameters
+struct CellResult {
+	vector<double> profile;
+	double params[6];
+	float scale;
+	KingFitResult fit;
+	string line;
+};
+
+static mutex coutMutex;
+
+/// The PSD grid to fit, read from the PSD file or from a response pack.
+/// The values are in the FITS order of the PSD image, rho fastest, then
+/// psi, energy, theta and phi.
+struct PsdCube {
+	vector<float> rhos, psis, energies, thetas, phis;
+	const float* values;
+	vector<float> storage;
+
+	/// The rho profile of the first psi of a cell
+	const float* Profile(int phi, int theta, int energy) const
+	{
+		return values + ((size_t(phi)*thetas.size()+theta)*energies.size()+energy)*psis.size()*rhos.size();
+	}
+};
+
+static void CopyAxis(const VecF& axis, vector<float>& dest)
+{
+	dest.assign(axis.Buffer(), axis.Buffer()+axis.Size());
+}
+
+static void ReadPsdFile(const char* psdfilename, PsdCube& psd)
+{
+	PsfGrid psf(psdfilename);
+	CopyAxis(psf.Rhos(), psd.rhos);
+	CopyAxis(psf.Psis(), psd.psis);
+	CopyAxis(psf.Energies(), psd.energies);
+	CopyAxis(psf.Thetas(), psd.thetas);
+	CopyAxis(psf.Phis(), psd.phis);
+	size_t count = psd.rhos.size()*psd.psis.size()*psd.energies.size()*psd.thetas.size()*psd.phis.size();
+	psd.storage.assign(psf.Values().Buffer(), psf.Values().Buffer()+count);
+	psd.values = &psd.storage[0];
+}
+
+static bool PackAxis(const ResponsePack& pack, int source, const char* column, vector<float>& dest)
+{
+	const ResponsePackArray* array = pack.Find(source, column);
+	if (!array || array->type!=PackFloat64)
+		return false;
+	const double* data = static_cast<const double*>(pack.Data(*array));
+	dest.assign(data, data+array->count);
+	return true;
+}
+
+/// Take the PSD grid from a response pack, if the pack holds the PSD file
+/// and the file did not change since the pack was built. The axes are the
+/// columns written by AG_createpsd.
+static bool ReadPsdPack(const ResponsePack& pack, const char* psdfilename, PsdCube& psd)
+{
+	int source = pack.FindSource(psdfilename);
+	if (source<0) {
+		cout << psdfilename << " is not in the response pack" << endl;
+		return false;
+	}
+	if (!pack.IsCurrent(source)) {
+		cout << psdfilename << " changed after the response pack was built" << endl;
+		return false;
+	}
+	const ResponsePackArray* image = pack.Find(source, "PRIMARY");
+	if (!image || image->ndims!=5 || !PackAxis(pack, source, "RHO", psd.rhos) || !PackAxis(pack, source, "PSI", psd.psis)
+	    || !PackAxis(pack, source, "ENERGY", psd.energies) || !PackAxis(pack, source, "POLAR_ANGLE", psd.thetas)
+	    || !PackAxis(pack, source, "AZIMUTH_ANGLE", psd.phis)
+	    || image->dims[0]!=psd.rhos.size() || image->dims[1]!=psd.psis.size() || image->dims[2]!=psd.energies.size()
+	    || image->dims[3]!=psd.thetas.size() || image->dims[4]!=psd.phis.size()) {
+		cout << "The PSD grid of the response pack is not complete" << endl;
+		return false;
+	}
+	if (image->type==PackFloat32) {
+		psd.values = static_cast<const float*>(pack.Data(*image));
+		psd.storage.clear();
+	}
+	else {
+		const double* data = static_cast<const double*>(pack.Data(*image));
+		psd.storage.assign(data, data+image->count);
+		psd.values = &psd.storage[0];
+	}
+	return true;
+}
+
+static void fitcell(const PsdCube& psf, const KingFit& king, const vector<double>& rhos, const TString& basename,
+		int energy, int theta, int phi, bool dofit, CellResult& result)
+{
+	TString outname(basename);
+	outname += "_";
+	outname += int(psf.energies[energy]);
+	outname += "_";
+	outname += int(psf.thetas[theta]);
+	outname += "_";
+	outname += int(psf.phis[phi]);
+	{
+		lock_guard<mutex> lock(coutMutex);
+		cout << outname << endl;
+	}
+
+	long nrhos = rhos.size();
+	const float * values = psf.Profile(phi,theta,energy);
+	result.scale = 100.0/values[1];
+	result.profile.resize(nrhos);
+	for (long rho=0; rho<nrhos; rho++)
+		result.profile[rho] = values[rho] * result.scale;
+
+	double start[6] = { 100.0, energy >= 5 ? 0.1 : 1.0, 1.5, 0.0, 0.1, 0.1 };
+	for (int par=0; par<6; par++)
+		result.params[par] = start[par];
+	if (dofit)
+		result.fit = king.Fit(&rhos[0], &result.profile[0], 0, nrhos, result.params);
+	else {
+		result.fit.norm = start[0];
+		result.fit.ang = start[1];
+		result.fit.gamma = start[2];
+		result.fit.normErr = result.fit.angErr = result.fit.gammaErr = 0;
+		result.fit.chi2 = 0;
+		result.fit.ndf = 0;
+		result.fit.iterations = 0;
+		result.fit.converged = false;
 	}
 
-void AG_fitpsfarray(char *  outfilename, char *  psdfilename) {
+	ostringstream line;
+	line << psf.energies[energy] << " " << psf.thetas[theta] << " " << psf.phis[phi] << " " 
+		<< result.fit.norm/result.scale << " " << result.fit.ang << " " << result.fit.gamma << " " <<  result.fit.chi2 << " " << endl;
+	result.line = line.str();
+}
+
+static void fitworker(const PsdCube& psf, const KingFit& king, const vector<double>& rhos, const TString& basename,
+		int nthetas, bool dofit, vector<CellResult>& results, atomic<int>& next)
+{
+	int count = results.size();
+	for (int cell=next++; cell<count; cell=next++) {
+		int phi = cell % 2;
+		int theta = (cell / 2) % nthetas;
+		int energy = cell / (2 * nthetas);
+		fitcell(psf, king, rhos, basename, energy, theta, phi, dofit, results[cell]);
+	}
+}
+
+void AG_fitpsfarray(char *  outfilename, char *  psdfilename, char *  packfilename, int nthreads, bool dofit, bool plots) {
 	
 	TString basename(outfilename);
 
-// read PSD matrix
-	/* float ******psfgrid;
-	float **psfrho;
-	float **psfpsi;
-	float **psftheta;
-	float **psfphi;
-	float **psfenergy;
-	long naxes[5];
-		psfgrid = new  float ***** [1];
-		psfrho = new  float * [1];
-		psfpsi = new  float * [1];		
-		psftheta = new  float * [1];
-		psfphi = new  float * [1];
-		psfenergy = new  float * [1];
-		alikeReadPsf(psdfilename, psfgrid, psfrho, psfpsi, psftheta, psfphi, psfenergy, naxes);
-	 */
-	PsfGrid psf(psdfilename);
+// read PSD matrix, from the response pack when it is up to date
+	PsdCube psf;
+	ResponsePack pack;
+	bool packed = strcmp(packfilename, "none") && pack.Open(packfilename) && ReadPsdPack(pack, psdfilename, psf);
+	if (packed)
+		cout << "PSD grid read from " << packfilename << endl;
+	else
+		ReadPsdFile(psdfilename, psf);
 	
 	long naxes[5];
-	naxes[0] = psf.Rhos().Size();
-	naxes[1] = psf.Psis().Size();
-	naxes[2] = psf.Energies().Size();
-	naxes[3] = psf.Thetas().Size();
-	naxes[4] = psf.Phis().Size();
-	float * psfrho = new float[naxes[0]];
+	naxes[0] = psf.rhos.size();
+	naxes[1] = psf.psis.size();
+	naxes[2] = psf.energies.size();
+	naxes[3] = psf.thetas.size();
+	naxes[4] = psf.phis.size();
 	
 	float * psfene2 = new float[naxes[2]+1];
-	for (int i=0;i<naxes[2];i++) psfene2[i]=psf.Energies()[i];
+	for (int i=0;i<naxes[2];i++) psfene2[i]=psf.energies[i];
 	psfene2[naxes[2]]=50000;
 	
-	float drho = psf.Rhos()[1]-psf.Rhos()[0];
-	for (int rho=0; rho<naxes[0] ; rho++) psfrho[rho] = psf.Rhos()[rho]-0.5*drho ;
-	TF1 * Tfitking = new TF1("Tfitking", fitking, psfrho[0], psfrho[naxes[0]-1]+drho, 6);
+	float drho = psf.rhos[1]-psf.rhos[0];
+	vector<double> rhos(naxes[0]);
+	for (int rho=0; rho<naxes[0] ; rho++) rhos[rho] = psf.rhos[rho];
+
+// weighted least squares fit of the scaled profile, all the weights equal to 1
+	KingFit king;
+	king.SetLimits(0,0.0,1000.0);
+	king.SetLimits(1,0.0,12.0);
+	king.SetLimits(2,0.0,12.0);
 
 	ofstream ofout((basename+".txt").Data());
 
 // prepare histograms
 	TH2F norm[2];
-	norm[0] = TH2F("Norm0","Norm 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
-	norm[1] = TH2F("Norm45","Norm 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
+	norm[0] = TH2F("Norm0","Norm 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
+	norm[1] = TH2F("Norm45","Norm 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
 	TH2F ang[2];
-	ang[0] = TH2F("Ang0","Angular Scale 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
-	ang[1] = TH2F("Ang45","Angular Scale 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
+	ang[0] = TH2F("Ang0","Angular Scale 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
+	ang[1] = TH2F("Ang45","Angular Scale 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
 	TH2F gamma[2];
-	gamma[0] = TH2F("Gamma0","Gamma 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
-	gamma[1] = TH2F("Gamma45","Gamma 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
+	gamma[0] = TH2F("Gamma0","Gamma 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
+	gamma[1] = TH2F("Gamma45","Gamma 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
 	TH2F chi2[2];
-	chi2[0] = TH2F("Chi^2 0","Chi^2 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
-	chi2[1] = TH2F("Chi^2 45","Chi^2 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
+	chi2[0] = TH2F("Chi^2 0","Chi^2 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
+	chi2[1] = TH2F("Chi^2 45","Chi^2 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
 	TH2I ndf[2];
-	ndf[0] = TH2I("NDF 0","NDF 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
-	ndf[1] = TH2I("NDF 45","NDF 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,psf.Thetas().Buffer());
+	ndf[0] = TH2I("NDF 0","NDF 0;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
+	ndf[1] = TH2I("NDF 45","NDF 45;E (MeV);#theta (deg)",naxes[2],psfene2,naxes[3]-1,&psf.thetas[0]);
 
 	delete [] psfene2;
 	gStyle->SetOptStat("");
 	gStyle->SetOptFit(0000);
-//	int badgammas = 0;
 
+// the cells are independent: each thread takes the next one, the results are
+// collected in the serial order and the outputs are written after the fits
+	vector<CellResult> results(naxes[2]*naxes[3]*2);
+	if (nthreads < 1)
+		nthreads = thread::hardware_concurrency();
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > int(results.size()))
+		nthreads = results.size();
+	cout << results.size() << " cells on " << nthreads << " threads" << endl;
+	atomic<int> next(0);
+	vector<thread> threads;
+	for (int t=0; t<nthreads; t++)
+		threads.push_back(thread(fitworker, cref(psf), cref(king), cref(rhos), cref(basename), int(naxes[3]), dofit, ref(results), ref(next)));
+	for (int t=0; t<nthreads; t++)
+		threads[t].join();
+
+	KingFitTable table;
+	table.Reserve(results.size());
+	int cell = 0;
 	for (int energy=0; energy<naxes[2]; energy++)
 		for (int theta=0; theta<naxes[3]; theta++)
 			for (int phi=0; phi<2; phi++) {
-				TCanvas * c0 = new TCanvas("","");
-				TString outname(basename);
-				outname += "_";
-				outname += int(psf.Energies()[energy]);
-				outname += "_";
-				outname += int(psf.Thetas()[theta]);
-				outname += "_";
-				outname += int(psf.Phis()[phi]);
-				cout << outname << endl;
-
-				TH1F psfhist("psf",(outname+";#theta (deg)").Data(),naxes[0]-1,psfrho);
-				c0->SetBottomMargin(0.2);
-				c0->SetFillColor(kWhite);
-//				c0->SetLineColor(kBlack);
-				psfhist.GetXaxis()->SetLabelSize(0.06);
-				psfhist.GetYaxis()->SetLabelSize(0.06);
-				psfhist.GetXaxis()->SetTitleSize(0.06);
-				psfhist.GetYaxis()->SetTitleSize(0.06);
-				psfhist.Set(naxes[0], psf.Values().Buffer()+psf.Values().AbsIndex(phi,theta,energy,0,0));
-				float scale = 100.0/psfhist.GetBinContent(1);
-				psfhist.Scale(scale);
-				psfhist.GetXaxis()->SetRange(0,0);
-				psfhist.Draw("HIST");
-				Tfitking->SetParameter(0,100.0);
-				if (energy >= 5) 
-					Tfitking->SetParameter(1,0.1);
-				else
-					Tfitking->SetParameter(1,1.0);					
-				Tfitking->SetParameter(2,1.5);
-				Tfitking->SetParLimits(0,0.0,1000.0);
-				Tfitking->SetParLimits(1,0.0,12.0);
-				Tfitking->SetParLimits(2,0.0,12.0);
-				Tfitking->FixParameter(3,0.0);
-				Tfitking->FixParameter(4,0.1);
-				Tfitking->FixParameter(5,0.1);
-//				psfhist.Fit("Tfitking","WW","E0");
-				Tfitking->ReleaseParameter(0);
-				Tfitking->ReleaseParameter(1);
-				Tfitking->ReleaseParameter(2);
-//				psfhist.Fit("Tfitking","EMWW");
-//				Tfitking->ReleaseParameter(3);
-//				Tfitking->ReleaseParameter(4);
-//				Tfitking->ReleaseParameter(5);
-//				Tfitking->SetParameter(3,1.0);
-//				psfhist.Fit("Tfitking","EMWW");
-
-				ofout << psf.Energies()[energy] << " " << psf.Thetas()[theta] << " " << psf.Phis()[phi] << " " 
-					<< Tfitking->GetParameter(0)/scale << " " << Tfitking->GetParameter(1) << " " << Tfitking->GetParameter(2) << " " <<  Tfitking->GetChisquare() << " " << endl;
-					
-				int maxnonzero = naxes[0];
-				for ( ; psfhist.GetBinContent(maxnonzero) <= 5 ; maxnonzero--)
-				psfhist.GetXaxis()->SetRange(1, maxnonzero);
-				cout << maxnonzero << endl;
-				outname += ".eps";
-				c0->Print(outname.Data());
-				delete c0;
-
-				norm[phi].SetBinContent(energy+1,theta+1,Tfitking->GetParameter(0)/scale);
-				norm[phi].SetBinError(energy+1,theta+1,Tfitking->GetParError(0)/scale);
-				ang[phi].SetBinContent(energy+1,theta+1,Tfitking->GetParameter(1));
-				ang[phi].SetBinError(energy+1,theta+1,Tfitking->GetParError(1));
-				float p2=Tfitking->GetParameter(2);
-//				if (p2 < 1e4) {
-					gamma[phi].SetBinContent(energy+1,theta+1,p2);
-					gamma[phi].SetBinError(energy+1,theta+1,Tfitking->GetParError(2));
-//				} else {
-//					gamma[phi].SetBinContent(energy+1,theta+1,1.0);
-//					gamma[phi].SetBinError(energy+1,theta+1,Tfitking->GetParError(2));
-//					badgammas++;
-//				}
-				chi2[phi].SetBinContent(energy+1,theta+1,Tfitking->GetChisquare());
-				ndf[phi].SetBinContent(energy+1,theta+1,Tfitking->GetNDF());
+				const CellResult& result = results[cell++];
+				const KingFitResult& fit = result.fit;
+				ofout << result.line;
+				norm[phi].SetBinContent(energy+1,theta+1,fit.norm/result.scale);
+				norm[phi].SetBinError(energy+1,theta+1,fit.normErr/result.scale);
+				ang[phi].SetBinContent(energy+1,theta+1,fit.ang);
+				ang[phi].SetBinError(energy+1,theta+1,fit.angErr);
+				gamma[phi].SetBinContent(energy+1,theta+1,fit.gamma);
+				gamma[phi].SetBinError(energy+1,theta+1,fit.gammaErr);
+				chi2[phi].SetBinContent(energy+1,theta+1,fit.chi2);
+				ndf[phi].SetBinContent(energy+1,theta+1,fit.ndf);
+				table.Append(psf.energies[energy], psf.thetas[theta], psf.phis[phi],
+					fit.norm/result.scale, fit.normErr/result.scale, fit.ang, fit.angErr,
+					fit.gamma, fit.gammaErr, fit.chi2, fit.ndf);
 	}
 	ofout.close();
-	delete [] psfrho;
-	
-	int tfields = 11;
-	char ** ttype = new char*[tfields];
-	char ** tform = new char*[tfields];
-	char ** tunit = new char*[tfields];
-	for (int i=0; i<tfields; i++) {
-		ttype[i] = new char[FLEN_FILENAME];
-		tform[i] = new char[FLEN_FILENAME];
-		tunit[i] = new char[FLEN_FILENAME];
-	}
-	strcpy(ttype[0],"ENERGY");
-	strcpy(tform[0],"1E");
-	strcpy(tunit[0],"MeV");
-	strcpy(ttype[1],"THETA");
-	strcpy(tform[1],"1E");
-	strcpy(tunit[1],"degrees");
-	strcpy(ttype[2],"PHI");
-	strcpy(tform[2],"1E");
-	strcpy(tunit[2],"degrees");
-	strcpy(ttype[3],"NORM");
-	strcpy(tform[3],"1E");
-	strcpy(tunit[3],"degrees^-1");
-	strcpy(ttype[4],"NORM_ERR");
-	strcpy(tform[4],"1E");
-	strcpy(tunit[4],"degrees^-1");
-	strcpy(ttype[5],"ANG");
-	strcpy(tform[5],"1E");
-	strcpy(tunit[5],"degrees");
-	strcpy(ttype[6],"ANG_ERR");
-	strcpy(tform[6],"1E");
-	strcpy(tunit[6],"degrees");
-	strcpy(ttype[7],"GAMMA");
-	strcpy(tform[7],"1E");
-	strcpy(tunit[7],"");
-	strcpy(ttype[8],"GAMMA_ERR");
-	strcpy(tform[8],"1E");
-	strcpy(tunit[8],"");
-	strcpy(ttype[9],"CHI2");
-	strcpy(tform[9],"1E");
-	strcpy(tunit[9],"");
-	strcpy(ttype[10],"NDF");
-	strcpy(tform[10],"1J");
-	strcpy(tunit[10],"");
-	
-	fitsfile * fp;
-	int status=0;
-	fits_create_file(&fp, (basename+"_table.fits.gz").Data(), &status);
-	if (status==0) fits_create_tbl(fp, BINARY_TBL, 0, tfields, ttype, tform, tunit, "PSDPARAMS", &status);
-	int rownum = 0;
-	if (status==0) for (int energy=0; energy<naxes[2]; energy++)
-		for (int theta=0; theta<naxes[3]; theta++)
-			for (int phi=0; phi<2; phi++) {
-				float value = psf.Energies()[energy];
-				if (status==0) fits_write_col(fp, TFLOAT, 1, ++rownum, 1, 1, &value, &status);
-				value = psf.Thetas()[theta];
-				if (status==0) fits_write_col(fp, TFLOAT, 2, rownum, 1, 1, &value, &status);
-				value = psf.Phis()[phi];
-				if (status==0) fits_write_col(fp, TFLOAT, 3, rownum, 1, 1, &value, &status);
-				value = norm[phi].GetBinContent(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 4, rownum, 1, 1, &value, &status);
-				value = norm[phi].GetBinError(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 5, rownum, 1, 1, &value, &status);
-				value = ang[phi].GetBinContent(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 6, rownum, 1, 1, &value, &status);
-				value = ang[phi].GetBinError(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 7, rownum, 1, 1, &value, &status);
-				value = gamma[phi].GetBinContent(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 8, rownum, 1, 1, &value, &status);
-				value = gamma[phi].GetBinError(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 9, rownum, 1, 1, &value, &status);
-				value = chi2[phi].GetBinContent(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TFLOAT, 10, rownum, 1, 1, &value, &status);
-				int value2 = ndf[phi].GetBinContent(energy+1,theta+1);
-				if (status==0) fits_write_col(fp, TLONG, 11, rownum, 1, 1, &value2, &status);
+
+	int status = table.Write((basename+"_table.fits.gz").Data());
+	if (status)
+		fits_report_error(stderr, status);
+
+// the plots are drawn after the fits, one cell at a time
+	if (plots) {
+		cell = 0;
+		for (int energy=0; energy<naxes[2]; energy++)
+			for (int theta=0; theta<naxes[3]; theta++)
+				for (int phi=0; phi<2; phi++) {
+					const CellResult& result = results[cell++];
+					TString outname(basename);
+					outname += "_";
+					outname += int(psf.energies[energy]);
+					outname += "_";
+					outname += int(psf.thetas[theta]);
+					outname += "_";
+					outname += int(psf.phis[phi]);
+					KingFitPlot::Plot((outname+".eps").Data(), (outname+";#theta (deg)").Data(), king, result.params,
+						&rhos[0], &result.profile[0], naxes[0], drho);
+		}
 	}
-	if (status==0) fits_close_file(fp, &status);
 	
-	TCanvas * c0 = new TCanvas("","");
-	gPad->SetLogx(1);
+	TCanvas * c0 = plots ? new TCanvas("","") : 0;
+	if (plots)
+		gPad->SetLogx(1);
 	TFile f(basename+"_histos.root","recreate");
 	for (Long_t phi=0;phi<2;phi++){
-		gPad->SetLogz(1);
-		norm[phi].Draw("SURF1");
-		c0->Print((basename+phi+"_norm.eps").Data());
+		if (plots) {
+			gPad->SetLogz(1);
+			norm[phi].Draw("SURF1");
+			c0->Print((basename+phi+"_norm.eps").Data());
+		}
 		norm[phi].Write();
-		ang[phi].Draw("SURF1");
-		c0->Print((basename+phi+"_ang.eps").Data());
+		if (plots) {
+			ang[phi].Draw("SURF1");
+			c0->Print((basename+phi+"_ang.eps").Data());
+			gPad->SetLogz(0);
+		}
 		ang[phi].Write();
-		gPad->SetLogz(0);
 		gamma[phi].SetMaximum(4.5);
-		gamma[phi].Draw("SURF1");
-		c0->Print((basename+phi+"_gamma.eps").Data());
+		if (plots) {
+			gamma[phi].Draw("SURF1");
+			c0->Print((basename+phi+"_gamma.eps").Data());
+		}
 		gamma[phi].Write();
 	}
 	delete c0;
@@ -303,11 +360,19 @@ int main(int argc,char **argv)
 	int status = 0, numpar = 0;
 	char * outfilename = new char[FLEN_FILENAME];
 	char * psdfilename  = new char[FLEN_FILENAME];
+	char * packfilename  = new char[FLEN_FILENAME];
 	
 	status = PILInit(argc,argv);
 	status = PILGetNumParameters(&numpar);
 	status = PILGetString("outfile", outfilename);
 	status = PILGetString("psdfile", psdfilename);
+	status = PILGetString("packfile", packfilename);
+	int nthreads = 1;
+	int plots = 0;
+	int dofit = 0;
+	status = PILGetInt("threads", &nthreads);
+	status = PILGetBool("fit", &dofit);
+	status = PILGetBool("plots", &plots);
 
 	status = PILClose(status);
 
@@ -321,10 +386,14 @@ int main(int argc,char **argv)
 	cout << " "<< endl;
 	cout << "Output file name : " <<  outfilename << endl;
 	cout << "PSD file name : "<< psdfilename << endl;
+	cout << "Response pack file name : "<< packfilename << endl;
+	cout << "Threads : "<< nthreads << endl;
+	cout << "Fit : "<< (dofit ? "yes" : "no") << endl;
+	cout << "Plots : "<< (plots ? "yes" : "no") << endl;
 	
 
 	cout << "AG_fitpsfarray...............................starting"<< endl;		
-	AG_fitpsfarray(outfilename, psdfilename);
+	AG_fitpsfarray(outfilename, psdfilename, packfilename, nthreads, dofit, plots);
 	cout << "AG_fitpsfarray............................... exiting"<< endl;		
 		printf("\n\n\n###################################################################\n");
 		printf("#########  AG_fitpsfarray B25 ........... exiting ###############\n");
@@ -332,6 +401,7 @@ int main(int argc,char **argv)
 	
 	delete[] outfilename;
 	delete[] psdfilename;
+	delete[] packfilename;
 
 	return status;
 }
@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION
+//       AGILE Science Tools
+//       AG fluxcorrtable
+//       Oct 2026
+//
+// INPUT
+//       The EDP and SAR files, and the grid of the spectral parameters.
+//
+// OUTPUT
+//       A FITS lookup table of the spectral shape corrections of the flux
+//       for each spectral model, energy range, spectral parameters and
+//       off-axis angle, averaged over phi.
+//
+// NOTICE
+//       Any information contained in this software
+//       is property of the AGILE TEAM and is strictly
+//       private and confidential.
+//       Copyright (C) 2005-2019 AGILE Team. All rights reserved.
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+////////////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <PilParams.h>
+#include <CalibUtils.h>
+#include "EdpCorrection.h"
+#include "EdpCorrectionTable.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+const char* startString = {
+"###################################################\n"
+"###    AG_fluxcorrtable B25 v1.0.0              ###\n"
+"###################################################\n"
+};
+
+const char* endString = {
+"###################################################\n"
+"###   AG_fluxcorrtable B25 ended successfully ####\n"
+"###################################################\n"
+};
+
+const PilDescription paramsDescr[] = {
+    { PilString, "edpfile", "EDP file name" },
+    { PilString, "sarfile", "SAR file name (none to use the EDP only)" },
+    { PilString, "outfile", "Output lookup table file name" },
+    { PilString, "models", "Spectral models (0=PL 1=PLExpCutoff 2=PLSuperExpCutoff 3=LogParabola)" },
+    { PilString, "energybins", "Energy ranges, as emin emax pairs separated by commas" },
+    { PilReal,   "indexmin", "Minimum spectral index" },
+    { PilReal,   "indexmax", "Maximum spectral index" },
+    { PilReal,   "indexstep", "Step of the spectral index" },
+    { PilString, "cutoffs", "Cutoff energies of PLExpCutoff and PLSuperExpCutoff [MeV]" },
+    { PilString, "gamma2s", "Second indexes of PLSuperExpCutoff" },
+    { PilString, "pivots", "Pivot energies of LogParabola [MeV]" },
+    { PilString, "betas", "Curvatures of LogParabola" },
+    { PilReal,   "refindex", "Index of the reference power law" },
+    { PilInt,    "threads", "Number of threads (0 means all the cores)" },
+    { PilNone, "", "" }
+};
+
+
+/// The numbers of a list separated by spaces or commas
+static vector<double> ParseList(const char* text)
+{
+string str(text);
+for (size_t i=0; i<str.size(); ++i)
+	if (str[i]==',')
+		str[i] = ' ';
+std::istringstream in(str);
+vector<double> values;
+double value;
+while (in >> value)
+	values.push_back(value);
+return values;
+}
+
+
+int main(int argc, char *argv[]) {
+    cout << startString << endl;
+
+    PilParams params(paramsDescr);
+    if (!params.Load(argc, argv))
+        return EXIT_FAILURE;
+
+    cout << endl << "INPUT PARAMETERS:" << endl;
+    params.Print();
+
+    EdpGrid edp;
+    if (!edp.Read(params["edpfile"])) {
+        cerr << "Error reading " << params.GetStrValue("edpfile") << endl;
+        return EXIT_FAILURE;
+    }
+    AeffGrid aeff;
+    const AeffGrid* aeffPtr = 0;
+    if (strcmp(params["sarfile"], "none")) {
+        if (!aeff.Read(params["sarfile"])) {
+            cerr << "Error reading " << params.GetStrValue("sarfile") << endl;
+            return EXIT_FAILURE;
+        }
+        aeffPtr = &aeff;
+    }
+
+    vector<double> models = ParseList(params["models"]);
+    vector<double> ebins = ParseList(params["energybins"]);
+    if (models.empty() || ebins.empty() || ebins.size()%2) {
+        cerr << "The models and the emin emax pairs of the energy ranges are required" << endl;
+        return EXIT_FAILURE;
+    }
+    double indexmin = params["indexmin"];
+    double indexmax = params["indexmax"];
+    double indexstep = params["indexstep"];
+    vector<double> indexes;
+    for (int i=0; indexmin+i*indexstep<=indexmax+indexstep*1e-6; ++i) {
+        indexes.push_back(indexmin+i*indexstep);
+        if (indexstep<=0)
+            break;
+    }
+    vector<double> noValue(1, 0.0);
+    vector<double> cutoffs = ParseList(params["cutoffs"]);
+    vector<double> gamma2s = ParseList(params["gamma2s"]);
+    vector<double> pivots = ParseList(params["pivots"]);
+    vector<double> betas = ParseList(params["betas"]);
+    double refindex = params["refindex"];
+    int threads = params["threads"];
+
+    EdpCorrectionTable table;
+    table.SetRefIndex(refindex);
+    EdpCorrection correction;
+    for (size_t m=0; m<models.size(); ++m) {
+        int model = int(models[m]);
+        const vector<double>* par2s = &noValue;
+        const vector<double>* par3s = &noValue;
+        if (model==EdpPLExpCutoff)
+            par2s = &cutoffs;
+        else if (model==EdpPLSuperExpCutoff) {
+            par2s = &cutoffs;
+            par3s = &gamma2s;
+        }
+        else if (model==EdpLogParabola) {
+            par2s = &pivots;
+            par3s = &betas;
+        }
+        else if (model!=EdpPL) {
+            cerr << "Unknown spectral model " << model << endl;
+            return EXIT_FAILURE;
+        }
+        if (par2s->empty() || par3s->empty()) {
+            cerr << "Missing parameters of the spectral model " << model << endl;
+            return EXIT_FAILURE;
+        }
+        for (size_t e=0; e<ebins.size(); e+=2) {
+            int iMin, iMax;
+            if (!EdpCorrection::Channels(edp, ebins[e], ebins[e+1], iMin, iMax)) {
+                cerr << "Energy range " << ebins[e] << "-" << ebins[e+1] << " out of the EDP grid" << endl;
+                return EXIT_FAILURE;
+            }
+            cout << "Model " << model << " E=[" << ebins[e] << ", " << ebins[e+1] << "] "
+                 << indexes.size()*par2s->size()*par3s->size() << " spectra" << endl;
+            for (size_t k=0; k<par3s->size(); ++k)
+                for (size_t j=0; j<par2s->size(); ++j)
+                    for (size_t i=0; i<indexes.size(); ++i) {
+                        double par2 = (*par2s)[j], par3 = (*par3s)[k];
+                        if (!correction.Compute(edp, iMin, iMax, refindex, model, indexes[i], par2, par3, threads, aeffPtr))
+                            return EXIT_FAILURE;
+                        if (table.Thetas().empty()) {
+                            vector<float> thetas(correction.Thetas());
+                            for (int t=0; t<correction.Thetas(); ++t)
+                                thetas[t] = correction.Theta(t);
+                            table.SetThetas(thetas);
+                        }
+                        /// Average over phi the EDP averages of the two spectra
+                        vector<double> corr(correction.Thetas(), 1.0);
+                        for (int t=0; t<correction.Thetas(); ++t) {
+                            double avgRef = 0, avgSpec = 0;
+                            for (int p=0; p<correction.Phis(); ++p) {
+                                avgRef += correction.AvgRef(t, p);
+                                avgSpec += correction.AvgSpec(t, p);
+                            }
+                            if (avgSpec>0)
+                                corr[t] = avgRef/avgSpec;
+                        }
+                        table.Append(model, ebins[e], ebins[e+1], indexes[i], par2, par3, corr);
+                    }
+        }
+    }
+
+    const char* outfile = params["outfile"];
+    int status = table.Write(outfile);
+    if (status) {
+        cerr << "Error writing " << outfile << ": " << status << endl;
+        return EXIT_FAILURE;
+    }
+    cout << table.Rows() << " spectra on " << table.Thetas().size() << " thetas written to " << outfile << endl;
+
+    /// Read the table back and check the interpolation on the nodes
+    EdpCorrectionTable check;
+    status = check.Read(outfile);
+    if (status) {
+        cerr << "Error reading " << outfile << ": " << status << endl;
+        return EXIT_FAILURE;
+    }
+    double maxDiff = 0;
+    for (int r=0; r<table.Rows(); ++r)
+        for (size_t t=0; t<table.Thetas().size(); ++t) {
+            bool found;
+            double value = check.Value(table.Model(r), table.Emin(r), table.Emax(r), table.SpectralIndex(r),
+                                       table.Par2(r), table.Par3(r), table.Thetas()[t], &found);
+            double diff = found ? fabs(value-table.Corr(r, t)) : 1;
+            if (diff>maxDiff)
+                maxDiff = diff;
+        }
+    cout << "Maximum difference of the interpolated corrections on the nodes: " << maxDiff << endl;
+
+    cout << endString << endl;
+    return EXIT_SUCCESS;
+}
@@ -10,6 +10,10 @@
 //
 // OUTPUT
 //       A scv with a the list of "l-coord b-coord pixel-value" for each pixel of the Map
+//       or, with format=binary, a columnar file of float32 values: a header
+//       (magic "AGMAPCOL", uint32 version, uint32 columns, uint64 pixels,
+//       uint64 groups, 16 characters per column name) followed by the groups,
+//       each made of an uint64 count and of the count values of l, b and value
 //
 // NOTICE
 //       Any information contained in this software
@@ -35,6 +39,18 @@
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdint.h>
+#if __cplusplus>=201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 #include <PilParams.h>
 #include <AgileMap.h>
 
@@ -57,9 +73,85 @@ const char* endString = {
 const PilDescription paramsDescr[] = {
     { PilString, "inmap", "Input map filename" },
     { PilString, "outfile", "Output filename" },
+    { PilString, "format", "Output format (text, binary)" },
+    { PilBool,   "skipzero", "Skip the pixels with value zero" },
+    { PilInt,    "threads", "Number of threads formatting the pixels (0 means all the cores)" },
     { PilNone,   "",   "" }
 };
 
+/// The rows of the map converted by a thread at a time
+const int c_blockRows = 64;
+
+/// The pixels of a block of rows, as text or as columns
+struct Block {
+    std::string text;
+    std::vector<float> l, b, value;
+};
+
+/// Append a number as printed by ostream with the default precision
+static void AppendNumber(std::string& text, double x)
+{
+    char buffer[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars>=201611L
+    std::to_chars_result res = std::to_chars(buffer, buffer+sizeof(buffer), x, std::chars_format::general, 6);
+    text.append(buffer, res.ptr);
+#else
+    int length = snprintf(buffer, sizeof(buffer), "%g", x);
+    text.append(buffer, length);
+#endif
+}
+
+/// The coordinates of the pixels are computed by the caller, on one thread
+static void ConvertRows(const AgileMap* map, const double* ls, const double* bs, int rowBegin, int rowEnd,
+                        bool binary, bool skipZero, Block* block)
+{
+    block->text.clear();
+    block->l.clear();
+    block->b.clear();
+    block->value.clear();
+    int cols = map->Dim(1);
+    for (int y=rowBegin; y<rowEnd; ++y)
+        for (int x=0; x<cols; ++x) {
+            double value = (*map)(y, x);
+            if (skipZero && value==0)
+                continue;
+            long i = long(y-rowBegin)*cols+x;
+            double l = ls[i];
+            double b = bs[i];
+            if (binary) {
+                block->l.push_back(l);
+                block->b.push_back(b);
+                block->value.push_back(value);
+            }
+            else {
+                AppendNumber(block->text, l);
+                block->text += ' ';
+                AppendNumber(block->text, b);
+                block->text += ' ';
+                AppendNumber(block->text, value);
+                block->text += '\n';
+            }
+        }
+}
+
+static void WriteHeader(std::ofstream& ofs, uint64_t pixels, uint64_t groups)
+{
+    const char magic[8] = { 'A', 'G', 'M', 'A', 'P', 'C', 'O', 'L' };
+    uint32_t version = 1;
+    uint32_t columns = 3;
+    char names[3][16];
+    memset(names, 0, sizeof(names));
+    strcpy(names[0], "l");
+    strcpy(names[1], "b");
+    strcpy(names[2], "value");
+    ofs.write(magic, sizeof(magic));
+    ofs.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    ofs.write(reinterpret_cast<const char*>(&columns), sizeof(columns));
+    ofs.write(reinterpret_cast<const char*>(&pixels), sizeof(pixels));
+    ofs.write(reinterpret_cast<const char*>(&groups), sizeof(groups));
+    ofs.write(names[0], sizeof(names));
+}
+
 int main(int argc, char *argv[]) {
     cout << startString << endl;
 
@@ -79,14 +171,84 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-//    cout << "Center: " << map.GetMapCenterL() << " " << map.GetMapCenterB() << endl;
-//    cout << "map.Dim(0) " << map.Dim(0) << " " << " map.Dim(1) " << map.Dim(1) << endl;
-    std::ofstream ofs(outFilename);
-    for (int y=0; y<map.Dim(0); ++y) {
-        for (int x=0; x<map.Dim(1); ++x) {
-            ofs << map.l(y, x) << " " << map.b(y, x) << " " << map(y, x) << endl;
+    std::string format = params.GetStrValue("format");
+    bool binary = format=="binary";
+    if (!binary && format!="text") {
+        cerr << "Format not correct. Possible values: [text, binary]." << endl;
+        return EXIT_FAILURE;
+    }
+    bool skipZero = params["skipzero"];
+    int threads = params["threads"];
+    if (threads<1)
+        threads = std::thread::hardware_concurrency();
+    if (threads<1)
+        threads = 1;
+
+    std::ofstream ofs(outFilename, binary ? std::ios::out|std::ios::binary : std::ios::out);
+    if (!ofs) {
+        cerr << "Error creating file " << outFilename << endl;
+        return EXIT_FAILURE;
+    }
+    if (binary)
+        WriteHeader(ofs, 0, 0);
+
+    /// A window of blocks is converted on the threads and written in order.
+    /// The coordinates are computed first on this thread, the projection
+    /// of AgileMap not being known to be reentrant.
+    int rows = map.Dim(0);
+    int cols = map.Dim(1);
+    std::vector<Block> blocks(threads);
+    std::vector<double> ls(long(threads)*c_blockRows*cols);
+    std::vector<double> bs(ls.size());
+    uint64_t pixels = 0;
+    uint64_t groups = 0;
+    for (int first=0; first<rows; first+=threads*c_blockRows) {
+        int last = std::min(rows, first+threads*c_blockRows);
+        for (int y=first; y<last; ++y)
+            for (int x=0; x<cols; ++x) {
+                long i = long(y-first)*cols+x;
+                map.GetCoords(y, x, &ls[i], &bs[i]);
+            }
+        std::vector<std::thread> workers;
+        int count = 0;
+        for (int t=0; t<threads && first+t*c_blockRows<rows; ++t, ++count) {
+            int rowBegin = first+t*c_blockRows;
+            int rowEnd = std::min(rows, rowBegin+c_blockRows);
+            long offset = long(rowBegin-first)*cols;
+            if (t)
+                workers.push_back(std::thread(ConvertRows, &map, &ls[offset], &bs[offset], rowBegin, rowEnd,
+                                              binary, skipZero, &blocks[t]));
+            else
+                ConvertRows(&map, &ls[offset], &bs[offset], rowBegin, rowEnd, binary, skipZero, &blocks[0]);
+        }
+        for (size_t t=0; t<workers.size(); ++t)
+            workers[t].join();
+        for (int t=0; t<count; ++t) {
+            const Block& block = blocks[t];
+            if (!binary) {
+                ofs.write(block.text.data(), block.text.size());
+                continue;
+            }
+            uint64_t n = block.value.size();
+            if (!n)
+                continue;
+            ofs.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            ofs.write(reinterpret_cast<const char*>(&block.l[0]), n*sizeof(float));
+            ofs.write(reinterpret_cast<const char*>(&block.b[0]), n*sizeof(float));
+            ofs.write(reinterpret_cast<const char*>(&block.value[0]), n*sizeof(float));
+            pixels += n;
+            ++groups;
         }
     }
+    if (binary) {
+        ofs.seekp(0);
+        WriteHeader(ofs, pixels, groups);
+    }
+    ofs.close();
+    if (!ofs) {
+        cerr << "Error writing file " << outFilename << endl;
+        return EXIT_FAILURE;
+    }
 
     cout << endString << endl;
     return EXIT_SUCCESS;
@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION
+//       AGILE Science Tools
+//       AG mapcube
+//       Oct 2026
+//
+// INPUT
+//       A maplist4, with multiple cts, exp and gas maps.
+//
+// OUTPUT
+//       An uncompressed, page aligned binary cube with all the maps of the
+//       list, to be memory mapped by MapCube. The FITS header of each
+//       counts map is preserved in the cube.
+//
+// NOTICE
+//       Any information contained in this software
+//       is property of the AGILE TEAM and is strictly
+//       private and confidential.
+//       Copyright (C) 2005-2019 AGILE Team. All rights reserved.
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+////////////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cstdlib>
+#include <PilParams.h>
+#include <AlikeData5.h>
+#include "MapCube.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+const char* startString = {
+"###################################################\n"
+"###    AG_mapcube B25 v1.0.0                    ###\n"
+"###################################################\n"
+};
+
+const char* endString = {
+"###################################################\n"
+"###   AG_mapcube B25 ended successfully ##########\n"
+"###################################################\n"
+};
+
+const PilDescription paramsDescr[] = {
+    { PilString, "maplist", "Input maplist" },
+    { PilString, "outfile", "Output cube file name" },
+    { PilString, "ctstype", "Pixel type of the counts maps (int32, float32, float64), int32 only for integer counts" },
+    { PilString, "exptype", "Pixel type of the exposure maps (float32, float64)" },
+    { PilString, "gastype", "Pixel type of the gas maps (float32, float64, none)" },
+    { PilNone, "", "" }
+};
+
+int main(int argc, char *argv[]) {
+    cout << startString << endl;
+
+    PilParams params(paramsDescr);
+    if (!params.Load(argc, argv))
+        return EXIT_FAILURE;
+
+    cout << endl << "INPUT PARAMETERS:" << endl;
+    params.Print();
+
+    MapCubeType ctsType = MapCube::TypeFromString(params["ctstype"]);
+    MapCubeType expType = MapCube::TypeFromString(params["exptype"]);
+    MapCubeType gasType = MapCube::TypeFromString(params["gastype"]);
+    if (ctsType==CubeNone || expType==CubeNone) {
+        cerr << "Pixel type not correct. Possible values: [int32, float32, float64]." << endl;
+        return EXIT_FAILURE;
+    }
+
+    MapList maplist;
+    int mapCount = maplist.Read(params["maplist"]);
+    if (!mapCount) {
+        cerr << "File " << params.GetStrValue("maplist") << " missing or empty." << endl;
+        return EXIT_FAILURE;
+    }
+
+    const char* outfile = params["outfile"];
+    if (!MapCube::Build(maplist, outfile, ctsType, expType, gasType)) {
+        cerr << "Error converting " << params.GetStrValue("maplist") << " into " << outfile << "." << endl;
+        return EXIT_FAILURE;
+    }
+
+    MapCube cube;
+    if (!cube.Open(outfile))
+        return EXIT_FAILURE;
+    cout << "Cube " << outfile << ": " << cube.Count() << " maps of " << cube.Rows() << "x" << cube.Cols() << " pixels" << endl;
+    cout << "cts " << MapCube::TypeName(cube.Type(CubeCts))
+         << ", exp " << MapCube::TypeName(cube.Type(CubeExp))
+         << ", gas " << MapCube::TypeName(cube.Type(CubeGas)) << endl;
+    for (int i=0; i<cube.Count(); ++i) {
+        const MapCubeInfo& info = cube.Info(i);
+        cout << i << " " << maplist.CtsName(i) << " E=[" << info.emin << ", " << info.emax << "]"
+             << " T=[" << info.tstart << ", " << info.tstop << "]" << endl;
+    }
+
+    cout << endString << endl;
+    return EXIT_SUCCESS;
+}
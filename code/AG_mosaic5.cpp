@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION
+//       AGILE Science Tools
+//       AG mosaic
+//       Oct 2026
+//
+// INPUT
+//       A list of maps, one per line, each optionally followed by its
+//       exposure map, and a template map defining the output grid.
+//
+// OUTPUT
+//       The mosaic of the maps on the grid of the template, the overlaps
+//       combined by sum, mean, max or exposure weighted mean.
+//
+// NOTICE
+//       Any information contained in this software
+//       is property of the AGILE TEAM and is strictly
+//       private and confidential.
+//       Copyright (C) 2005-2019 AGILE Team. All rights reserved.
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+////////////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <PilParams.h>
+#include <AgileMap.h>
+#include "MosaicBuilder.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+const char* startString = {
+"###################################################\n"
+"###    AG_mosaic B25 v1.0.0                     ###\n"
+"###################################################\n"
+};
+
+const char* endString = {
+"###################################################\n"
+"###   AG_mosaic B25 ended successfully ###########\n"
+"###################################################\n"
+};
+
+const PilDescription paramsDescr[] = {
+    { PilString, "inputlist", "Input list of maps, each optionally followed by its exposure map" },
+    { PilString, "template", "Map defining the grid of the mosaic" },
+    { PilString, "outfile", "Output mosaic file name" },
+    { PilString, "rule", "Combination of the overlaps (sum, mean, max, exp)" },
+    { PilInt,    "tilerows", "Rows of the mosaic built at a time (0 means all the rows)" },
+    { PilInt,    "threads", "Number of threads (0 means all the cores)" },
+    { PilNone, "", "" }
+};
+
+int main(int argc, char *argv[]) {
+    cout << startString << endl;
+
+    PilParams params(paramsDescr);
+    if (!params.Load(argc, argv))
+        return EXIT_FAILURE;
+
+    cout << endl << "INPUT PARAMETERS:" << endl;
+    params.Print();
+
+    MosaicRule rule = MosaicBuilder::RuleFromString(params["rule"]);
+    if (rule==MosaicNone) {
+        cerr << "Rule not correct. Possible values: [sum, mean, max, exp]." << endl;
+        return EXIT_FAILURE;
+    }
+
+    AgileMap target;
+    if (target.Read(params["template"])) {
+        cerr << "Error reading the template map " << params.GetStrValue("template") << endl;
+        return EXIT_FAILURE;
+    }
+
+    MosaicBuilder mosaic(target, rule);
+    int count = mosaic.AddList(params["inputlist"]);
+    if (count<1) {
+        cerr << "File " << params.GetStrValue("inputlist") << " missing or empty." << endl;
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!mosaic.Build(params["tilerows"], params["threads"])) {
+        cerr << "Error building the mosaic of " << params.GetStrValue("inputlist") << "." << endl;
+        return EXIT_FAILURE;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    const std::vector<int>& coverage = mosaic.Coverage();
+    int covered = 0;
+    for (size_t i=0; i<coverage.size(); ++i)
+        if (coverage[i])
+            ++covered;
+    cout << "Mosaic of " << count << " maps (" << MosaicBuilder::RuleName(rule) << ") in " << seconds << " s, "
+         << covered << " of " << coverage.size() << " pixels covered" << endl;
+
+    if (mosaic.Map().Write(params["outfile"])) {
+        cerr << "Error writing " << params.GetStrValue("outfile") << endl;
+        return EXIT_FAILURE;
+    }
+
+    cout << endString << endl;
+    return EXIT_SUCCESS;
+}
@@ -29,7 +29,21 @@
 
 
 
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <TROOT.h>
+
 #include "RoiMulti5.h"
+#include "RoiMultiConfig.h"
+#include "RoiProfile.h"
+#include "FitProfiler.h"
+#include "MathUtils.h"
 #include "PilParams.h"
 
 using namespace std;
@@ -64,6 +78,17 @@ const PilDescription c_params[] = {
 	{ PilReal, "maxThreshold", "The upper bound for the threshold level in exp-ratio evaluation"},
 	{ PilReal, "squareSize", "The edge degree dimension of the exp-ratio evaluation area"},
 	{ PilInt,   "contourpoints", "Number of points to determine the contour (0-400)"},
+	{ PilString, "ulmethod", "Upper limit method: fit (RoiMulti refits), brent (profile likelihood root)" },
+	{ PilString, "locmethod", "Location contour method: fit (RoiMulti refits), polar (adaptive polar grid)" },
+	{ PilInt,    "profilethreads", "Number of threads for the polar contour (0 means all the cores)" },
+	{ PilString, "profile", "Write the timing of the fit phases: none, json, csv" },
+	{ PilInt,    "tsmap", "TS map mode: 0 disabled, 1 fit the flux, 2 fit flux and index" },
+	{ PilReal,   "tsmapradius", "Radius of the TS map around the map center (0 means ranal)" },
+	{ PilInt,    "tsmapbinstep", "Bin step of the TS map grid" },
+	{ PilReal,   "tsmapindex", "Spectral index of the TS map test source" },
+	{ PilInt,    "tsmapthreads", "Number of threads for the TS map (0 means all the cores)" },
+	{ PilString, "tsmapminimizer", "Minimizer type of the TS map fits: same (minimizertype) or a reentrant one (Minuit2) for more threads" },
+	{ PilBool,   "tsmapul", "Compute the flux upper limit of every TS map pixel" },
 	{ PilNone,   "",   "" }
 	};
 
@@ -84,13 +109,218 @@ public:
 };
 
 
+/// One pixel of the TS map grid and the result of its fit
+struct TsMapPixel
+{
+	int row, col;
+	double l, b;
+	double flux, ts, index, fluxul;
+};
+
+/// Everything a TS map thread needs to fit its pixels
+struct TsMapSetup
+{
+	double ranal, ulcl;
+	double index;
+	int fixflag;
+	SourceDataArray background;
+};
+
+static const char* c_tsMapLabel = "TSMAP";
+
+
+/// Write a copy of the map list with the diffuse coefficients fitted by roiMulti,
+/// so that galmode=isomode=1 keeps them fixed during the fit of each TS map pixel
+static int WriteFittedMapList(const char* inName, const char* outName, RoiMulti& roiMulti)
+{
+ifstream inFile(inName);
+ofstream outFile(outName);
+if (!inFile.is_open() || !outFile.is_open())
+	return 0;
+outFile << setprecision(10);
+int count = 0;
+string line;
+while (getline(inFile, line)) {
+	istringstream ss(line);
+	string cts, exp, gas, offaxis;
+	if (!(ss >> cts) || cts[0]=='#') {
+		outFile << line << endl;
+		continue;
+		}
+	ss >> exp >> gas >> offaxis;
+	if (offaxis.empty())
+		offaxis = "30";
+	outFile << cts << " " << exp << " " << gas << " " << offaxis << " ";
+	outFile << roiMulti.GetGalactic(count).GetCoeff() << " " << roiMulti.GetIsotropic(count).GetCoeff() << endl;
+	++count;
+	}
+return count;
+}
+
+
+static void TsMapWorker(const TsMapSetup& setup, RoiMulti* roiMultiPtr, vector<TsMapPixel>& pixels, atomic<int>& next, mutex& coutMutex)
+{
+RoiMulti& roiMulti = *roiMultiPtr;
+int count = pixels.size();
+for (int i=next++; i<count; i=next++) {
+	TsMapPixel& pixel = pixels[i];
+	SourceDataArray tryArr(setup.background);
+	SourceData tryData;
+	tryData.label = c_tsMapLabel;
+	tryData.srcL = pixel.l;
+	tryData.srcB = pixel.b;
+	tryData.flux = 0;
+	tryData.index = setup.index;
+	tryData.fixflag = setup.fixflag;
+	tryData.minTS = 0;
+	tryArr.Append(tryData);
+	roiMulti.DoFit(tryArr, setup.ranal, setup.ulcl, 0, 0, c_tsMapLabel, 0);
+	SourceDataArray fitArr = roiMulti.GetFitData();
+	const SourceData& fitData = fitArr[string(c_tsMapLabel)];
+	pixel.flux = fitData.flux;
+	pixel.ts = fitData.TS<0 ? 0 : fitData.TS;
+	pixel.index = fitData.index;
+	pixel.fluxul = fitData.fluxul;
+	if ((i+1)%100==0) {
+		lock_guard<mutex> lock(coutMutex);
+		cout << "TS map: " << i+1 << " of " << count << " pixels" << endl;
+		}
+	}
+}
+
+
+/// Fit a test source on every pixel of a grid, with the background sources and
+/// the diffuse coefficients fixed to the values of the last roiMulti fit
+static int DoTsMap(MultiParams& mPars, RoiMulti& roiMulti, const MapList& maplist, FitProfiler& profiler)
+{
+const char* outfilename = mPars["outfile"];
+string prefix(outfilename);
+prefix += ".tsmap";
+
+RoiMultiConfig config;
+config.Load(mPars);
+config.galmode = 1;
+config.isomode = 1;
+string minimizer = mPars.GetStrValue("tsmapminimizer");
+if (minimizer!="same")
+	config.minimizertype = minimizer;
+
+bool fluxul = mPars["tsmapul"];
+TsMapSetup setup;
+setup.ranal = mPars["ranal"];
+setup.ulcl = fluxul ? double(mPars["ulcl"]) : 0;
+setup.index = mPars["tsmapindex"];
+int mode = mPars["tsmap"];
+setup.fixflag = mode==2 ? 5 : 1;
+
+/// The background sources are kept fixed at their fitted values
+setup.background = roiMulti.GetFitData();
+for (int i=0; i<setup.background.Count(); ++i)
+	setup.background[i].fixflag = 0;
+
+string maplistName(prefix);
+maplistName += ".maplist";
+MapList fittedList;
+if (!WriteFittedMapList(mPars["maplist"], maplistName.c_str(), roiMulti) || !fittedList.Read(maplistName.c_str())) {
+	cerr << "ERROR writing " << maplistName << endl;
+	return -1;
+	}
+/// The maps of the main fit are left as they are
+MapData mapData;
+if (!mapData.Load(fittedList))
+	return -1;
+
+AgileMap modelMap(maplist.CtsName(0));
+double radius = mPars["tsmapradius"];
+if (radius<=0)
+	radius = setup.ranal;
+int binstep = mPars["tsmapbinstep"];
+if (binstep<1)
+	binstep = 1;
+double lcenter = modelMap.GetMapCenterL();
+double bcenter = modelMap.GetMapCenterB();
+vector<TsMapPixel> pixels;
+for (int row=0; row<modelMap.Rows(); row+=binstep)
+	for (int col=0; col<modelMap.Cols(); col+=binstep) {
+		TsMapPixel pixel;
+		pixel.row = row;
+		pixel.col = col;
+		pixel.l = modelMap.l(row, col);
+		pixel.b = modelMap.b(row, col);
+		pixel.flux = pixel.ts = pixel.index = pixel.fluxul = 0;
+		if (SphDistDeg(pixel.l, pixel.b, lcenter, bcenter)<radius)
+			pixels.push_back(pixel);
+		}
+
+int threadCount = mPars["tsmapthreads"];
+if (threadCount<1)
+	threadCount = thread::hardware_concurrency();
+if (threadCount<1)
+	threadCount = 1;
+if (threadCount>int(pixels.size()))
+	threadCount = pixels.size();
+/// TMinuit and TFumili keep their state in a global instance
+if (threadCount>1 && !config.IsReentrant()) {
+	cout << "TS map: the " << config.minimizertype << " minimizer is not reentrant, the pixels are fitted on one thread (set tsmapminimizer=Minuit2 for more)" << endl;
+	threadCount = 1;
+	}
+cout << "TS map: " << pixels.size() << " pixels on " << threadCount << " threads" << endl;
+
+/// Each thread needs its own fitter. RoiMulti reads the PSF, SAR and EDP
+/// grids by itself, the fitters are set up here one at a time.
+vector<RoiMulti> fitters(threadCount);
+for (int t=0; t<threadCount; ++t)
+	if (!config.Setup(fitters[t], mapData)) {
+		cerr << "ERROR setting up the TS map fitter" << endl;
+		return -1;
+		}
+
+if (threadCount>1)
+	ROOT::EnableThreadSafety();
+atomic<int> next(0);
+mutex coutMutex;
+vector<thread> threads;
+for (int t=1; t<threadCount; ++t)
+	threads.push_back(thread(TsMapWorker, cref(setup), &fitters[t], ref(pixels), ref(next), ref(coutMutex)));
+TsMapWorker(setup, &fitters[0], pixels, next, coutMutex);
+for (size_t t=0; t<threads.size(); ++t)
+	threads[t].join();
+if (profiler.IsEnabled())
+	profiler.AddCount("tsmap_fits", pixels.size());
+
+AgileMap fluxMap(modelMap);
+AgileMap tsMap(modelMap);
+AgileMap siMap(modelMap);
+AgileMap ulMap(modelMap);
+fluxMap.Zero();
+tsMap.Zero();
+siMap.Zero();
+ulMap.Zero();
+for (size_t i=0; i<pixels.size(); ++i) {
+	const TsMapPixel& pixel = pixels[i];
+	fluxMap(pixel.row, pixel.col) = pixel.flux;
+	tsMap(pixel.row, pixel.col) = pixel.ts;
+	siMap(pixel.row, pixel.col) = pixel.index;
+	ulMap(pixel.row, pixel.col) = pixel.fluxul;
+	}
+string outfname(prefix);
+fluxMap.Write((outfname + ".flux.fits.gz").c_str());
+tsMap.Write((outfname + ".TS.fits.gz").c_str());
+if (fluxul)
+	ulMap.Write((outfname + ".fluxul.fits.gz").c_str());
+if (mode==2)
+	siMap.Write((outfname + ".SI.fits.gz").c_str());
+return 0;
+}
+
+
 class AppScreen
 {
 public:
 	AppScreen()
 	{
 	cout << "#################################################################"<< endl;
-	cout << "####    AG_Multi B25 v6.0.0 - A.C. T.C. A.T. A.B            #####"<< endl;
+	cout << "####    AG_Multi B25 v6.1.0 - A.C. T.C. A.T. A.B            #####"<< endl;
 	cout << "#################################################################"<< endl;
 	}
 
@@ -114,24 +344,37 @@ if (!mPars.Load(argc, argv))
 cout << endl << endl << "INPUT PARAMETERS:" << endl << endl;
 mPars.Print();
 
-MapList maplist;
-int mapCount = maplist.Read(mPars["maplist"]);
-if (!mapCount) {
-	cerr << "File " << mPars.GetStrValue("maplist") << " missing or empty" << endl;
-	return -1;
-	}
+/// The profiler does not read the clock at all when profile=none
+string profileMode = mPars.GetStrValue("profile");
+FitProfiler profiler;
+profiler.Enable(profileMode=="json" || profileMode=="csv");
 
+MapList maplist;
 MapData mapData;
-if (!mapData.Load(maplist))
-	return -1;
+{
+	FitProfiler::Phase phase(&profiler, "map_loading");
+	int mapCount = maplist.Read(mPars["maplist"]);
+	if (!mapCount) {
+		cerr << "File " << mPars.GetStrValue("maplist") << " missing or empty" << endl;
+		return -1;
+		}
+	if (!mapData.Load(maplist))
+		return -1;
+}
 
 // ExpCorr expCorr("None"); /// zzz To remove
 
 RoiMulti roiMulti;
-if (!roiMulti.SetPsf(mPars["psdfile"], mPars["sarfile"], mPars["edpfile"]))
-	return -1;
-if (!roiMulti.SetMaps(mapData , mPars["galmode"], mPars["isomode"]))
-	return -1;
+{
+	FitProfiler::Phase phase(&profiler, "psf_setup");
+	if (!roiMulti.SetPsf(mPars["psdfile"], mPars["sarfile"], mPars["edpfile"]))
+		return -1;
+}
+{
+	FitProfiler::Phase phase(&profiler, "template_building");
+	if (!roiMulti.SetMaps(mapData , mPars["galmode"], mPars["isomode"]))
+		return -1;
+}
 
 const char* outfilename = mPars["outfile"];
 string fileName;
@@ -148,19 +391,96 @@ roiMulti.SetCorrections(mPars["galmode2"], mPars["galmode2fit"], mPars["isomode2
 	
 	if (!srcArr.Count())
 		cout << "Warning: no point sources loaded" << endl;
-	
-if (roiMulti.DoFit(srcArr, mPars["ranal"], mPars["ulcl"], mPars["loccl"], 1))
-	return -1;
 
-roiMulti.Write(outfilename);
+/// With the fast methods RoiMulti skips its own upper limit and contour refits
+string ulmethod = mPars.GetStrValue("ulmethod");
+string locmethod = mPars.GetStrValue("locmethod");
+bool brentUl = ulmethod=="brent";
+bool polarLoc = locmethod=="polar";
+double ulcl = mPars["ulcl"];
+double loccl = mPars["loccl"];
+double fitUlcl = brentUl ? 0 : ulcl;
+double fitLoccl = polarLoc ? 0 : loccl;
+/// With ulmethod=fit and locmethod=fit this phase includes the upper limit
+/// and contour refits of RoiMulti, which cannot be timed apart
+{
+	FitProfiler::Phase phase(&profiler, "fit");
+	if (roiMulti.DoFit(srcArr, mPars["ranal"], fitUlcl, fitLoccl, 1))
+		return -1;
+}
+if (profiler.IsEnabled())
+	profiler.AddCount("fits");
+
+{
+	FitProfiler::Phase phase(&profiler, "output");
+	roiMulti.Write(outfilename);
 	double sq = mPars["squareSize"];
 	//cout << "***************************** mPars[squareSize]" << sq << endl;
-roiMulti.WriteSources(outfilename, mPars["expratioevaluation"], false, mPars["minThreshold"], mPars["maxThreshold"], sq);
-roiMulti.WriteHtml(outfilename, mPars["expratioevaluation"], false, mPars["minThreshold"], mPars["maxThreshold"], sq);
-//roiMulti.WriteHtml(outfilename, "yes", "no", 0, 15, 10);
-	
-fileName = outfilename;
-fileName += ".log";roiMulti.Write(fileName.c_str(), false);
+	roiMulti.WriteSources(outfilename, mPars["expratioevaluation"], false, mPars["minThreshold"], mPars["maxThreshold"], sq);
+	roiMulti.WriteHtml(outfilename, mPars["expratioevaluation"], false, mPars["minThreshold"], mPars["maxThreshold"], sq);
+	//roiMulti.WriteHtml(outfilename, "yes", "no", 0, 15, 10);
+
+	fileName = outfilename;
+	fileName += ".log";roiMulti.Write(fileName.c_str(), false);
+}
+
+SourceDataArray fitArr = roiMulti.GetFitData();
+vector<RoiProfile::Result> results;
+if (brentUl || polarLoc) {
+	RoiMultiConfig config;
+	config.Load(mPars);
+	int threads = mPars["profilethreads"];
+	if (threads<1)
+		threads = thread::hardware_concurrency();
+	RoiProfile profile(config, mapData, mPars["ranal"], threads);
+	profile.SetProfiler(&profiler);
+	int contourpoints = mPars["contourpoints"];
+	if (contourpoints>0)
+		profile.SetContourGrid(contourpoints, 0.1, 3.0);
+	results = profile.Run(fitArr, brentUl ? ulcl : 0, polarLoc ? loccl : 0);
+	fileName = outfilename;
+	fileName += ".ulloc";
+	RoiProfile::Write(fileName.c_str(), outfilename, results, ulmethod.c_str(), locmethod.c_str());
+	RoiProfile::AppendToSources(outfilename, results, ulmethod.c_str(), locmethod.c_str());
+	}
+
+if (int(mPars["tsmap"])>0) {
+	FitProfiler::Phase phase(&profiler, "tsmap");
+	if (DoTsMap(mPars, roiMulti, maplist, profiler))
+		return -1;
+	}
+
+if (profiler.IsEnabled()) {
+	for (int i=0; i<fitArr.Count(); ++i) {
+		const SourceData& src = fitArr[i];
+		FitProfiler::SourceStats stats;
+		stats.label = src.label;
+		stats.flux = src.flux;
+		stats.TS = src.TS;
+		stats.fixflag = src.fixflag;
+		stats.ulEvals = stats.locEvals = 0;
+		stats.ulTime = stats.locTime = 0;
+		stats.ulConverged = stats.locClosed = -1;
+		for (size_t k=0; k<results.size(); ++k)
+			if (results[k].label==src.label) {
+				stats.ulEvals = results[k].ulEvals;
+				stats.ulTime = results[k].ulTime;
+				stats.locEvals = results[k].locEvals;
+				stats.locTime = results[k].locTime;
+				if (stats.ulEvals)
+					stats.ulConverged = results[k].ulConverged;
+				if (stats.locEvals)
+					stats.locClosed = results[k].locClosed;
+				}
+		profiler.AddSource(stats);
+		}
+	fileName = outfilename;
+	fileName += ".profile.";
+	fileName += profileMode;
+	bool written = profileMode=="json" ? profiler.WriteJson(fileName.c_str()) : profiler.WriteCsv(fileName.c_str());
+	if (!written)
+		cerr << "ERROR writing " << fileName << endl;
+	}
 
 return 0;
 }
@@ -27,6 +27,8 @@
 ////////////////////////////////////////////////////////////////////////////////////
 
 
+#include <chrono>
+
 #include "RoiMulti5.h"
 #include "PilParams.h"
 
@@ -220,6 +222,8 @@ double minThreshold = mPars["minThreshold"];
 double maxThreshold = mPars["maxThreshold"];
 int squareSize = mPars["squareSize"];
 */
+chrono::steady_clock::time_point preStart = chrono::steady_clock::now();
+
 MapList maplist;
 int mapCount = maplist.Read(maplistname);
 if (!mapCount) {
@@ -249,9 +253,14 @@ if (!roiMulti.SetPsf(psdfilename, sarfilename, edpfilename))
 	return -1;
 if (!roiMulti.SetMaps(mapData , galmode, isomode))
 	return -1;
+/// RoiMulti convolves the extended templates with the PSF of each map here,
+/// it takes no already convolved templates, so this time is reported but
+/// the convolution cannot be cached or replaced by this tool
 if (!roiMulti.SetExtendedSources(extData))
 	return -1;
 
+double preTime = chrono::duration<double>(chrono::steady_clock::now()-preStart).count();
+
 string fileName;
 
 fileName = outfilename;
@@ -264,8 +273,12 @@ roiMulti.SetLogfile(fileName.c_str());
 	//roiMulti.SetCorrections(0, 0, 0, 0, mPars["edpcorrection"], mPars["fluxcorrection"]);
 
 	
+chrono::steady_clock::time_point fitStart = chrono::steady_clock::now();
 if (roiMulti.DoFit(srcArr, ranal, ulcl, loccl, 1))
 	return -1;
+double fitTime = chrono::duration<double>(chrono::steady_clock::now()-fitStart).count();
+cout << "Preprocessing time: " << preTime << " s" << endl;
+cout << "Fit time: " << fitTime << " s" << endl;
 
 roiMulti.Write(outfilename);
 roiMulti.WriteSources(outfilename, false, false, 0, 15, 10);
@@ -33,6 +33,9 @@
 #include <Eval.h>
 #include <FitsUtils.h>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include "MapStacker.h"
 
 #define DEBUG 0
 #ifdef DEBUG
@@ -75,6 +78,7 @@ const PilDescription paramsDescr[] = {
 	{ PilReal,   "loccl",   "Location contour confidence level" },
 	{ PilString, "resmatrices", "Response matrices" },
 	{ PilString, "respath", "Response matrices path" },
+	{ PilInt,    "sumthreads", "Number of threads summing the maps of a block (0 means all the cores)" },
 	/*
 	{ PilBool, "expratioevaluation","If 'yes' (or 'y') the exp-ratio evaluation will be enabled."},
 	{ PilBool, "isExpMapNormalized","If 'yes' (or 'y') you assert that the exp-map is already normalized. Insert 'no' (or 'n') instead and the map will be normalized before carrying out the exp-ratio evaluation."},
@@ -87,18 +91,35 @@ const PilDescription paramsDescr[] = {
 
 enum { Concise=1, SkipAnalysis=2, DoubleAnalysis=4, SaveMaps=8 };
 
-AgileMap SumMaps(const AgileMap* mapArr, int offset, int block) {
-	AgileMap m(mapArr[offset]);
+/// The sums of a block of maps. The headers are the ones of operator+=,
+/// the pixels are summed with the pairwise tree of MapStacker.
+/// \return false if the maps have different sizes.
+bool SumMaps(const AgileMap* mapArr, int offset, int block, int threads, AgileMap& m) {
+	std::vector<const AgileMap*> maps;
+	for (int i=offset; i<offset+block; ++i)
+		maps.push_back(&mapArr[i]);
+	std::vector<double> pixels(mapArr[offset].Size());
+	if (!MapStacker::TreeSumPixels(maps, &pixels[0], threads))
+		return false;
+	m = mapArr[offset];
 	for (int i=offset+1; i<offset+block; ++i)
 		m += mapArr[i];
-	return m;
+	std::copy(pixels.begin(), pixels.end(), m.Buffer());
+	return true;
 }
 
-AgileMap SumExposure(const MapMaps& maps, int offset, int block) {
-	AgileMap m(maps.ExpMap(offset));
+bool SumExposure(const MapMaps& maps, int offset, int block, int threads, AgileMap& m) {
+	std::vector<const AgileMap*> expMaps;
+	for (int i=offset; i<offset+block; ++i)
+		expMaps.push_back(&maps.ExpMap(i));
+	std::vector<double> pixels(maps.ExpMap(offset).Size());
+	if (!MapStacker::TreeSumPixels(expMaps, &pixels[0], threads))
+		return false;
+	m = maps.ExpMap(offset);
 	for (int i=offset+1; i<offset+block; ++i)
 		m += maps.ExpMap(i);
-	return m;
+	std::copy(pixels.begin(), pixels.end(), m.Buffer());
+	return true;
 }
 
 int main(int argc,char **argv) {
@@ -125,6 +146,7 @@ int main(int argc,char **argv) {
 	const char* srclistanalysis = params["srclistanalysis"];
 	const char* resmatrices = params["resmatrices"];
 	const char* respath = params["respath"];
+	int sumthreads = params["sumthreads"];
 	double ranal = params["ranal"];
 	int galmode = params["galmode"];
 	int isomode = params["isomode"];
@@ -265,8 +287,11 @@ int main(int argc,char **argv) {
                                 ds << std::endl;
 #endif
 
-				AgileMap ctsMap = SumMaps(simArr, j, block);
-				AgileMap expMap = SumExposure(mapData, j, block);
+				AgileMap ctsMap, expMap;
+				if (!SumMaps(simArr, j, block, sumthreads, ctsMap) || !SumExposure(mapData, j, block, sumthreads, expMap)) {
+					cerr << "Error summing maps from " << j+1 << " to " << j+block << ": maps of different sizes" << endl;
+					return EXIT_FAILURE;
+				}
 				/// Writing cts and exp maps
 				if (opmode & SaveMaps) {
 					char mapName[256];
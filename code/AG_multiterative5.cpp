@@ -29,7 +29,11 @@
 #include <iostream>
 #include <fstream>
 
+#include <thread>
+
 #include "RoiMulti5.h"
+#include "RoiMultiConfig.h"
+#include "RoiProfile.h"
 #include "PilParams.h"
 
 using namespace std;
@@ -67,6 +71,9 @@ const PilDescription c_params[] = {
 	{ PilInt,    "minimizerdefstrategy", "Minimizer default strategy" },
 	{ PilReal,   "mindefaulttolerance", "Minimizer default tolerance"},
 	{ PilInt,   "integratortype", "Integrator type (1-8)"},
+	{ PilString, "ulmethod", "Upper limit method of step two: fit (RoiMulti refits), brent (profile likelihood root)" },
+	{ PilString, "locmethod", "Location contour method of step two: fit (RoiMulti refits), polar (adaptive polar grid)" },
+	{ PilInt,    "profilethreads", "Number of threads for the polar contour (0 means all the cores)" },
 	{ PilNone,   "",   "" }
 	};
 
@@ -335,6 +342,14 @@ const char* outfilename = mPars["outfile"];
 double ulcl = mPars["ulcl"];
 double loccl = mPars["loccl"];
 
+/// With the fast methods RoiMulti skips its own upper limit and contour refits in step two
+string ulmethod = mPars.GetStrValue("ulmethod");
+string locmethod = mPars.GetStrValue("locmethod");
+bool brentUl = ulmethod=="brent";
+bool polarLoc = locmethod=="polar";
+double step2Ulcl = brentUl ? 0 : ulcl;
+double step2Loccl = polarLoc ? 0 : loccl;
+
 
 FixFlag fixflagscan = mPars["fixflagscan"];
 FixFlag fixflagstep2 = mPars["fixflagstep2"];
@@ -357,6 +372,14 @@ MapData mapData;
 if (!mapData.Load(maplist))
 	return -1;
 
+/// The profile fitters are set up at the first cycle and reused by the next ones
+RoiMultiConfig profileConfig;
+profileConfig.Load(mPars);
+int profileThreads = mPars["profilethreads"];
+if (profileThreads<1)
+	profileThreads = std::thread::hardware_concurrency();
+RoiProfile profile(profileConfig, mapData, ranal, profileThreads);
+
 
 double tsThreshold = sqrTsThreshold*sqrTsThreshold;
 double minSourceTS = minSourceSqrTS*minSourceSqrTS;
@@ -609,7 +632,7 @@ for (int cycle=0; cycle<maxIterations; ++cycle) {
 
 		string fileName(outfilename);
 		fileName += CycleNumber(cycle);
-		roiMulti.DoFit(tryArr, ranal, ulcl, loccl, 1);
+		roiMulti.DoFit(tryArr, ranal, step2Ulcl, step2Loccl, 1);
 		tryArr = roiMulti.GetFitData();
 		galc = roiMulti.GetGalactic(0).GetCoeff();
 		isoc = roiMulti.GetIsotropic(0).GetCoeff();
@@ -626,7 +649,7 @@ for (int cycle=0; cycle<maxIterations; ++cycle) {
 			tryArr[tryName].fixflag = 1;
 			tryArr.Print(cout);
 			tryArr.Print(logFile);
-			roiMulti.DoFit(tryArr, ranal, ulcl, loccl, 1);
+			roiMulti.DoFit(tryArr, ranal, step2Ulcl, step2Loccl, 1);
 			tryArr = roiMulti.GetFitData();
 			galc = roiMulti.GetGalactic(0).GetCoeff();
 			isoc = roiMulti.GetIsotropic(0).GetCoeff();
@@ -634,6 +657,13 @@ for (int cycle=0; cycle<maxIterations; ++cycle) {
 			roiMulti.WriteSources(fileName.c_str(), false, false, 0, 15, 10, true);
 			roiMulti.WriteHtml(fileName.c_str(), false, false, 0, 15, 10);
 			}
+		if (brentUl || polarLoc) {
+			vector<RoiProfile::Result> results = profile.Run(tryArr, brentUl ? ulcl : 0, polarLoc ? loccl : 0);
+			string profileName(fileName);
+			profileName += ".ulloc";
+			RoiProfile::Write(profileName.c_str(), fileName.c_str(), results, ulmethod.c_str(), locmethod.c_str());
+			RoiProfile::AppendToSources(fileName.c_str(), results, ulmethod.c_str(), locmethod.c_str());
+			}
 		/// Restore the fixflags
 		tryArr[tryName].fixflag = originalFixflag;
 		tryArr[tryName].gal= galc;
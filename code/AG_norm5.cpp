@@ -35,6 +35,9 @@
 #include <fitsio.h>
 #include <pil.h>
 #include <iostream>
+#include <vector>
+#include <limits>
+#include <cstdio>
 
 using std::cout;
 using std::cerr;
@@ -76,6 +79,71 @@ void exitOnPilError(int status) {
     }
 }
 
+/// The sum of a buffer, compensated in four independent lanes so that the
+/// loop can be vectorized, and the count of its non zero pixels
+static double Reduce(const double* x, long n, long* nonZero)
+{
+    double s[4] = { 0, 0, 0, 0 };
+    double c[4] = { 0, 0, 0, 0 };
+    long nz[4] = { 0, 0, 0, 0 };
+    long i = 0;
+    for (; i+4<=n; i+=4)
+        for (int k=0; k<4; ++k) {
+            double y = x[i+k] - c[k];
+            double t = s[k] + y;
+            c[k] = (t - s[k]) - y;
+            s[k] = t;
+            nz[k] += x[i+k]!=0;
+        }
+    for (; i<n; ++i) {
+        double y = x[i] - c[0];
+        double t = s[0] + y;
+        c[0] = (t - s[0]) - y;
+        s[0] = t;
+        nz[0] += x[i]!=0;
+    }
+    double sum = 0.0;
+    double comp = 0.0;
+    for (int k=0; k<8; ++k) {
+        double y = (k%2 ? -c[k/2] : s[k/2]) - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    *nonZero = nz[0] + nz[1] + nz[2] + nz[3];
+    return sum;
+}
+
+/// Divide a buffer in place by the sum and return the maximum of the result
+static double Scale(double* x, long n, double sum)
+{
+    double m[4];
+    for (int k=0; k<4; ++k)
+        m[k] = -std::numeric_limits<double>::infinity();
+    long i = 0;
+    for (; i+4<=n; i+=4)
+        for (int k=0; k<4; ++k) {
+            x[i+k] /= sum;
+            m[k] = x[i+k]>m[k] ? x[i+k] : m[k];
+        }
+    for (; i<n; ++i) {
+        x[i] /= sum;
+        m[0] = x[i]>m[0] ? x[i] : m[0];
+    }
+    double max = m[0];
+    for (int k=1; k<4; ++k)
+        max = m[k]>max ? m[k] : max;
+    return max;
+}
+
+static double Max(const double* x, long n)
+{
+    double max = -std::numeric_limits<double>::infinity();
+    for (long i=0; i<n; ++i)
+        max = x[i]>max ? x[i] : max;
+    return max;
+}
+
 int main(int argc, char *argv[]) {
     cout << startString << endl;
 	cout << "Using " << *pilversion << endl;
@@ -83,6 +151,7 @@ int main(int argc, char *argv[]) {
     int status, numpar;
 	char mapFilename[FLEN_FILENAME];
 	char mapnormFilename[FLEN_FILENAME];
+	int perPlane = 1;
 
 	// parse .par or command line options with PIL
 	status = PILInit(argc,argv);
@@ -93,12 +162,15 @@ int main(int argc, char *argv[]) {
 	exitOnPilError(status);
 	status = PILGetString("mapnorm", mapnormFilename);
 	exitOnPilError(status);
+	status = PILGetBool("perplane", &perPlane);
+	exitOnPilError(status);
 	status = PILClose(status);
 	exitOnPilError(status);
 
 	cout << endl << "INPUT PARAMETERS:" << endl;
 	cout << "Input map filename = " << mapFilename << endl;
 	cout << "Normalized map filename = " << mapnormFilename << endl;
+	cout << "Normalize each plane = " << (perPlane ? "yes" : "no") << endl;
 
     fitsfile *ifd;
     fits_open_file(&ifd, mapFilename, READONLY, &status);
@@ -114,44 +186,81 @@ int main(int argc, char *argv[]) {
     fits_get_img_dim(ifd, &numaxis, &status);
     exitOnFitsIOError(status);
 
-    if(numaxis != 2) {
-        cerr << "Error: only images with 2 dimensions are supported!" << endl;
+    if(numaxis < 2 || numaxis > 9) {
+        cerr << "Error: only images with 2 to 9 dimensions are supported!" << endl;
         return EXIT_FAILURE;
     }
 
-    long dimaxis[2];
-    fits_get_img_size(ifd, 2, dimaxis, &status);
+    long dimaxis[9];
+    fits_get_img_size(ifd, numaxis, dimaxis, &status);
     exitOnFitsIOError(status);
 
-    long npixels = dimaxis[0] * dimaxis[1];
-    long pix1[3] = {1, 1, 1};
+    /// The planes are the images of the first two axes
+    long planeSize = dimaxis[0] * dimaxis[1];
+    long planes = 1;
+    for (int i=2; i<numaxis; ++i)
+        planes *= dimaxis[i];
+    long npixels = planeSize * planes;
+    long pix1[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
 
-    double *inbuff = new double[npixels];
-    fits_read_pix(ifd, TDOUBLE, pix1, npixels, NULL, inbuff, NULL, &status);
+    std::vector<double> buff(npixels);
+    fits_read_pix(ifd, TDOUBLE, pix1, npixels, NULL, &buff[0], NULL, &status);
     exitOnFitsIOError(status);
     fits_close_file(ifd, &status);
     exitOnFitsIOError(status);
 
-    // compute the sum
-    double sum = 0.0;
-    for (int y=0; y<dimaxis[0]; ++y) {
-        for (int x=0; x<dimaxis[1]; ++x) {
-            int idx = y * dimaxis[1] + x;
-            sum += inbuff[idx];
-        }
+    // compute the sums, then normalize in place
+    std::vector<double> sums(planes);
+    std::vector<long> nonZeros(planes);
+    double total = 0.0;
+    double comp = 0.0;
+    long nonZero = 0;
+    for (long p=0; p<planes; ++p) {
+        sums[p] = Reduce(&buff[p*planeSize], planeSize, &nonZeros[p]);
+        double y = sums[p] - comp;
+        double t = total + y;
+        comp = (t - total) - y;
+        total = t;
+        nonZero += nonZeros[p];
     }
-    // normalize
-    double *normbuff = new double[npixels];
-    for (int y=0; y<dimaxis[0]; ++y) {
-        for (int x=0; x<dimaxis[1]; ++x) {
-            int idx = y * dimaxis[1] + x;
-            normbuff[idx] = inbuff[idx] / sum;
+    std::vector<double> maxs(planes);
+    double outSum = 0.0;
+    for (long p=0; p<planes; ++p) {
+        double sum = perPlane ? sums[p] : total;
+        if (sum!=0) {
+            maxs[p] = Scale(&buff[p*planeSize], planeSize, sum);
+            outSum += sums[p] / sum;
+        }
+        else {
+            cerr << "Warning: the sum of plane " << p+1 << " is zero, the plane is not normalized" << endl;
+            maxs[p] = Max(&buff[p*planeSize], planeSize);
         }
     }
+    double max = maxs[0];
+    for (long p=1; p<planes; ++p)
+        max = maxs[p]>max ? maxs[p] : max;
+    double mean = npixels ? outSum / npixels : 0.0;
+    cout << "Sum = " << total << ", non zero pixels = " << nonZero << endl;
+
+    /// The statistics of the normalized data, in the header before the data
+    fits_update_key(ofd, TDOUBLE, "NORMSUM", &total, "Sum of the input map", &status);
+    fits_update_key(ofd, TDOUBLE, "DATAMEAN", &mean, "Mean of the normalized map", &status);
+    fits_update_key(ofd, TDOUBLE, "DATAMAX", &max, "Maximum of the normalized map", &status);
+    fits_update_key(ofd, TLONG, "NONZERO", &nonZero, "Non zero pixels", &status);
+    fits_update_key(ofd, TLOGICAL, "NORMPLAN", &perPlane, "Each plane normalized to 1", &status);
+    if (planes>1 && planes<=999)
+        for (long p=0; p<planes; ++p) {
+            char key[FLEN_KEYWORD];
+            snprintf(key, sizeof(key), "NSUM%ld", p+1);
+            fits_update_key(ofd, TDOUBLE, key, &sums[p], "Sum of the input plane", &status);
+            snprintf(key, sizeof(key), "NMAX%ld", p+1);
+            fits_update_key(ofd, TDOUBLE, key, &maxs[p], "Maximum of the normalized plane", &status);
+            snprintf(key, sizeof(key), "NNZ%ld", p+1);
+            fits_update_key(ofd, TLONG, key, &nonZeros[p], "Non zero pixels of the plane", &status);
+        }
+    exitOnFitsIOError(status);
 
-    delete[] inbuff;
-    fits_write_pix(ofd, TDOUBLE, pix1, npixels, normbuff, &status);
-    delete[] normbuff;
+    fits_write_pix(ofd, TDOUBLE, pix1, npixels, &buff[0], &status);
     exitOnFitsIOError(status);
 
     fits_close_file(ofd, &status);
@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+// DESCRIPTION
+//       AGILE Science Tools
+//       AG responsepack
+//       Oct 2026
+//
+// INPUT
+//       The PSD, SAR and EDP calibration files.
+//
+// OUTPUT
+//       A response pack: a single page aligned binary file with all the
+//       grids and axes of the calibration files, to be memory mapped by
+//       ResponsePack, with the checksums of the source files.
+//
+// NOTICE
+//       Any information contained in this software
+//       is property of the AGILE TEAM and is strictly
+//       private and confidential.
+//       Copyright (C) 2005-2019 AGILE Team. All rights reserved.
+/*
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+////////////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <PilParams.h>
+#include "ResponsePack.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+const char* startString = {
+"###################################################\n"
+"###    AG_responsepack B25 v1.0.0               ###\n"
+"###################################################\n"
+};
+
+const char* endString = {
+"###################################################\n"
+"###   AG_responsepack B25 ended successfully #####\n"
+"###################################################\n"
+};
+
+const PilDescription paramsDescr[] = {
+    { PilString, "psdfile", "PSD file name" },
+    { PilString, "sarfile", "SAR file name" },
+    { PilString, "edpfile", "EDP file name" },
+    { PilString, "outfile", "Output response pack file name" },
+    { PilNone, "", "" }
+};
+
+int main(int argc, char *argv[]) {
+    cout << startString << endl;
+
+    PilParams params(paramsDescr);
+    if (!params.Load(argc, argv))
+        return EXIT_FAILURE;
+
+    cout << endl << "INPUT PARAMETERS:" << endl;
+    params.Print();
+
+    vector<string> fileNames;
+    const char* calibParams[3] = { "psdfile", "sarfile", "edpfile" };
+    for (int i=0; i<3; ++i) {
+        string fileName = params.GetStrValue(calibParams[i]);
+        if (!fileName.empty() && fileName!="none")
+            fileNames.push_back(fileName);
+    }
+
+    const char* outfile = params["outfile"];
+    if (!ResponsePack::Build(fileNames, outfile)) {
+        cerr << "Error converting the calibration files into " << outfile << "." << endl;
+        return EXIT_FAILURE;
+    }
+
+    ResponsePack pack;
+    if (!pack.Open(outfile))
+        return EXIT_FAILURE;
+    for (int i=0; i<pack.SourceCount(); ++i) {
+        const ResponsePackSource& src = pack.Source(i);
+        cout << src.tag << " " << src.fileName << " " << src.size << " bytes, checksum "
+             << std::hex << src.checksum << std::dec << (pack.IsCurrent(i, true) ? "" : " CHANGED") << endl;
+    }
+    for (int i=0; i<pack.ArrayCount(); ++i) {
+        const ResponsePackArray& array = pack.Array(i);
+        cout << array.name << " [";
+        for (uint32_t d=0; d<array.ndims; ++d)
+            cout << (d ? "x" : "") << array.dims[d];
+        cout << "] " << (array.type==PackFloat32 ? "float32" : "float64") << endl;
+    }
+
+    cout << endString << endl;
+    return EXIT_SUCCESS;
+}
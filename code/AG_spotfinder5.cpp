@@ -36,6 +36,7 @@
 #include <cstdlib>
 #include "AgileMap.h"
 #include "PlotCts2D3.h"
+#include "CapMask.h"
 
 using namespace std;
 
@@ -109,14 +110,12 @@ if (argc == 6) {
 
 	int M = map.GetNrows();
 	int N = map.GetNcols();
+	CapMask mask(map);
+	mask.Apply(lcenter, bcenter, radious, CapUnion, true);
 	for (int i=0; i<M; i+=stepbin)
-		for (int j=0; j<N; j+=stepbin) {
-			double l = map.l(i, j);
-			double b = map.b(i, j);
-			double dist = AlikeSphdistDeg(l, b, lcenter, bcenter);
-			if (dist<=radious) 
-				asciiFile << "0.00000e-08 " << l << " " << b << " " << " 2.1 " << typeanal << " 2.0 S" << index++ << endl;
-			}
+		for (int j=0; j<N; j+=stepbin)
+			if (mask.Inside(i, j))
+				asciiFile << "0.00000e-08 " << map.l(i, j) << " " << map.b(i, j) << " " << " 2.1 " << typeanal << " 2.0 S" << index++ << endl;
 	return 0;
 	}
 
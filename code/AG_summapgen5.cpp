@@ -38,6 +38,7 @@
 #include <PilParams.h>
 #include <AgileMap.h>
 #include <AlikeData5.h>
+#include "MapStacker.h"
 
 using std::cout;
 using std::cerr;
@@ -56,9 +57,11 @@ const char* endString = {
 };
 
 const PilDescription paramsDescr[] = {
-    { PilString, "maplist", "Input maplist" },
+    { PilString, "maplist", "Input maplist or map cube" },
     { PilString, "outprefix", "Output name prefix for the maps" },
     { PilString, "operationmode", "Operation mode: sum (it adds the maps), sub (it subtracts from the first map the others map)" },
+    { PilBool,   "prefetch", "Read the next maps while subtracting the current ones" },
+    { PilInt,    "threads", "Number of threads reading the maps to sum, each keeping a pair of maps in memory (0 means all the cores)" },
     { PilNone, "", "" }
 };
 
@@ -72,18 +75,18 @@ int main(int argc, char *argv[]) {
     cout << endl << "INPUT PARAMETERS:" << endl;
     params.Print();
 
+    /// A map cube built by AG_mapcube can be given instead of the map list
+    MapCube cube;
+    bool isCube = MapCube::IsCube(params["maplist"]);
+    if (isCube && !cube.Open(params["maplist"]))
+        return EXIT_FAILURE;
+
     MapList maplist;
-    int mapCount = maplist.Read(params["maplist"]);
+    int mapCount = isCube ? cube.Count() : maplist.Read(params["maplist"]);
     if (!mapCount) {
         cerr << "File " << params.GetStrValue("maplist") << " missing or empty." << endl;
         return EXIT_FAILURE;
     }
-    MapData mapData;
-    if (!mapData.Load(maplist)) {
-        cerr << "Error loading map data from " << params.GetStrValue("maplist") << "." << endl;
-        return EXIT_FAILURE;
-    }
-
     std::string operationMode = std::string(params["operationmode"]);
     short int om;
     if(operationMode == "sum")
@@ -97,51 +100,30 @@ int main(int argc, char *argv[]) {
     }
 
 
-    AgileMap sumCts = mapData.CtsMap(0);
-    AgileMap sumExp = mapData.ExpMap(0);
-    double emin = sumCts.GetEmin();
-    double emax = sumCts.GetEmax();
-    double fovmin = sumCts.GetFovMin();
-    double fovmax = sumCts.GetFovMax();
-    double tstart = sumCts.GetTstart();
-    double tstop = sumCts.GetTstop();
-    for(int i=1; i<mapData.Count(); i++) {
-        AgileMap otherCts = mapData.CtsMap(i);
-        for (int y=0; y<sumCts.Dim(0); ++y)
-            for (int x=0; x<sumCts.Dim(1); ++x)
-            {
-                sumCts(y, x) += (om) * otherCts(y, x);
-                if(sumCts(y, x) < 0)
-                   sumCts(y, x) = 0;
-            }
-
-        AgileMap otherExp = mapData.ExpMap(i);
-        for (int y=0; y<sumExp.Dim(0); ++y)
-            for (int x=0; x<sumExp.Dim(1); ++x)
-            {
-                sumExp(y, x) += (om) * otherExp(y, x);
-                if (sumExp(y, x) < 0 )
-                    sumExp(y, x) = 0;
-            }
-        if(otherCts.GetEmin() < emin)
-            emin = otherCts.GetEmin();
-        if(otherCts.GetEmax() > emax)
-            emax = otherCts.GetEmax();
-        if(otherCts.GetFovMin() < fovmin)
-            fovmin = otherCts.GetFovMin();
-        if(otherCts.GetFovMax() > fovmax)
-            fovmax = otherCts.GetFovMax();
-        if(otherCts.GetTstart() < tstart)
-            tstart = otherCts.GetTstart();
-        if(otherCts.GetTstop() > tstop)
-            tstop = otherCts.GetTstop();
+    bool prefetch = params["prefetch"];
+    int threads = params["threads"];
+    MapStacker ctsStacker(om);
+    MapStacker expStacker(om, true);
+    bool loaded;
+    if (isCube)
+        loaded = MapStacker::StackCube(cube, ctsStacker, expStacker);
+    else if (om>0) {
+        double mapsPerSecond = 0;
+        loaded = MapStacker::TreeSumList(maplist, ctsStacker, expStacker, threads, &mapsPerSecond);
+        if (loaded)
+            cout << "Stacked " << 2*mapCount << " maps, " << mapsPerSecond << " maps/s" << endl;
+    }
+    else
+        loaded = MapStacker::StackList(maplist, ctsStacker, expStacker, prefetch);
+    if (!loaded) {
+        cerr << "Error loading map data from " << params.GetStrValue("maplist") << "." << endl;
+        return EXIT_FAILURE;
     }
-    sumCts.SetEnergy(emin, emax);
-    sumExp.SetEnergy(emin, emax);
-    sumCts.SetFov(fovmin, fovmax);
-    sumExp.SetFov(fovmin, fovmax);
-    sumCts.SetTT(tstart, tstop);
-    sumExp.SetTT(tstart, tstop);
+    AgileMap& sumCts = ctsStacker.Map();
+    AgileMap& sumExp = expStacker.Map();
+    sumExp.SetEnergy(sumCts.GetEmin(), sumCts.GetEmax());
+    sumExp.SetFov(sumCts.GetFovMin(), sumCts.GetFovMax());
+    sumExp.SetTT(sumCts.GetTstart(), sumCts.GetTstop());
 
     std::string outCts = std::string(params["outprefix"])+".cts.gz";
     if(sumCts.WriteWithAllMetadata(outCts.c_str()))
@@ -0,0 +1,347 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <cstring>
+#include <cmath>
+
+#include "CapMask.h"
+
+
+CapMask::CapMask(const AgileMap& map):
+	m_map(map), m_rows(map.Rows()), m_cols(map.Cols()),
+	m_mask(long(map.Rows())*map.Cols(), 0), m_row(map.Cols(), 0), m_evaluations(0)
+{
+}
+
+
+void CapMask::Clear(bool value)
+{
+if (!m_mask.empty())
+	memset(&m_mask[0], value ? 1 : 0, m_mask.size());
+}
+
+
+bool CapMask::RuleFromChar(char c, CapMaskRule* rule)
+{
+if (c=='+')
+	*rule = CapUnion;
+else if (c=='*')
+	*rule = CapIntersection;
+else if (c=='-')
+	*rule = CapExclusion;
+else
+	return false;
+return true;
+}
+
+
+double CapMask::Dist(int row, int col, double l, double b) const
+{
+++m_evaluations;
+return m_map.SrcDist(row, col, l, b);
+}
+
+bool CapMask::In(int row, int col, double l, double b, double radius, bool closed) const
+{
+double dist = Dist(row, col, l, b);
+return closed ? dist<=radius : dist<radius;
+}
+
+
+/// The last column of [a, z] inside the cap, a being inside and the inside
+/// columns being a prefix of the range
+int CapMask::LastIn(int row, int a, int z, double l, double b, double radius, bool closed) const
+{
+if (In(row, z, l, b, radius, closed))
+	return z;
+while (z-a>1) {
+	int m = a+(z-a)/2;
+	if (In(row, m, l, b, radius, closed))
+		a = m;
+	else
+		z = m;
+	}
+return a;
+}
+
+/// The first column of [a, z] inside the cap, z being inside and the inside
+/// columns being a suffix of the range
+int CapMask::FirstIn(int row, int a, int z, double l, double b, double radius, bool closed) const
+{
+if (In(row, a, l, b, radius, closed))
+	return a;
+while (z-a>1) {
+	int m = a+(z-a)/2;
+	if (In(row, m, l, b, radius, closed))
+		z = m;
+	else
+		a = m;
+	}
+return z;
+}
+
+/// The column of the largest distance in [a, z], by ternary search
+int CapMask::Farthest(int row, int a, int z, double l, double b) const
+{
+while (z-a>2) {
+	int m1 = a+(z-a)/3;
+	int m2 = z-(z-a)/3;
+	if (Dist(row, m1, l, b)>Dist(row, m2, l, b))
+		z = m2;
+	else
+		a = m1;
+	}
+int far = a;
+double farDist = Dist(row, a, l, b);
+for (int c=a+1; c<=z; ++c) {
+	double dist = Dist(row, c, l, b);
+	if (dist>farDist) {
+		farDist = dist;
+		far = c;
+		}
+	}
+return far;
+}
+
+/// The first column of [a, z] with a finite distance, a being out of the
+/// projection and z inside it
+int CapMask::FirstFinite(int row, int a, int z, double l, double b) const
+{
+while (z-a>1) {
+	int m = a+(z-a)/2;
+	if (std::isfinite(Dist(row, m, l, b)))
+		z = m;
+	else
+		a = m;
+	}
+return z;
+}
+
+/// The last column of [a, z] with a finite distance, a being inside the
+/// projection and z out of it
+int CapMask::LastFinite(int row, int a, int z, double l, double b) const
+{
+while (z-a>1) {
+	int m = a+(z-a)/2;
+	if (std::isfinite(Dist(row, m, l, b)))
+		a = m;
+	else
+		z = m;
+	}
+return a;
+}
+
+/// The column of [lo, hi] closest to the center, descending from c with
+/// steps doubled while the distance decreases
+int CapMask::Closest(int row, int c, int lo, int hi, double l, double b, double* dist) const
+{
+double d = Dist(row, c, l, b);
+bool moved = true;
+while (moved) {
+	moved = false;
+	for (int dir=-1; dir<=1; dir+=2) {
+		int step = 1;
+		while (c+dir*step>=lo && c+dir*step<=hi) {
+			double next = Dist(row, c+dir*step, l, b);
+			if (next>=d)
+				break;
+			c += dir*step;
+			d = next;
+			step *= 2;
+			moved = true;
+			}
+		}
+	}
+*dist = d;
+return c;
+}
+
+
+int CapMask::RowSpans(int row, double l, double b, double radius, bool closed, int* hint, int spans[6]) const
+{
+if (m_cols<1)
+	return 0;
+/// Outside the projection (e.g. the corners of an AIT map) the distance is
+/// not finite and the pixels are outside the cap. The projected columns
+/// of a row are searched as an interval [lo, hi] around a projected one.
+int c = *hint<0 ? 0 : *hint>=m_cols ? m_cols-1 : *hint;
+if (!std::isfinite(Dist(row, c, l, b))) {
+	c = m_cols/2;
+	if (!std::isfinite(Dist(row, c, l, b)))
+		return -1;
+	}
+int lo = 0;
+int hi = m_cols-1;
+if (!std::isfinite(Dist(row, lo, l, b)))
+	lo = FirstFinite(row, lo, c, l, b);
+if (!std::isfinite(Dist(row, hi, l, b)))
+	hi = LastFinite(row, c, hi, l, b);
+double best;
+c = Closest(row, c, lo, hi, l, b, &best);
+*hint = c;
+bool inCenter = closed ? best<=radius : best<radius;
+bool inFirst = In(row, lo, l, b, radius, closed);
+bool inLast = In(row, hi, l, b, radius, closed);
+
+/// Left of the closest column the distance grows from the row start to a
+/// maximum and then decreases, so the inside columns are a prefix and a
+/// suffix of [lo, c]; the same on the right of it
+int count = 0;
+int mainFirst = c;
+int mainLast = c;
+if (inFirst && inCenter) {
+	int p = Farthest(row, lo, c, l, b);
+	if (In(row, p, l, b, radius, closed))
+		mainFirst = lo;
+	else {
+		spans[0] = lo;
+		spans[1] = LastIn(row, lo, p, l, b, radius, closed);
+		count = 1;
+		mainFirst = FirstIn(row, p, c, l, b, radius, closed);
+		}
+	}
+else if (inFirst) {
+	spans[0] = lo;
+	spans[1] = LastIn(row, lo, c, l, b, radius, closed);
+	count = 1;
+	}
+else if (inCenter)
+	mainFirst = FirstIn(row, lo, c, l, b, radius, closed);
+
+int tailFirst = -1;
+if (inLast && inCenter) {
+	int q = Farthest(row, c, hi, l, b);
+	if (In(row, q, l, b, radius, closed))
+		mainLast = hi;
+	else {
+		mainLast = LastIn(row, c, q, l, b, radius, closed);
+		tailFirst = FirstIn(row, q, hi, l, b, radius, closed);
+		}
+	}
+else if (inLast)
+	tailFirst = FirstIn(row, c, hi, l, b, radius, closed);
+else if (inCenter)
+	mainLast = LastIn(row, c, hi, l, b, radius, closed);
+
+if (inCenter) {
+	if (count && spans[1]+1>=mainFirst)
+		mainFirst = spans[0], count = 0;
+	spans[2*count] = mainFirst;
+	spans[2*count+1] = mainLast;
+	++count;
+	}
+if (tailFirst>=0) {
+	if (count && spans[2*count-1]+1>=tailFirst)
+		spans[2*count-1] = hi;
+	else {
+		spans[2*count] = tailFirst;
+		spans[2*count+1] = hi;
+		++count;
+		}
+	}
+
+/// The columns next to the spans and the middle of each gap must be
+/// outside, the middle of each span inside, otherwise the row has a shape
+/// not expected and it is evaluated pixel by pixel
+int gapFirst = lo;
+for (int k=0; k<=count; ++k) {
+	int gapLast = k<count ? spans[2*k]-1 : hi;
+	if (gapLast>=gapFirst && In(row, gapFirst+(gapLast-gapFirst)/2, l, b, radius, closed))
+		return -1;
+	if (k==count)
+		break;
+	if (spans[2*k]>0 && In(row, spans[2*k]-1, l, b, radius, closed))
+		return -1;
+	if (spans[2*k+1]<m_cols-1 && In(row, spans[2*k+1]+1, l, b, radius, closed))
+		return -1;
+	if (!In(row, spans[2*k]+(spans[2*k+1]-spans[2*k])/2, l, b, radius, closed))
+		return -1;
+	gapFirst = spans[2*k+1]+1;
+	}
+/// A second minimum of the distance (rows of AIT maps near the poles) is
+/// reached descending from the row ends, it must be in a span
+for (int end=0; end<2; ++end) {
+	double dist;
+	int m = Closest(row, end ? hi : lo, lo, hi, l, b, &dist);
+	if (closed ? dist<=radius : dist<radius) {
+		int k = 0;
+		while (k<count && (m<spans[2*k] || m>spans[2*k+1]))
+			++k;
+		if (k==count)
+			return -1;
+		}
+	}
+return count;
+}
+
+
+void CapMask::Apply(double l, double b, double radius, CapMaskRule rule, bool closed)
+{
+/// The closest column of a row is the hint of the next one
+int hint = m_cols/2;
+int row, col;
+if (m_map.GetRowCol(l, b, &row, &col) && col>=0 && col<m_cols)
+	hint = col;
+for (row=0; row<m_rows; ++row) {
+	unsigned char* mask = &m_mask[long(row)*m_cols];
+	int spans[6];
+	int count = RowSpans(row, l, b, radius, closed, &hint, spans);
+	if (count>=0) {
+		if (rule==CapUnion)
+			for (int k=0; k<count; ++k)
+				memset(mask+spans[2*k], 1, spans[2*k+1]-spans[2*k]+1);
+		else if (rule==CapExclusion)
+			for (int k=0; k<count; ++k)
+				memset(mask+spans[2*k], 0, spans[2*k+1]-spans[2*k]+1);
+		else {
+			int from = 0;
+			for (int k=0; k<count; ++k) {
+				memset(mask+from, 0, spans[2*k]-from);
+				from = spans[2*k+1]+1;
+				}
+			memset(mask+from, 0, m_cols-from);
+			}
+		continue;
+		}
+	for (col=0; col<m_cols; ++col)
+		m_row[col] = In(row, col, l, b, radius, closed);
+	for (col=0; col<m_cols; ++col) {
+		if (rule==CapUnion)
+			mask[col] |= m_row[col];
+		else if (rule==CapExclusion)
+			mask[col] &= !m_row[col];
+		else
+			mask[col] &= m_row[col];
+		}
+	}
+}
+
+
+long CapMask::Count() const
+{
+long count = 0;
+for (size_t i=0; i<m_mask.size(); ++i)
+	count += m_mask[i];
+return count;
+}
+
+
+void CapMask::CopyTo(AgileMap& map) const
+{
+for (int row=0; row<m_rows; ++row) {
+	const unsigned char* mask = Row(row);
+	for (int col=0; col<m_cols; ++col)
+		map(row, col) = mask[col] ? 1. : 0.;
+	}
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _CAPMASK_H
+#define _CAPMASK_H
+
+#include <vector>
+
+#include <AgileMap.h>
+
+
+/// How a cap is combined with the mask
+enum CapMaskRule { CapUnion=0, CapIntersection=1, CapExclusion=2 };
+
+
+/// A 0/1 mask of the pixels of a map inside a combination of spherical
+/// caps. Along a row of the map the distance from the center of a cap has
+/// a minimum, found by descending from the minimum of the previous row,
+/// and it grows monotonically on both sides, apart from the border of an
+/// all-sky map where it can decrease again towards the row ends. So a cap
+/// crosses a row in at most three intervals, whose ends are found by
+/// bisection with a number of distance evaluations growing with the
+/// logarithm of the columns, and the intervals are filled with memset.
+/// The pixels out of the projection (e.g. the corners of an AIT map) have
+/// a non finite distance and are outside; the search is limited to the
+/// projected columns of the row. The columns next to each interval, the
+/// middle of each interval and gap, and the minima reached from the row
+/// ends are checked, the rows of a different shape are evaluated pixel by
+/// pixel. The distances are the ones of AgileMap::SrcDist, so the masks
+/// are the same of a full scan.
+/// \brief Mask of the pixels inside spherical caps
+class CapMask {
+
+public:
+	/// \param[in] map The map providing the grid, it must outlive the mask.
+	CapMask(const AgileMap& map);
+
+	/// Set all the pixels to value.
+	void Clear(bool value=false);
+
+	/// Combine a cap with the mask.
+	/// \param[in] closed Include the pixels at distance radius, otherwise
+	/// only the ones closer than radius.
+	void Apply(double l, double b, double radius, CapMaskRule rule=CapUnion, bool closed=false);
+
+	/// The intervals of columns of a row inside a cap.
+	/// \param[in,out] hint The column where the search of the closest column
+	/// starts, the closest column on return.
+	/// \param[out] spans The first and last column of each interval.
+	/// \return the number of intervals, -1 if the row has to be evaluated
+	/// pixel by pixel.
+	int RowSpans(int row, double l, double b, double radius, bool closed, int* hint, int spans[6]) const;
+
+	int Rows() const { return m_rows; }
+	int Cols() const { return m_cols; }
+	const unsigned char* Row(int row) const { return &m_mask[long(row)*m_cols]; }
+	bool Inside(int row, int col) const { return m_mask[long(row)*m_cols+col]!=0; }
+
+	/// The pixels inside the mask.
+	long Count() const;
+
+	/// The distance evaluations done so far.
+	long Evaluations() const { return m_evaluations; }
+
+	/// Write the mask as 1 and 0 into a map of the same size.
+	void CopyTo(AgileMap& map) const;
+
+	/// '+' union, '*' intersection, '-' exclusion.
+	/// \return false for any other character.
+	static bool RuleFromChar(char c, CapMaskRule* rule);
+
+private:
+	bool In(int row, int col, double l, double b, double radius, bool closed) const;
+	double Dist(int row, int col, double l, double b) const;
+	int FirstFinite(int row, int a, int z, double l, double b) const;
+	int LastFinite(int row, int a, int z, double l, double b) const;
+	int Closest(int row, int c, int lo, int hi, double l, double b, double* dist) const;
+	int Farthest(int row, int a, int z, double l, double b) const;
+	int FirstIn(int row, int a, int z, double l, double b, double radius, bool closed) const;
+	int LastIn(int row, int a, int z, double l, double b, double radius, bool closed) const;
+
+	const AgileMap& m_map;
+	int m_rows;
+	int m_cols;
+	std::vector<unsigned char> m_mask;
+	std::vector<unsigned char> m_row;
+	mutable long m_evaluations;
+};
+
+#endif
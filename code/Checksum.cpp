@@ -0,0 +1,49 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <fstream>
+#include <vector>
+
+#include "Checksum.h"
+
+static const uint64_t c_fnvPrime = 1099511628211ULL;
+
+const uint64_t Checksum::Offset;
+
+
+uint64_t Checksum::Fnv1a(const void* data, size_t size, uint64_t hash)
+{
+const unsigned char* bytes = static_cast<const unsigned char*>(data);
+for (size_t i=0; i<size; ++i) {
+	hash ^= bytes[i];
+	hash *= c_fnvPrime;
+	}
+return hash;
+}
+
+
+uint64_t Checksum::File(const char* fileName)
+{
+std::ifstream file(fileName, std::ios::binary);
+if (!file)
+	return 0;
+uint64_t hash = Offset;
+std::vector<char> buffer(1<<20);
+while (file) {
+	file.read(&buffer[0], buffer.size());
+	hash = Fnv1a(&buffer[0], file.gcount(), hash);
+	}
+return hash;
+}
@@ -0,0 +1,40 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <cstddef>
+#include <stdint.h>
+
+
+/// 64 bit FNV-1a hashes of memory blocks and files, used to name the
+/// cache files of the tools and to detect changed inputs. Not meant to
+/// resist deliberate collisions.
+/// \brief FNV-1a checksums
+class Checksum {
+
+public:
+	/// The initial value of a hash
+	static const uint64_t Offset = 14695981039346656037ULL;
+
+	/// Continue hash with a block of memory.
+	static uint64_t Fnv1a(const void* data, size_t size, uint64_t hash=Offset);
+
+	/// The hash of the whole content of a file, 0 if it can't be read.
+	static uint64_t File(const char* fileName);
+};
+
+#endif
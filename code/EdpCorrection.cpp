@@ -0,0 +1,270 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <cmath>
+#include <thread>
+#include <fitsio.h>
+#include <CalibUtils.h>
+
+#include "EdpCorrection.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+
+/// The points of the Gauss-Legendre quadrature of each octave
+static const int s_glPoints = 16;
+
+
+/// Nodes and weights of the Gauss-Legendre quadrature in [-1, 1]
+static void GaussLegendre(int n, vector<double>& nodes, vector<double>& weights)
+{
+nodes.resize(n);
+weights.resize(n);
+for (int i=0; i<(n+1)/2; ++i) {
+	double x = cos(M_PI*(i+0.75)/(n+0.5));
+	double dp = 0;
+	for (int iter=0; iter<100; ++iter) {
+		double p0 = 1, p1 = 0;
+		for (int j=1; j<=n; ++j) {
+			double p2 = p1;
+			p1 = p0;
+			p0 = ((2*j-1)*x*p1-(j-1)*p2)/j;
+			}
+		dp = n*(x*p0-p1)/(x*x-1);
+		double dx = p0/dp;
+		x -= dx;
+		if (fabs(dx)<1e-15)
+			break;
+		}
+	nodes[i] = -x;
+	nodes[n-1-i] = x;
+	weights[i] = weights[n-1-i] = 2/((1-x*x)*dp*dp);
+	}
+}
+
+
+static double Spectrum(int type, double e, double index, double par2, double par3)
+{
+switch (type) {
+	case EdpPLExpCutoff:
+		return pow(e, -index)*exp(-e/par2);
+	case EdpPLSuperExpCutoff:
+		return pow(e, -index)*exp(-pow(e/par2, par3));
+	case EdpLogParabola:
+		return pow(e/par2, -(index+par3*log(e/par2)));
+	default:
+		return pow(e, -index);
+	}
+}
+
+
+EdpCorrection::EdpCorrection(): m_iMin(0), m_iMax(0), m_eMin(0), m_eMax(0), m_refIndex(0),
+	m_type(EdpPL), m_index(0), m_par2(0), m_par3(0), m_refNorm(0), m_specNorm(0)
+{
+}
+
+
+double EdpCorrection::Integral(int type, double eMin, double eMax, double index, double par2, double par3)
+{
+if (type==EdpPL) {
+	if (fabs(index-1)<1e-9)
+		return log(eMax/eMin);
+	return (pow(eMin, 1-index)-pow(eMax, 1-index))/(index-1);
+	}
+static vector<double> nodes, weights;
+static bool init = (GaussLegendre(s_glPoints, nodes, weights), true);
+(void)init;
+/// Integrate f(E)E in log(E), one octave at a time
+double uMin = log(eMin);
+double uMax = log(eMax);
+int steps = int(ceil((uMax-uMin)/M_LN2));
+if (steps<1)
+	steps = 1;
+double h = (uMax-uMin)/steps;
+double sum = 0;
+for (int s=0; s<steps; ++s) {
+	double mid = uMin+(s+0.5)*h;
+	for (int i=0; i<s_glPoints; ++i) {
+		double e = exp(mid+0.5*h*nodes[i]);
+		sum += weights[i]*Spectrum(type, e, index, par2, par3)*e;
+		}
+	}
+return 0.5*h*sum;
+}
+
+
+void EdpCorrection::BinIntegrals(const float* energies, int count, int type, double index, double par2,
+                                 double par3, vector<double>& integrals)
+{
+integrals.resize(count>1 ? count-1 : 0);
+for (int i=0; i<count-1; ++i)
+	integrals[i] = Integral(type, energies[i], energies[i+1], index, par2, par3);
+}
+
+
+bool EdpCorrection::Channels(const EdpGrid& edp, double emin, double emax, int& iMin, int& iMax)
+{
+const VecF& energies = edp.TrueEnergies();
+int eneChanCount = energies.Size();
+if (eneChanCount<2 || emin>=energies[eneChanCount-1] || emax<=emin)
+	return false;
+iMin = energies.GeomIndex(emin);
+iMax = eneChanCount-2;
+if (emax<energies[eneChanCount-1]) {
+	iMax = energies.GeomIndex(emax);
+	if (iMax>iMin)
+		--iMax;
+	}
+return true;
+}
+
+
+bool EdpCorrection::Compute(const EdpGrid& edp, int iMin, int iMax, double refIndex, int type,
+                            double index, double par2, double par3, int threads, const AeffGrid* aeff)
+{
+const VecF& trueEnergies = edp.TrueEnergies();
+const VecF& thetas = edp.Thetas();
+const VecF& phis = edp.Phis();
+int eneChanCount = trueEnergies.Size();
+if (iMin<0 || iMax<iMin || iMax>eneChanCount-2 || iMax>=edp.ObsEnergies().Size()) {
+	cout << "Error: EDP channels [" << iMin << ", " << iMax << "] out of the grid" << endl;
+	return false;
+	}
+m_iMin = iMin;
+m_iMax = iMax;
+m_eMin = trueEnergies[iMin];
+m_eMax = trueEnergies[iMax+1];
+m_refIndex = refIndex;
+m_type = type;
+m_index = index;
+m_par2 = par2;
+m_par3 = par3;
+
+m_energies.resize(eneChanCount);
+for (int i=0; i<eneChanCount; ++i)
+	m_energies[i] = trueEnergies[i];
+BinIntegrals(&m_energies[0], eneChanCount, EdpPL, refIndex, 0, 0, m_refWeights);
+BinIntegrals(&m_energies[0], eneChanCount, type, index, par2, par3, m_specWeights);
+m_refNorm = m_specNorm = 0;
+for (int i=iMin; i<=iMax; ++i) {
+	m_refNorm += m_refWeights[i];
+	m_specNorm += m_specWeights[i];
+	}
+
+m_thetas.resize(thetas.Size());
+for (int i=0; i<thetas.Size(); ++i)
+	m_thetas[i] = thetas[i];
+m_phis.resize(phis.Size());
+for (int i=0; i<phis.Size(); ++i)
+	m_phis[i] = phis[i];
+int cells = m_thetas.size()*m_phis.size();
+m_corr.assign(cells, 0.0);
+m_avgRef.assign(cells, 0.0);
+m_avgSpec.assign(cells, 0.0);
+
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1)
+	threads = 1;
+if (threads>cells)
+	threads = cells;
+std::atomic<int> next(0);
+vector<std::thread> workers;
+for (int t=1; t<threads; ++t)
+	workers.push_back(std::thread(CellWorker, this, &edp, aeff, &next));
+CellWorker(this, &edp, aeff, &next);
+for (size_t t=0; t<workers.size(); ++t)
+	workers[t].join();
+return true;
+}
+
+
+void EdpCorrection::CellWorker(EdpCorrection* self, const EdpGrid* edp, const AeffGrid* aeff, std::atomic<int>* next)
+{
+int cells = self->m_corr.size();
+for (int cell=(*next)++; cell<cells; cell=(*next)++)
+	self->ComputeCell(*edp, aeff, cell);
+}
+
+
+void EdpCorrection::ComputeCell(const EdpGrid& edp, const AeffGrid* aeff, int cell)
+{
+const Mat4F& grid = edp.Values();
+int thetaind = cell%m_thetas.size();
+int phiind = cell/m_thetas.size();
+/// The odd phi of the grid share the dispersion of the previous even phi
+int phiindcor = phiind%2 ? phiind-1 : phiind;
+int trueCount = m_refWeights.size();
+vector<double> refWeights(m_refWeights), specWeights(m_specWeights);
+if (aeff)
+	for (int etrue=0; etrue<trueCount; ++etrue) {
+		double area = aeff->Val(m_energies[etrue], m_thetas[thetaind], m_phis[phiind]);
+		refWeights[etrue] *= area;
+		specWeights[etrue] *= area;
+		}
+double avgRef = 0, avgSpec = 0;
+for (int eobs=m_iMin; eobs<=m_iMax; ++eobs)
+	for (int etrue=0; etrue<trueCount; ++etrue) {
+		double val = grid(phiindcor, thetaind, eobs, etrue);
+		avgRef += val*refWeights[etrue];
+		avgSpec += val*specWeights[etrue];
+		}
+m_avgRef[cell] = avgRef/m_refNorm;
+m_avgSpec[cell] = avgSpec/m_specNorm;
+m_corr[cell] = m_avgSpec[cell]>0 ? m_avgRef[cell]/m_avgSpec[cell] : 1.0;
+}
+
+
+int EdpCorrection::Write(const char* fileName, const char* extName) const
+{
+const int tfields = 5;
+const char* ttype[tfields] = { "THETA", "PHI", "CORR", "AVG_REF", "AVG_SPEC" };
+const char* tform[tfields] = { "1E", "1E", "1D", "1D", "1D" };
+const char* tunit[tfields] = { "degrees", "degrees", "", "", "" };
+
+int status = 0;
+fitsfile* fp;
+if (fits_create_file(&fp, fileName, &status))
+	return status;
+fits_create_tbl(fp, BINARY_TBL, 0, tfields, (char**)ttype, (char**)tform, (char**)tunit, extName, &status);
+double emin = m_eMin, emax = m_eMax;
+double refIndex = m_refIndex, index = m_index, par2 = m_par2, par3 = m_par3;
+int type = m_type;
+fits_write_key(fp, TDOUBLE, "EMIN", &emin, "Lower edge of the energy range [MeV]", &status);
+fits_write_key(fp, TDOUBLE, "EMAX", &emax, "Upper edge of the energy range [MeV]", &status);
+fits_write_key(fp, TDOUBLE, "REFINDEX", &refIndex, "Index of the reference power law", &status);
+fits_write_key(fp, TINT, "SPECTYPE", &type, "0=PL 1=PLExpCutoff 2=PLSuperExpCutoff 3=LogParabola", &status);
+fits_write_key(fp, TDOUBLE, "INDEX", &index, "Spectral index", &status);
+fits_write_key(fp, TDOUBLE, "PAR2", &par2, "Cutoff or pivot energy [MeV]", &status);
+fits_write_key(fp, TDOUBLE, "PAR3", &par3, "Second index or curvature", &status);
+long rows = m_corr.size();
+if (rows) {
+	vector<float> thetas(rows), phis(rows);
+	for (long cell=0; cell<rows; ++cell) {
+		thetas[cell] = m_thetas[cell%m_thetas.size()];
+		phis[cell] = m_phis[cell/m_thetas.size()];
+		}
+	fits_write_col(fp, TFLOAT, 1, 1, 1, rows, (void*)&thetas[0], &status);
+	fits_write_col(fp, TFLOAT, 2, 1, 1, rows, (void*)&phis[0], &status);
+	fits_write_col(fp, TDOUBLE, 3, 1, 1, rows, (void*)&m_corr[0], &status);
+	fits_write_col(fp, TDOUBLE, 4, 1, 1, rows, (void*)&m_avgRef[0], &status);
+	fits_write_col(fp, TDOUBLE, 5, 1, 1, rows, (void*)&m_avgSpec[0], &status);
+	}
+int closeStatus = 0;
+fits_close_file(fp, &closeStatus);
+return status ? status : closeStatus;
+}
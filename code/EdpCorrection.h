@@ -0,0 +1,109 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _EDPCORRECTION_H
+#define _EDPCORRECTION_H
+
+#include <vector>
+#include <atomic>
+
+class EdpGrid;
+class AeffGrid;
+
+
+/// The spectral shapes, numbered as the spectral models of the sources
+/// (0=PL, 1=PLExpCutoff, 2=PLSuperExpCutoff, 3=LogParabola).
+enum EdpSpectrum { EdpPL=0, EdpPLExpCutoff=1, EdpPLSuperExpCutoff=2, EdpLogParabola=3 };
+
+
+/// The energy dispersion correction of the flux of a source with a given
+/// spectral shape, relative to a reference power law, for each (theta, phi)
+/// cell of an EDP grid. The integrals of the two spectra in the true energy
+/// bins are computed once, analytically for the power law and with a
+/// Gauss-Legendre quadrature in log(E) for the other shapes, and then
+/// reused by all the cells, which are evaluated in parallel.
+/// \brief Spectral shape correction table from the energy dispersion
+class EdpCorrection {
+
+public:
+	EdpCorrection();
+
+	/// The integral of a spectrum in [eMin, eMax], up to the normalization.
+	/// \param[in] type One of EdpSpectrum.
+	/// \param[in] index The photon index, gamma1 for PLSuperExpCutoff, alpha for LogParabola.
+	/// \param[in] par2 The cutoff energy, or the pivot energy for LogParabola.
+	/// \param[in] par3 gamma2 for PLSuperExpCutoff, beta for LogParabola.
+	static double Integral(int type, double eMin, double eMax, double index, double par2, double par3);
+
+	/// The integrals of a spectrum in the count-1 bins of an energy grid.
+	static void BinIntegrals(const float* energies, int count, int type, double index, double par2,
+	                         double par3, std::vector<double>& integrals);
+
+	/// The observed energy channels [iMin, iMax] of an energy range, with
+	/// the boundaries of the EDP grid. An emax beyond the grid selects up
+	/// to the last bin.
+	/// \return false if the range is out of the grid.
+	static bool Channels(const EdpGrid& edp, double emin, double emax, int& iMin, int& iMax);
+
+	/// Compute the correction table.
+	/// \param[in] edp The energy dispersion grid.
+	/// \param[in] iMin, iMax The first and the last observed energy channels of the analysis.
+	/// \param[in] refIndex The index of the reference power law.
+	/// \param[in] type, index, par2, par3 The spectrum of the source, as in Integral().
+	/// \param[in] threads The number of threads, 0 for all the cores.
+	/// \param[in] aeff If given, the true energy bins are also weighted by the effective area of the cell.
+	/// \return false if the channels are out of the grid.
+	bool Compute(const EdpGrid& edp, int iMin, int iMax, double refIndex, int type,
+	             double index, double par2, double par3, int threads=1, const AeffGrid* aeff=0);
+
+	int Thetas() const { return m_thetas.size(); }
+	int Phis() const { return m_phis.size(); }
+	float Theta(int thetaind) const { return m_thetas[thetaind]; }
+	float Phi(int phiind) const { return m_phis[phiind]; }
+
+	/// The ratio between the EDP averages of the reference and of the
+	/// source spectrum in the cell.
+	double Value(int thetaind, int phiind) const { return m_corr[Cell(thetaind, phiind)]; }
+	double AvgRef(int thetaind, int phiind) const { return m_avgRef[Cell(thetaind, phiind)]; }
+	double AvgSpec(int thetaind, int phiind) const { return m_avgSpec[Cell(thetaind, phiind)]; }
+
+	/// Write the table as a binary table with a row for each cell and the
+	/// spectrum in the header.
+	/// \return the cfitsio status, 0 on success.
+	int Write(const char* fileName, const char* extName="EDPCORR") const;
+
+private:
+	int Cell(int thetaind, int phiind) const { return phiind*m_thetas.size()+thetaind; }
+	void ComputeCell(const EdpGrid& edp, const AeffGrid* aeff, int cell);
+	static void CellWorker(EdpCorrection* self, const EdpGrid* edp, const AeffGrid* aeff, std::atomic<int>* next);
+
+	int m_iMin, m_iMax;
+	double m_eMin, m_eMax;
+	double m_refIndex;
+	int m_type;
+	double m_index, m_par2, m_par3;
+
+	std::vector<float> m_thetas;
+	std::vector<float> m_phis;
+	std::vector<float> m_energies;
+	std::vector<double> m_refWeights;
+	std::vector<double> m_specWeights;
+	double m_refNorm, m_specNorm;
+
+	std::vector<double> m_corr;
+	std::vector<double> m_avgRef;
+	std::vector<double> m_avgSpec;
+};
+
+#endif
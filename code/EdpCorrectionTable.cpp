@@ -0,0 +1,264 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <fitsio.h>
+
+#include "EdpCorrectionTable.h"
+
+using std::vector;
+
+/// The relative tolerance on the energy range of a lookup
+static const double c_energyTolerance = 1e-5;
+
+
+/// The position of x in a sorted axis as the lower node and the weight of
+/// the upper one, clamped to the edges
+static void Bracket(const vector<double>& axis, double x, int& lo, double& frac)
+{
+int n = axis.size();
+if (n<2 || x<=axis[0]) {
+	lo = 0;
+	frac = 0;
+	return;
+	}
+if (x>=axis[n-1]) {
+	lo = n-2;
+	frac = 1;
+	return;
+	}
+lo = std::upper_bound(axis.begin(), axis.end(), x)-axis.begin()-1;
+frac = (x-axis[lo])/(axis[lo+1]-axis[lo]);
+}
+
+
+static int AxisPos(const vector<double>& axis, double x)
+{
+return std::lower_bound(axis.begin(), axis.end(), x)-axis.begin();
+}
+
+
+static bool SameEnergy(double tabulated, double energy)
+{
+return fabs(tabulated-energy)<=c_energyTolerance*std::max(fabs(tabulated), 1.0);
+}
+
+
+EdpCorrectionTable::EdpCorrectionTable(): m_refIndex(0)
+{
+}
+
+
+bool EdpCorrectionTable::Key::operator<(const Key& other) const
+{
+if (model!=other.model)
+	return model<other.model;
+if (emin!=other.emin)
+	return emin<other.emin;
+return emax<other.emax;
+}
+
+
+void EdpCorrectionTable::Append(int model, float emin, float emax, double index, double par2, double par3,
+                                const vector<double>& corr)
+{
+m_model.push_back(model);
+m_emin.push_back(emin);
+m_emax.push_back(emax);
+m_index.push_back(index);
+m_par2.push_back(par2);
+m_par3.push_back(par3);
+for (size_t t=0; t<m_thetas.size(); ++t)
+	m_corr.push_back(t<corr.size() ? corr[t] : 1.0);
+}
+
+
+bool EdpCorrectionTable::Index()
+{
+m_blocks.clear();
+m_thetaAxis.assign(m_thetas.begin(), m_thetas.end());
+int rows = m_model.size();
+vector<Key> keys(rows);
+for (int r=0; r<rows; ++r) {
+	Key key = { m_model[r], m_emin[r], m_emax[r] };
+	keys[r] = key;
+	Block& block = m_blocks[key];
+	block.axes[0].push_back(m_index[r]);
+	block.axes[1].push_back(m_par2[r]);
+	block.axes[2].push_back(m_par3[r]);
+	}
+int nthetas = m_thetas.size();
+for (BlockMap::iterator it=m_blocks.begin(); it!=m_blocks.end(); ++it) {
+	Block& block = it->second;
+	for (int a=0; a<3; ++a) {
+		vector<double>& axis = block.axes[a];
+		std::sort(axis.begin(), axis.end());
+		axis.erase(std::unique(axis.begin(), axis.end()), axis.end());
+		}
+	block.values.assign(block.axes[0].size()*block.axes[1].size()*block.axes[2].size()*nthetas, 1.0);
+	}
+/// Every node of the grid of a block must come from exactly one row
+std::map<Key, vector<char> > filled;
+for (BlockMap::iterator it=m_blocks.begin(); it!=m_blocks.end(); ++it)
+	filled[it->first].assign(it->second.axes[0].size()*it->second.axes[1].size()*it->second.axes[2].size(), 0);
+bool complete = true;
+for (int r=0; r<rows; ++r) {
+	Block& block = m_blocks[keys[r]];
+	int i0 = AxisPos(block.axes[0], m_index[r]);
+	int i1 = AxisPos(block.axes[1], m_par2[r]);
+	int i2 = AxisPos(block.axes[2], m_par3[r]);
+	size_t node = (size_t(i2)*block.axes[1].size()+i1)*block.axes[0].size()+i0;
+	char& done = filled[keys[r]][node];
+	if (done)
+		complete = false;
+	done = 1;
+	std::copy(m_corr.begin()+size_t(r)*nthetas, m_corr.begin()+size_t(r+1)*nthetas, block.values.begin()+node*nthetas);
+	}
+for (std::map<Key, vector<char> >::const_iterator it=filled.begin(); it!=filled.end(); ++it)
+	if (std::find(it->second.begin(), it->second.end(), 0)!=it->second.end())
+		complete = false;
+if (!complete)
+	m_blocks.clear();
+return complete;
+}
+
+
+double EdpCorrectionTable::Value(int model, float emin, float emax, double index, double par2, double par3,
+                                 double theta, bool* found) const
+{
+/// The blocks are few, the energy range is matched within the tolerance
+BlockMap::const_iterator it = m_blocks.begin();
+while (it!=m_blocks.end() && !(it->first.model==model && SameEnergy(it->first.emin, emin) && SameEnergy(it->first.emax, emax)))
+	++it;
+if (found)
+	*found = it!=m_blocks.end();
+if (it==m_blocks.end())
+	return 1.0;
+const Block& block = it->second;
+int lo[3];
+double frac[3];
+Bracket(block.axes[0], index, lo[0], frac[0]);
+Bracket(block.axes[1], par2, lo[1], frac[1]);
+Bracket(block.axes[2], par3, lo[2], frac[2]);
+int loT;
+double fracT;
+Bracket(m_thetaAxis, theta, loT, fracT);
+int n0 = block.axes[0].size();
+int n1 = block.axes[1].size();
+int nthetas = m_thetas.size();
+double value = 0;
+for (int corner=0; corner<16; ++corner) {
+	int pos[3];
+	double weight = 1;
+	for (int a=0; a<3; ++a) {
+		int up = (corner>>a)&1;
+		weight *= up ? frac[a] : 1-frac[a];
+		pos[a] = std::min(lo[a]+up, int(block.axes[a].size())-1);
+		}
+	int upT = (corner>>3)&1;
+	weight *= upT ? fracT : 1-fracT;
+	if (weight==0)
+		continue;
+	int t = std::min(loT+upT, nthetas-1);
+	value += weight*block.values[((size_t(pos[2])*n1+pos[1])*n0+pos[0])*nthetas+t];
+	}
+return value;
+}
+
+
+int EdpCorrectionTable::Write(const char* fileName) const
+{
+int nthetas = m_thetas.size();
+char corrForm[16];
+sprintf(corrForm, "%dD", nthetas);
+const int tfields = 7;
+const char* ttype[tfields] = { "MODEL", "EMIN", "EMAX", "INDEX", "PAR2", "PAR3", "CORR" };
+const char* tform[tfields] = { "1J", "1E", "1E", "1D", "1D", "1D", corrForm };
+const char* tunit[tfields] = { "", "MeV", "MeV", "", "", "", "" };
+
+int status = 0;
+fitsfile* fp;
+if (fits_create_file(&fp, fileName, &status))
+	return status;
+fits_create_tbl(fp, BINARY_TBL, 0, tfields, (char**)ttype, (char**)tform, (char**)tunit, "FLUXCORR", &status);
+double refIndex = m_refIndex;
+fits_write_key(fp, TDOUBLE, "REFINDEX", &refIndex, "Index of the reference power law", &status);
+fits_write_key(fp, TINT, "NTHETA", &nthetas, "Number of thetas of the CORR column", &status);
+long rows = m_model.size();
+if (rows) {
+	fits_write_col(fp, TINT, 1, 1, 1, rows, (void*)&m_model[0], &status);
+	fits_write_col(fp, TFLOAT, 2, 1, 1, rows, (void*)&m_emin[0], &status);
+	fits_write_col(fp, TFLOAT, 3, 1, 1, rows, (void*)&m_emax[0], &status);
+	fits_write_col(fp, TDOUBLE, 4, 1, 1, rows, (void*)&m_index[0], &status);
+	fits_write_col(fp, TDOUBLE, 5, 1, 1, rows, (void*)&m_par2[0], &status);
+	fits_write_col(fp, TDOUBLE, 6, 1, 1, rows, (void*)&m_par3[0], &status);
+	if (nthetas)
+		fits_write_col(fp, TDOUBLE, 7, 1, 1, rows*nthetas, (void*)&m_corr[0], &status);
+	}
+const char* thetaType[1] = { "THETA" };
+const char* thetaForm[1] = { "1E" };
+const char* thetaUnit[1] = { "degrees" };
+fits_create_tbl(fp, BINARY_TBL, 0, 1, (char**)thetaType, (char**)thetaForm, (char**)thetaUnit, "THETAS", &status);
+if (nthetas)
+	fits_write_col(fp, TFLOAT, 1, 1, 1, nthetas, (void*)&m_thetas[0], &status);
+int closeStatus = 0;
+fits_close_file(fp, &closeStatus);
+return status ? status : closeStatus;
+}
+
+
+int EdpCorrectionTable::Read(const char* fileName)
+{
+int status = 0;
+fitsfile* fp;
+if (fits_open_file(&fp, fileName, READONLY, &status))
+	return status;
+long nthetas = 0;
+if (!fits_movnam_hdu(fp, BINARY_TBL, (char*)"THETAS", 0, &status))
+	fits_get_num_rows(fp, &nthetas, &status);
+m_thetas.resize(nthetas);
+if (nthetas)
+	fits_read_col(fp, TFLOAT, 1, 1, 1, nthetas, 0, &m_thetas[0], 0, &status);
+
+long rows = 0;
+fits_movnam_hdu(fp, BINARY_TBL, (char*)"FLUXCORR", 0, &status);
+fits_read_key(fp, TDOUBLE, "REFINDEX", &m_refIndex, 0, &status);
+fits_get_num_rows(fp, &rows, &status);
+if (!status) {
+	m_model.resize(rows);
+	m_emin.resize(rows);
+	m_emax.resize(rows);
+	m_index.resize(rows);
+	m_par2.resize(rows);
+	m_par3.resize(rows);
+	m_corr.resize(rows*nthetas);
+	}
+if (rows && !status) {
+	fits_read_col(fp, TINT, 1, 1, 1, rows, 0, &m_model[0], 0, &status);
+	fits_read_col(fp, TFLOAT, 2, 1, 1, rows, 0, &m_emin[0], 0, &status);
+	fits_read_col(fp, TFLOAT, 3, 1, 1, rows, 0, &m_emax[0], 0, &status);
+	fits_read_col(fp, TDOUBLE, 4, 1, 1, rows, 0, &m_index[0], 0, &status);
+	fits_read_col(fp, TDOUBLE, 5, 1, 1, rows, 0, &m_par2[0], 0, &status);
+	fits_read_col(fp, TDOUBLE, 6, 1, 1, rows, 0, &m_par3[0], 0, &status);
+	if (nthetas)
+		fits_read_col(fp, TDOUBLE, 7, 1, 1, rows*nthetas, 0, &m_corr[0], 0, &status);
+	}
+int closeStatus = 0;
+fits_close_file(fp, &closeStatus);
+if (!status && !Index())
+	return c_incompleteGrid;
+return status ? status : closeStatus;
+}
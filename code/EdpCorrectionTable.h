@@ -0,0 +1,110 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _EDPCORRECTIONTABLE_H
+#define _EDPCORRECTIONTABLE_H
+
+#include <vector>
+#include <map>
+
+
+/// A lookup table of the spectral shape corrections of the flux, as a
+/// function of the off-axis angle theta, for a grid of spectral parameters
+/// of each spectral model and energy range. The table is generated once by
+/// AG_fluxcorrtable with EdpCorrection, then the corrections are
+/// interpolated, linearly in the spectral parameters and in theta, without
+/// integrating the spectra.
+/// \brief Tabulated spectral shape corrections
+class EdpCorrectionTable {
+
+public:
+	EdpCorrectionTable();
+
+	/// Set the theta axis, in degrees, shared by all the rows.
+	void SetThetas(const std::vector<float>& thetas) { m_thetas = thetas; }
+	void SetRefIndex(double refIndex) { m_refIndex = refIndex; }
+
+	/// Add the corrections of a spectrum, one for each theta of the axis.
+	void Append(int model, float emin, float emax, double index, double par2, double par3,
+	            const std::vector<double>& corr);
+
+	/// The status of Read when the rows are not a complete grid
+	static const int c_incompleteGrid = -1;
+
+	/// \return the cfitsio status, 0 on success.
+	int Write(const char* fileName) const;
+	/// \return the cfitsio status, 0 on success, c_incompleteGrid if the
+	/// rows of a model and energy range are not exactly one for each node
+	/// of the index x par2 x par3 grid.
+	int Read(const char* fileName);
+
+	/// Build the interpolation grids from the rows, called by Read.
+	/// \return false, and no grid, if the rows are not a complete grid.
+	bool Index();
+
+	/// The interpolated correction, after Index() or Read(). The parameters
+	/// out of the grid are clamped to its edges, the energy range must be
+	/// one of the table within a relative tolerance of 1e-5. No memory is
+	/// allocated, so it can be called inside a fit loop.
+	/// \param[in] model One of EdpSpectrum.
+	/// \param[out] found Set to false if the model and the energy range are not tabulated.
+	/// \return the correction, 1 if not found.
+	double Value(int model, float emin, float emax, double index, double par2, double par3,
+	             double theta, bool* found=0) const;
+
+	int Rows() const { return m_model.size(); }
+	double RefIndex() const { return m_refIndex; }
+	const std::vector<float>& Thetas() const { return m_thetas; }
+
+	/// The spectrum and the corrections of the r-th row
+	int Model(int r) const { return m_model[r]; }
+	float Emin(int r) const { return m_emin[r]; }
+	float Emax(int r) const { return m_emax[r]; }
+	double SpectralIndex(int r) const { return m_index[r]; }
+	double Par2(int r) const { return m_par2[r]; }
+	double Par3(int r) const { return m_par3[r]; }
+	double Corr(int r, int t) const { return m_corr[r*m_thetas.size()+t]; }
+
+private:
+	/// A spectral model and energy range of the table
+	struct Key {
+		int model;
+		float emin, emax;
+		bool operator<(const Key& other) const;
+	};
+
+	/// The rows of a (model, emin, emax), on the grid index x par2 x par3
+	struct Block {
+		std::vector<double> axes[3];
+		std::vector<double> values;
+	};
+	typedef std::map<Key, Block> BlockMap;
+
+	double m_refIndex;
+	std::vector<float> m_thetas;
+	/// The theta axis in double, built by Index()
+	std::vector<double> m_thetaAxis;
+
+	std::vector<int> m_model;
+	std::vector<float> m_emin;
+	std::vector<float> m_emax;
+	std::vector<double> m_index;
+	std::vector<double> m_par2;
+	std::vector<double> m_par3;
+	std::vector<double> m_corr;
+
+	BlockMap m_blocks;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+
+#include "FitProfiler.h"
+
+using std::string;
+using std::endl;
+
+
+FitProfiler::Phase::Phase(FitProfiler* profiler, const char* name):
+	m_profiler(Active(profiler) ? profiler : 0), m_name(name), m_start(0)
+{
+if (m_profiler)
+	m_start = Now();
+}
+
+FitProfiler::Phase::~Phase()
+{
+if (m_profiler)
+	m_profiler->AddTime(m_name, Now()-m_start);
+}
+
+
+FitProfiler::FitProfiler(): m_enabled(false)
+{
+}
+
+
+double FitProfiler::Now()
+{
+return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void FitProfiler::AddTime(const string& phase, double seconds)
+{
+for (size_t i=0; i<m_times.size(); ++i)
+	if (m_times[i].first==phase) {
+		m_times[i].second += seconds;
+		return;
+		}
+m_times.push_back(std::make_pair(phase, seconds));
+}
+
+void FitProfiler::AddCount(const string& counter, long count)
+{
+for (size_t i=0; i<m_counts.size(); ++i)
+	if (m_counts[i].first==counter) {
+		m_counts[i].second += count;
+		return;
+		}
+m_counts.push_back(std::make_pair(counter, count));
+}
+
+void FitProfiler::AddSource(const SourceStats& stats)
+{
+m_sources.push_back(stats);
+}
+
+
+/// A flag of SourceStats, null or empty when unknown
+static const char* JsonFlag(int flag)
+{
+return flag<0 ? "null" : flag ? "true" : "false";
+}
+
+static const char* CsvFlag(int flag)
+{
+return flag<0 ? "" : flag ? "1" : "0";
+}
+
+
+bool FitProfiler::WriteJson(const char* fileName) const
+{
+std::ofstream outFile(fileName);
+if (!outFile.is_open())
+	return false;
+outFile << std::setprecision(8);
+outFile << "{" << endl << "  \"phases\": {";
+for (size_t i=0; i<m_times.size(); ++i)
+	outFile << (i ? "," : "") << endl << "    \"" << m_times[i].first << "\": " << m_times[i].second;
+outFile << endl << "  }," << endl << "  \"counters\": {";
+for (size_t i=0; i<m_counts.size(); ++i)
+	outFile << (i ? "," : "") << endl << "    \"" << m_counts[i].first << "\": " << m_counts[i].second;
+outFile << endl << "  }," << endl << "  \"sources\": [";
+for (size_t i=0; i<m_sources.size(); ++i) {
+	const SourceStats& s = m_sources[i];
+	outFile << (i ? "," : "") << endl << "    { \"label\": \"" << s.label << "\""
+	        << ", \"flux\": " << s.flux << ", \"TS\": " << s.TS << ", \"fixflag\": " << s.fixflag
+	        << ", \"ul_evals\": " << s.ulEvals << ", \"ul_time\": " << s.ulTime
+	        << ", \"ul_converged\": " << JsonFlag(s.ulConverged)
+	        << ", \"loc_evals\": " << s.locEvals << ", \"loc_time\": " << s.locTime
+	        << ", \"loc_closed\": " << JsonFlag(s.locClosed) << " }";
+	}
+outFile << endl << "  ]" << endl << "}" << endl;
+return outFile.good();
+}
+
+
+bool FitProfiler::WriteCsv(const char* fileName) const
+{
+std::ofstream outFile(fileName);
+if (!outFile.is_open())
+	return false;
+outFile << std::setprecision(8);
+outFile << "kind,name,value" << endl;
+for (size_t i=0; i<m_times.size(); ++i)
+	outFile << "phase," << m_times[i].first << "," << m_times[i].second << endl;
+for (size_t i=0; i<m_counts.size(); ++i)
+	outFile << "counter," << m_counts[i].first << "," << m_counts[i].second << endl;
+outFile << endl << "label,flux,TS,fixflag,ul_evals,ul_time,ul_converged,loc_evals,loc_time,loc_closed" << endl;
+for (size_t i=0; i<m_sources.size(); ++i) {
+	const SourceStats& s = m_sources[i];
+	outFile << s.label << "," << s.flux << "," << s.TS << "," << s.fixflag << ","
+	        << s.ulEvals << "," << s.ulTime << "," << CsvFlag(s.ulConverged) << ","
+	        << s.locEvals << "," << s.locTime << "," << CsvFlag(s.locClosed) << endl;
+	}
+return outFile.good();
+}
@@ -0,0 +1,85 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _FITPROFILER_H
+#define _FITPROFILER_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+
+/// Wall time of the phases of a fit, call counters and per source
+/// statistics, written as a JSON or CSV sidecar of the fit outputs.
+/// A disabled profiler, or a null pointer, is never asked for the time.
+/// \brief Low overhead instrumentation of RoiMulti based tools
+class FitProfiler {
+
+public:
+	/// The statistics of one fitted source. The flags are 1 or 0, or -1
+	/// when unknown, as for the upper limits and contours of RoiMulti.
+	struct SourceStats {
+		std::string label;
+		double flux;
+		double TS;
+		int fixflag;
+		int ulEvals;
+		double ulTime;
+		int ulConverged;
+		int locEvals;
+		double locTime;
+		int locClosed;
+	};
+
+	/// Adds the wall time of its scope to a phase of the profiler
+	class Phase {
+	public:
+		Phase(FitProfiler* profiler, const char* name);
+		~Phase();
+	private:
+		FitProfiler* m_profiler;
+		const char*  m_name;
+		double       m_start;
+	};
+
+	FitProfiler();
+
+	void Enable(bool enable) { m_enabled = enable; }
+	bool IsEnabled() const { return m_enabled; }
+
+	/// Add seconds to the wall time of a phase
+	void AddTime(const std::string& phase, double seconds);
+	/// Add count to a counter
+	void AddCount(const std::string& counter, long count=1);
+	void AddSource(const SourceStats& stats);
+
+	/// \return true on success.
+	bool WriteJson(const char* fileName) const;
+	/// \return true on success.
+	bool WriteCsv(const char* fileName) const;
+
+	/// A monotonic wall clock in seconds
+	static double Now();
+
+	/// true if the profiler exists and is enabled
+	static bool Active(const FitProfiler* profiler) { return profiler && profiler->m_enabled; }
+
+private:
+	bool m_enabled;
+	std::vector<std::pair<std::string, double> > m_times;
+	std::vector<std::pair<std::string, long> >   m_counts;
+	std::vector<SourceStats>                     m_sources;
+};
+
+#endif
@@ -0,0 +1,387 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
+
+#include "HealpixReprojector.h"
+#include "Checksum.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+static const char c_magic[8] = { 'A', 'G', 'H', 'P', 'X', 'M', 'A', 'P' };
+static const uint32_t c_version = 1;
+
+
+/// The fixed size header of a cache file, followed by the geometry key,
+/// the offsets, the HEALPix pixels and the weights
+struct HealpixReprojHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t keyLength;
+	uint64_t entries;
+	uint64_t outside;
+	double   corners[8];
+};
+
+
+/// The mapping of a block of rows, built by one thread
+struct HealpixRowBlock {
+	vector<uint32_t> counts;
+	vector<int32_t>  pixels;
+	vector<float>    weights;
+	long             outside;
+};
+
+
+static double WrapDeg(double d)
+{
+while (d>180.0)
+	d -= 360.0;
+while (d<-180.0)
+	d += 360.0;
+return d;
+}
+
+static void Corners(const AgileMap& map, double corners[8])
+{
+int rows[4] = { 0, 0, map.Rows()-1, map.Rows()-1 };
+int cols[4] = { 0, map.Cols()-1, 0, map.Cols()-1 };
+for (int k=0; k<4; ++k)
+	map.GetCoords(rows[k], cols[k], &corners[2*k], &corners[2*k+1]);
+}
+
+
+HealpixReprojector::HealpixReprojector():
+	m_rows(0), m_cols(0), m_outside(0), m_fromCache(false)
+{
+}
+
+
+string HealpixReprojector::GeometryKey(const AgileMap& map, long nside, int subsamples)
+{
+std::ostringstream key;
+key << std::setprecision(12)
+    << map.Rows() << ' ' << map.Cols() << ' '
+    << map.GetMapCenterL() << ' ' << map.GetMapCenterB() << ' ' << map.GetXbin() << ' ' << map.GetYbin() << ' '
+    << map.GetX0() << ' ' << map.GetY0() << ' ' << map.GetLonpole() << ' '
+    << nside << ' ' << subsamples;
+return key.str();
+}
+
+string HealpixReprojector::CacheFileName(const char* cacheDir, const AgileMap& map, long nside, int subsamples)
+{
+string key = GeometryKey(map, nside, subsamples);
+std::ostringstream name;
+name << cacheDir << "/hpx_" << std::hex << std::setw(16) << std::setfill('0')
+     << Checksum::Fnv1a(key.data(), key.size()) << ".map";
+return name.str();
+}
+
+
+/// The samples of the map pixels in the rows [rowBegin, rowEnd), the
+/// centers in the nearest mode, subsamples x subsamples points per pixel
+/// placed with the derivatives of the coordinates in the drizzle mode
+static void SampleWorker(int rows, int cols, const double* l, const double* b, int subsamples,
+                         int rowBegin, int rowEnd, int chunkBegin, double* sl, double* sb)
+{
+long perPixel = long(subsamples)*subsamples;
+for (int r=rowBegin; r<rowEnd; ++r)
+	for (int c=0; c<cols; ++c) {
+		long i = long(r)*cols+c;
+		long k = (long(r-chunkBegin)*cols+c)*perPixel;
+		if (subsamples<=1) {
+			sl[k] = l[i];
+			sb[k] = b[i];
+			continue;
+			}
+		/// The derivatives of the coordinates along the columns and the rows
+		int c0 = c>0 ? c-1 : c;
+		int c1 = c<cols-1 ? c+1 : c;
+		int r0 = r>0 ? r-1 : r;
+		int r1 = r<rows-1 ? r+1 : r;
+		double dLdc = 0, dBdc = 0, dLdr = 0, dBdr = 0;
+		if (c1>c0) {
+			dLdc = WrapDeg(l[long(r)*cols+c1]-l[long(r)*cols+c0])/(c1-c0);
+			dBdc = (b[long(r)*cols+c1]-b[long(r)*cols+c0])/(c1-c0);
+			}
+		if (r1>r0) {
+			dLdr = WrapDeg(l[long(r1)*cols+c]-l[long(r0)*cols+c])/(r1-r0);
+			dBdr = (b[long(r1)*cols+c]-b[long(r0)*cols+c])/(r1-r0);
+			}
+		for (int v=0; v<subsamples; ++v) {
+			double dy = (v+0.5)/subsamples-0.5;
+			for (int u=0; u<subsamples; ++u, ++k) {
+				double dx = (u+0.5)/subsamples-0.5;
+				double x = l[i]+dx*dLdc+dy*dLdr;
+				double y = b[i]+dx*dBdc+dy*dBdr;
+				if (y>90.0)
+					y = 90.0;
+				else if (y<-90.0)
+					y = -90.0;
+				x = fmod(x, 360.0);
+				if (x<0)
+					x += 360.0;
+				sl[k] = x;
+				sb[k] = y;
+				}
+			}
+		}
+}
+
+/// The mapping of the rows [rowBegin, rowEnd) from the HEALPix pixels of
+/// their samples
+static void MergeWorker(long positions, int cols, int subsamples, const long* samplePixels,
+                        int rowBegin, int rowEnd, int chunkBegin, HealpixRowBlock* block)
+{
+long perPixel = long(subsamples)*subsamples;
+block->outside = 0;
+block->counts.clear();
+block->pixels.clear();
+block->weights.clear();
+block->counts.reserve(long(rowEnd-rowBegin)*cols);
+float fraction = 1.0f/perPixel;
+vector<long> parts;
+for (int r=rowBegin; r<rowEnd; ++r)
+	for (int c=0; c<cols; ++c) {
+		const long* pix = samplePixels+(long(r-chunkBegin)*cols+c)*perPixel;
+		parts.clear();
+		for (long k=0; k<perPixel; ++k)
+			if (pix[k]<0 || pix[k]>=positions)
+				++block->outside;
+			else
+				parts.push_back(pix[k]);
+		std::sort(parts.begin(), parts.end());
+		uint32_t count = 0;
+		for (size_t k=0; k<parts.size(); ) {
+			size_t m = k;
+			while (m<parts.size() && parts[m]==parts[k])
+				++m;
+			block->pixels.push_back(parts[k]);
+			block->weights.push_back(fraction*(m-k));
+			++count;
+			k = m;
+			}
+		block->counts.push_back(count);
+		}
+}
+
+
+/// The coordinate transforms of AgileMap and HealpixMap are done on this
+/// thread, the placement of the samples and the merging on the threads.
+/// The rows are done in chunks to bound the memory of the samples.
+void HealpixReprojector::Compute(const AgileMap& map, HealpixMap& hMap, int subsamples, int threads)
+{
+long size = long(m_rows)*m_cols;
+vector<double> l(size), b(size);
+for (int r=0; r<m_rows; ++r)
+	for (int c=0; c<m_cols; ++c) {
+		long i = long(r)*m_cols+c;
+		map.GetCoords(r, c, &l[i], &b[i]);
+		}
+
+long perPixel = long(subsamples)*subsamples;
+int chunkRows = int(std::max(1L, (1L<<20)/(long(m_cols)*perPixel)));
+if (chunkRows>m_rows)
+	chunkRows = m_rows;
+vector<double> sl(long(chunkRows)*m_cols*perPixel);
+vector<double> sb(sl.size());
+vector<long> samplePixels(sl.size());
+long positions = hMap.Count();
+vector<HealpixRowBlock> blocks(threads);
+m_offsets.assign(1, 0);
+m_offsets.reserve(size+1);
+m_pixels.clear();
+m_weights.clear();
+m_outside = 0;
+for (int chunkBegin=0; chunkBegin<m_rows; chunkBegin+=chunkRows) {
+	int chunkEnd = std::min(m_rows, chunkBegin+chunkRows);
+	int n = std::min(threads, chunkEnd-chunkBegin);
+	vector<std::thread> workers;
+	for (int t=1; t<n; ++t)
+		workers.push_back(std::thread(SampleWorker, m_rows, m_cols, &l[0], &b[0], subsamples,
+		                              chunkBegin+(chunkEnd-chunkBegin)*t/n, chunkBegin+(chunkEnd-chunkBegin)*(t+1)/n,
+		                              chunkBegin, &sl[0], &sb[0]));
+	SampleWorker(m_rows, m_cols, &l[0], &b[0], subsamples, chunkBegin, chunkBegin+(chunkEnd-chunkBegin)/n,
+	             chunkBegin, &sl[0], &sb[0]);
+	for (size_t t=0; t<workers.size(); ++t)
+		workers[t].join();
+
+	long samples = long(chunkEnd-chunkBegin)*m_cols*perPixel;
+	for (long k=0; k<samples; ++k)
+		samplePixels[k] = hMap.Gal2Hpx(sl[k], sb[k]);
+
+	workers.clear();
+	for (int t=1; t<n; ++t)
+		workers.push_back(std::thread(MergeWorker, positions, m_cols, subsamples, &samplePixels[0],
+		                              chunkBegin+(chunkEnd-chunkBegin)*t/n, chunkBegin+(chunkEnd-chunkBegin)*(t+1)/n,
+		                              chunkBegin, &blocks[t]));
+	MergeWorker(positions, m_cols, subsamples, &samplePixels[0], chunkBegin, chunkBegin+(chunkEnd-chunkBegin)/n,
+	            chunkBegin, &blocks[0]);
+	for (size_t t=0; t<workers.size(); ++t)
+		workers[t].join();
+
+	/// The blocks are joined in the order of the rows
+	for (int t=0; t<n; ++t) {
+		const HealpixRowBlock& block = blocks[t];
+		for (size_t k=0; k<block.counts.size(); ++k)
+			m_offsets.push_back(m_offsets.back()+block.counts[k]);
+		m_pixels.insert(m_pixels.end(), block.pixels.begin(), block.pixels.end());
+		m_weights.insert(m_weights.end(), block.weights.begin(), block.weights.end());
+		m_outside += block.outside;
+		}
+	}
+}
+
+
+bool HealpixReprojector::Read(const char* fileName, const AgileMap& map, long positions)
+{
+std::ifstream file(fileName, std::ios::binary);
+if (!file)
+	return false;
+HealpixReprojHeader header;
+if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	return false;
+if (memcmp(header.magic, c_magic, sizeof(c_magic)) || header.version!=c_version
+    || int(header.rows)!=m_rows || int(header.cols)!=m_cols || header.keyLength!=m_key.size())
+	return false;
+string key(header.keyLength, ' ');
+if (!file.read(&key[0], key.size()) || key!=m_key)
+	return false;
+/// Same key of a different projection
+double corners[8];
+Corners(map, corners);
+for (int k=0; k<8; ++k)
+	if (fabs(corners[k]-header.corners[k])>1e-9)
+		return false;
+m_offsets.resize(long(m_rows)*m_cols+1);
+m_pixels.resize(header.entries);
+m_weights.resize(header.entries);
+file.read(reinterpret_cast<char*>(&m_offsets[0]), m_offsets.size()*sizeof(uint32_t));
+if (header.entries) {
+	file.read(reinterpret_cast<char*>(&m_pixels[0]), m_pixels.size()*sizeof(int32_t));
+	file.read(reinterpret_cast<char*>(&m_weights[0]), m_weights.size()*sizeof(float));
+	}
+if (!file || m_offsets[0] || m_offsets.back()!=header.entries)
+	return false;
+for (size_t i=1; i<m_offsets.size(); ++i)
+	if (m_offsets[i]<m_offsets[i-1])
+		return false;
+for (size_t k=0; k<m_pixels.size(); ++k)
+	if (m_pixels[k]<0 || m_pixels[k]>=positions)
+		return false;
+m_outside = header.outside;
+return true;
+}
+
+bool HealpixReprojector::Write(const char* fileName, const AgileMap& map) const
+{
+HealpixReprojHeader header;
+memset(&header, 0, sizeof(header));
+memcpy(header.magic, c_magic, sizeof(c_magic));
+header.version = c_version;
+header.rows = m_rows;
+header.cols = m_cols;
+header.keyLength = m_key.size();
+header.entries = m_pixels.size();
+header.outside = m_outside;
+Corners(map, header.corners);
+
+/// Written aside and renamed, for the processes sharing the cache
+std::ostringstream tmpName;
+tmpName << fileName << ".tmp" << getpid();
+string tmp = tmpName.str();
+{
+std::ofstream file(tmp.c_str(), std::ios::binary);
+file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+file.write(m_key.data(), m_key.size());
+file.write(reinterpret_cast<const char*>(&m_offsets[0]), m_offsets.size()*sizeof(uint32_t));
+if (!m_pixels.empty()) {
+	file.write(reinterpret_cast<const char*>(&m_pixels[0]), m_pixels.size()*sizeof(int32_t));
+	file.write(reinterpret_cast<const char*>(&m_weights[0]), m_weights.size()*sizeof(float));
+	}
+if (!file) {
+	file.close();
+	remove(tmp.c_str());
+	return false;
+	}
+}
+if (rename(tmp.c_str(), fileName)) {
+	remove(tmp.c_str());
+	return false;
+	}
+return true;
+}
+
+
+bool HealpixReprojector::Prepare(const AgileMap& map, HealpixMap& hMap, int subsamples, int threads, const char* cacheDir)
+{
+if (map.Rows()<1 || map.Cols()<1)
+	return false;
+if (subsamples<1)
+	subsamples = 1;
+string key = GeometryKey(map, hMap.GetNSide(), subsamples);
+if (key==m_key)
+	return true;
+m_key = key;
+m_rows = map.Rows();
+m_cols = map.Cols();
+m_fromCache = false;
+string cacheName;
+if (cacheDir && *cacheDir) {
+	cacheName = CacheFileName(cacheDir, map, hMap.GetNSide(), subsamples);
+	m_fromCache = Read(cacheName.c_str(), map, hMap.Count());
+	if (m_fromCache)
+		return true;
+	}
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1)
+	threads = 1;
+Compute(map, hMap, subsamples, threads);
+if (!cacheName.empty() && !Write(cacheName.c_str(), map))
+	cerr << "Warning: could not write the cache file " << cacheName << endl;
+return true;
+}
+
+
+void HealpixReprojector::Scatter(const double* values, double* sums, double* weights, int* used) const
+{
+long size = long(m_rows)*m_cols;
+for (long i=0; i<size; ++i) {
+	double value = values[i];
+	for (uint32_t k=m_offsets[i]; k<m_offsets[i+1]; ++k) {
+		int32_t pix = m_pixels[k];
+		double w = m_weights[k];
+		sums[pix] += w*value;
+		if (weights)
+			weights[pix] += w;
+		if (used)
+			++used[pix];
+		}
+	}
+}
@@ -0,0 +1,89 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _HEALPIXREPROJECTOR_H
+#define _HEALPIXREPROJECTOR_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <AgileMap.h>
+#include <HealpixMap.h>
+
+
+/// The HEALPix pixels covered by each pixel of a map, with the fraction
+/// of the map pixel falling in each of them. In the nearest mode a map
+/// pixel goes entirely into the HEALPix pixel of its center. In the
+/// drizzle mode it is split in subsamples x subsamples parts, placed with
+/// the local derivatives of the coordinates, so that its value is shared
+/// among the HEALPix pixels it overlaps and the total is preserved.
+/// The mapping depends only on the WCS of the map, on nside and on the
+/// subsamples, and it can be kept in a cache directory, so that the maps
+/// of the same geometry are converted with a single scatter.
+/// \brief Reprojection of the maps on HEALPix
+class HealpixReprojector {
+
+public:
+	HealpixReprojector();
+
+	/// Compute the mapping of the pixels of a map, or read it from the cache.
+	/// Nothing is done if the mapping of the same geometry is already there.
+	/// \param[in] hMap The HEALPix map, only its nside is used.
+	/// \param[in] subsamples 1 for the nearest mode, more for the drizzle mode.
+	/// \param[in] threads The number of threads placing the samples and
+	/// merging them, 0 for all the cores. The coordinate transforms are done
+	/// on the calling thread.
+	/// \param[in] cacheDir The directory of the cache, it must exist. Null or
+	/// empty for no cache. A cache file of a different geometry, e.g. of
+	/// another projection, or with offsets or pixels out of range, is replaced.
+	/// \return false if the map is empty.
+	bool Prepare(const AgileMap& map, HealpixMap& hMap, int subsamples=1, int threads=0, const char* cacheDir=0);
+
+	/// Add the values of a map with the geometry of Prepare.
+	/// \param[in] values The pixels of the map, in the order of its buffer.
+	/// \param[in,out] sums The sums of the fractions of the values, one per HEALPix pixel.
+	/// \param[in,out] weights If given, the sums of the fractions of the pixels.
+	/// \param[in,out] used If given, the number of map pixels touching each HEALPix pixel.
+	void Scatter(const double* values, double* sums, double* weights=0, int* used=0) const;
+
+	/// The map pixels, or parts of them, falling outside the HEALPix range.
+	long Outside() const { return m_outside; }
+
+	/// The mapping was read from the cache.
+	bool FromCache() const { return m_fromCache; }
+
+	long Entries() const { return long(m_pixels.size()); }
+
+	/// The name of the cache file of a geometry.
+	static std::string CacheFileName(const char* cacheDir, const AgileMap& map, long nside, int subsamples);
+
+private:
+	static std::string GeometryKey(const AgileMap& map, long nside, int subsamples);
+	void Compute(const AgileMap& map, HealpixMap& hMap, int subsamples, int threads);
+	/// \return false if the file is missing, of another geometry or inconsistent.
+	bool Read(const char* fileName, const AgileMap& map, long positions);
+	bool Write(const char* fileName, const AgileMap& map) const;
+
+	std::string           m_key;
+	int                   m_rows;
+	int                   m_cols;
+	long                  m_outside;
+	bool                  m_fromCache;
+	std::vector<uint32_t> m_offsets;
+	std::vector<int32_t>  m_pixels;
+	std::vector<float>    m_weights;
+};
+
+#endif
@@ -0,0 +1,285 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "KingFit.h"
+
+static const double c_deg2rad = M_PI/180.0;
+static const double c_huge = std::numeric_limits<double>::max();
+/// The largest Newton decrement, relative to the deviance, of a stationary point
+static const double c_gradTolerance = 1e-6;
+
+
+/// Solve a 3x3 linear system by Gauss elimination with partial pivoting
+static bool Solve3(double a[3][3], double b[3], double x[3])
+{
+for (int col=0; col<3; ++col) {
+	int pivot = col;
+	for (int row=col+1; row<3; ++row)
+		if (fabs(a[row][col])>fabs(a[pivot][col]))
+			pivot = row;
+	if (a[pivot][col]==0)
+		return false;
+	for (int k=0; k<3; ++k)
+		std::swap(a[col][k], a[pivot][k]);
+	std::swap(b[col], b[pivot]);
+	for (int row=col+1; row<3; ++row) {
+		double f = a[row][col]/a[col][col];
+		for (int k=col; k<3; ++k)
+			a[row][k] -= f*a[col][k];
+		b[row] -= f*b[col];
+		}
+	}
+for (int row=2; row>=0; --row) {
+	double sum = b[row];
+	for (int k=row+1; k<3; ++k)
+		sum -= a[row][k]*x[k];
+	x[row] = sum/a[row][row];
+	}
+return true;
+}
+
+
+KingFit::KingFit(Statistic statistic, double coeff, bool ring):
+	m_statistic(statistic), m_coeff(coeff), m_ring(ring), m_maxIterations(200), m_tolerance(1e-9)
+{
+for (int i=0; i<3; ++i) {
+	m_low[i] = -c_huge;
+	m_high[i] = c_huge;
+	}
+}
+
+
+void KingFit::SetLimits(int par, double low, double high)
+{
+m_low[par] = low;
+m_high[par] = high;
+}
+
+
+double KingFit::King(double rho, double ang, double gamma)
+{
+return (1.0 - 1.0/gamma) * pow(1.0 + (rho*rho/ang/ang)/(2.0*gamma), -gamma);
+}
+
+
+double KingFit::Model(double rho, const double* params) const
+{
+double val = params[0]*King(rho, params[1], params[2]);
+if (params[3]!=0)
+	val += params[3]*King(rho, params[4], params[5]);
+if (m_ring)
+	val *= sin(rho*c_deg2rad);
+return m_coeff*val;
+}
+
+
+double KingFit::Deviance(const double* rhos, const double* values, const double* weights, int count, const double* params) const
+{
+double dev = 0;
+for (int i=0; i<count; ++i) {
+	double m = Model(rhos[i], params);
+	if (!std::isfinite(m))
+		return c_huge;
+	if (m_statistic==LeastSquares) {
+		double w = weights ? weights[i] : 1.0;
+		if (w>0)
+			dev += w*(values[i]-m)*(values[i]-m);
+		}
+	else {
+		if (m<=0) {
+			if (values[i]>0 || m<0)
+				return c_huge;
+			continue;
+			}
+		dev += m - values[i];
+		if (values[i]>0)
+			dev += values[i]*log(values[i]/m);
+		}
+	}
+return m_statistic==LeastSquares ? dev : 2*dev;
+}
+
+
+void KingFit::Clamp(double* params) const
+{
+for (int i=0; i<3; ++i) {
+	if (params[i]<m_low[i])
+		params[i] = m_low[i];
+	if (params[i]>m_high[i])
+		params[i] = m_high[i];
+	}
+}
+
+
+bool KingFit::Derivatives(const double* rhos, const double* values, const double* weights, int count,
+                          const double* params, double grad[3], double hess[3][3]) const
+{
+/// Central differences, one sided on the limits
+double lo[3][6], hi[3][6], step[3];
+for (int j=0; j<3; ++j) {
+	for (int k=0; k<6; ++k)
+		lo[j][k] = hi[j][k] = params[k];
+	double h = 1e-6*(fabs(params[j])>1e-3 ? fabs(params[j]) : 1e-3);
+	hi[j][j] = params[j]+h<=m_high[j] ? params[j]+h : params[j];
+	lo[j][j] = params[j]-h>=m_low[j] ? params[j]-h : params[j];
+	step[j] = hi[j][j]-lo[j][j];
+	if (step[j]<=0)
+		return false;
+	}
+for (int j=0; j<3; ++j) {
+	grad[j] = 0;
+	for (int k=0; k<3; ++k)
+		hess[j][k] = 0;
+	}
+for (int i=0; i<count; ++i) {
+	double w = m_statistic==LeastSquares ? (weights ? weights[i] : 1.0) : 1.0;
+	if (w<=0)
+		continue;
+	double m = Model(rhos[i], params);
+	double dm[3];
+	for (int j=0; j<3; ++j)
+		dm[j] = (Model(rhos[i], hi[j])-Model(rhos[i], lo[j]))/step[j];
+	double r, c;
+	if (m_statistic==LeastSquares) {
+		r = -2*w*(values[i]-m);
+		c = 2*w;
+		}
+	else {
+		if (m<=0)
+			continue;
+		r = 2*(1.0-values[i]/m);
+		c = 2/m;
+		}
+	for (int j=0; j<3; ++j) {
+		grad[j] += r*dm[j];
+		for (int k=0; k<3; ++k)
+			hess[j][k] += c*dm[j]*dm[k];
+		}
+	}
+return true;
+}
+
+
+bool KingFit::Stationary(const double* params, const double grad[3], const double hess[3][3], double dev) const
+{
+/// The parameters on a limit, with the descent direction out of it, are left out
+bool free[3];
+for (int j=0; j<3; ++j)
+	free[j] = !((params[j]<=m_low[j] && grad[j]>0) || (params[j]>=m_high[j] && grad[j]<0));
+double a[3][3], b[3], delta[3];
+for (int j=0; j<3; ++j) {
+	for (int k=0; k<3; ++k)
+		a[j][k] = free[j] && free[k] ? hess[j][k] : (j==k ? 1.0 : 0.0);
+	b[j] = free[j] ? grad[j] : 0;
+	}
+double g[3] = { b[0], b[1], b[2] };
+if (!Solve3(a, b, delta))
+	return false;
+double decrement = 0;
+for (int j=0; j<3; ++j)
+	decrement += g[j]*delta[j];
+return decrement>=0 && decrement<=c_gradTolerance*(fabs(dev)+1);
+}
+
+
+KingFitResult KingFit::Fit(const double* rhos, const double* values, const double* weights, int count, double* params) const
+{
+KingFitResult result;
+result.iterations = 0;
+result.converged = false;
+
+Clamp(params);
+double dev = Deviance(rhos, values, weights, count, params);
+double lambda = 1e-3;
+double grad[3], hess[3][3];
+for (int iter=0; iter<m_maxIterations && dev<c_huge; ++iter) {
+	result.iterations = iter+1;
+	if (!Derivatives(rhos, values, weights, count, params, grad, hess))
+		break;
+	bool accepted = false;
+	double newDev = dev;
+	while (lambda<1e12) {
+		double a[3][3], b[3], delta[3];
+		for (int j=0; j<3; ++j) {
+			for (int k=0; k<3; ++k)
+				a[j][k] = hess[j][k];
+			a[j][j] *= 1.0+lambda;
+			if (a[j][j]==0)
+				a[j][j] = lambda;
+			b[j] = -grad[j];
+			}
+		if (Solve3(a, b, delta)) {
+			double trial[6];
+			for (int k=0; k<6; ++k)
+				trial[k] = params[k];
+			for (int j=0; j<3; ++j)
+				trial[j] += delta[j];
+			Clamp(trial);
+			newDev = Deviance(rhos, values, weights, count, trial);
+			if (newDev<dev) {
+				for (int j=0; j<3; ++j)
+					params[j] = trial[j];
+				accepted = true;
+				lambda = lambda>1e-12 ? lambda/10 : lambda;
+				break;
+				}
+			}
+		lambda *= 10;
+		}
+	/// No step lowers the deviance: it is a minimum only if the gradient vanishes
+	if (!accepted) {
+		result.converged = Stationary(params, grad, hess, dev);
+		break;
+		}
+	double change = dev-newDev;
+	dev = newDev;
+	if (change<=m_tolerance*(fabs(dev)+m_tolerance)) {
+		result.converged = true;
+		break;
+		}
+	}
+
+/// The errors come from the covariance, twice the inverse of the hessian of the deviance
+double err[3] = { 0, 0, 0 };
+if (Derivatives(rhos, values, weights, count, params, grad, hess)) {
+	for (int j=0; j<3; ++j) {
+		double a[3][3], b[3] = { 0, 0, 0 }, col[3];
+		for (int r=0; r<3; ++r)
+			for (int k=0; k<3; ++k)
+				a[r][k] = hess[r][k];
+		b[j] = 1;
+		if (Solve3(a, b, col) && col[j]>0)
+			err[j] = sqrt(2*col[j]);
+		}
+	}
+
+int points = 0;
+for (int i=0; i<count; ++i)
+	if (m_statistic==Poisson || !weights || weights[i]>0)
+		++points;
+
+result.norm = params[0];
+result.normErr = err[0];
+result.ang = params[1];
+result.angErr = err[1];
+result.gamma = params[2];
+result.gammaErr = err[2];
+result.chi2 = dev;
+result.ndf = points>3 ? points-3 : 0;
+return result;
+}
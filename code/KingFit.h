@@ -0,0 +1,84 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _KINGFIT_H
+#define _KINGFIT_H
+
+
+/// The result of a fit of the King profile
+struct KingFitResult {
+	double norm, normErr;
+	double ang, angErr;
+	double gamma, gammaErr;
+	double chi2;
+	int    ndf;
+	int    iterations;
+	bool   converged;
+};
+
+
+/// Fit of the double King profile of the PSF,
+/// norm*K(rho; ang, gamma) + norm2*K(rho; ang2, gamma2), with
+/// K(rho; s, g) = (1-1/g) (1 + rho^2/(2 g s^2))^-g. The first component is
+/// fitted within box limits with a Levenberg-Marquardt minimization, the
+/// second one is fixed. The model can be multiplied by coeff*sin(rho), for
+/// counts binned in rings of constant width. No ROOT object is involved, so
+/// a KingFit can be used by many threads at once.
+/// \brief Headless least squares or Poisson fit of the King profile
+class KingFit {
+
+public:
+	enum Statistic { LeastSquares, Poisson };
+
+	KingFit(Statistic statistic=LeastSquares, double coeff=1.0, bool ring=false);
+
+	/// Limits of the fitted parameters: 0 norm, 1 ang, 2 gamma.
+	void SetLimits(int par, double low, double high);
+
+	/// The King function normalized to 1 in rho=0.
+	static double King(double rho, double ang, double gamma);
+
+	/// The model in rho (degrees), with params norm, ang, gamma, norm2, ang2, gamma2.
+	double Model(double rho, const double* params) const;
+
+	/// The chi square of a least squares fit, or -2 log of the Poisson
+	/// likelihood ratio. Points with weight 0 are ignored.
+	double Deviance(const double* rhos, const double* values, const double* weights, int count, const double* params) const;
+
+	/// Fit the first King component.
+	/// \param[in] rhos The angular distances in degrees.
+	/// \param[in] values The profile values, or the counts for a Poisson fit.
+	/// \param[in] weights The least squares weights, 0 for all equal to 1.
+	/// \param[in,out] params The six parameters of the model: the starting
+	/// values of the first three, the fixed values of the others.
+	KingFitResult Fit(const double* rhos, const double* values, const double* weights, int count, double* params) const;
+
+private:
+	void Clamp(double* params) const;
+	/// The gradient and the Gauss-Newton approximation of the hessian of the deviance
+	bool Derivatives(const double* rhos, const double* values, const double* weights, int count,
+	                 const double* params, double grad[3], double hess[3][3]) const;
+	/// True if the gradient, projected on the limits, is null within the tolerance
+	bool Stationary(const double* params, const double grad[3], const double hess[3][3], double dev) const;
+
+	Statistic m_statistic;
+	double    m_coeff;
+	bool      m_ring;
+	double    m_low[3];
+	double    m_high[3];
+	int       m_maxIterations;
+	double    m_tolerance;
+};
+
+#endif
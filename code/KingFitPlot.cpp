@@ -0,0 +1,53 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "TCanvas.h"
+#include "TH1F.h"
+#include "TF1.h"
+
+#include "KingFitPlot.h"
+
+
+void KingFitPlot::Plot(const char* fileName, const char* title, const KingFit& fit, const double* params,
+                       const double* rhos, const double* values, int count, double binWidth,
+                       double minFraction)
+{
+if (count<1)
+	return;
+double xmin = rhos[0]-binWidth/2;
+double xmax = rhos[count-1]+binWidth/2;
+TCanvas c0("", "");
+c0.SetFillColor(kWhite);
+c0.SetBottomMargin(0.2);
+TH1D hist("kingprofile", title, count, xmin, xmax);
+hist.SetDirectory(0);
+double maxValue = 0;
+for (int i=0; i<count; ++i) {
+	hist.SetBinContent(i+1, values[i]);
+	if (values[i]>maxValue)
+		maxValue = values[i];
+	}
+int last = count;
+while (last>1 && values[last-1]<=minFraction*maxValue)
+	--last;
+hist.GetXaxis()->SetRange(1, last);
+hist.GetXaxis()->SetLabelSize(0.06);
+hist.GetYaxis()->SetLabelSize(0.06);
+hist.GetXaxis()->SetTitleSize(0.06);
+hist.GetYaxis()->SetTitleSize(0.06);
+hist.Draw("HIST");
+TF1 model("kingmodel", [&fit, params](double* x, double*) { return fit.Model(x[0], params); }, xmin, xmax, 0);
+model.Draw("SAME");
+c0.Print(fileName);
+}
@@ -0,0 +1,36 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _KINGFITPLOT_H
+#define _KINGFITPLOT_H
+
+#include "KingFit.h"
+
+
+/// Plots of the fitted PSF profiles, drawn with ROOT after the fits as a
+/// separate post processing step. ROOT graphics are not thread safe, so
+/// the plots are never drawn by the fitting threads.
+/// \brief EPS plot of a profile and of its King model
+class KingFitPlot {
+
+public:
+	/// Draw the profile as a histogram of bins of width binWidth centered in
+	/// rhos, together with the model, and print the canvas in fileName.
+	/// The range ends at the last bin above minFraction of the maximum.
+	static void Plot(const char* fileName, const char* title, const KingFit& fit, const double* params,
+	                 const double* rhos, const double* values, int count, double binWidth,
+	                 double minFraction=0.05);
+};
+
+#endif
@@ -0,0 +1,85 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fitsio.h>
+
+#include "KingFitTable.h"
+
+
+void KingFitTable::Reserve(int rows)
+{
+m_energy.reserve(rows);
+m_theta.reserve(rows);
+m_phi.reserve(rows);
+m_norm.reserve(rows);
+m_normErr.reserve(rows);
+m_ang.reserve(rows);
+m_angErr.reserve(rows);
+m_gamma.reserve(rows);
+m_gammaErr.reserve(rows);
+m_chi2.reserve(rows);
+m_ndf.reserve(rows);
+}
+
+
+void KingFitTable::Append(float energy, float theta, float phi, const KingFitResult& result)
+{
+Append(energy, theta, phi, result.norm, result.normErr, result.ang, result.angErr,
+       result.gamma, result.gammaErr, result.chi2, result.ndf);
+}
+
+
+void KingFitTable::Append(float energy, float theta, float phi, float norm, float normErr,
+                          float ang, float angErr, float gamma, float gammaErr, float chi2, int ndf)
+{
+m_energy.push_back(energy);
+m_theta.push_back(theta);
+m_phi.push_back(phi);
+m_norm.push_back(norm);
+m_normErr.push_back(normErr);
+m_ang.push_back(ang);
+m_angErr.push_back(angErr);
+m_gamma.push_back(gamma);
+m_gammaErr.push_back(gammaErr);
+m_chi2.push_back(chi2);
+m_ndf.push_back(ndf);
+}
+
+
+int KingFitTable::Write(const char* fileName, const char* extName) const
+{
+const int tfields = 11;
+const char* ttype[tfields] = { "ENERGY", "THETA", "PHI", "NORM", "NORM_ERR", "ANG", "ANG_ERR",
+                               "GAMMA", "GAMMA_ERR", "CHI2", "NDF" };
+const char* tform[tfields] = { "1E", "1E", "1E", "1E", "1E", "1E", "1E", "1E", "1E", "1E", "1J" };
+const char* tunit[tfields] = { "MeV", "degrees", "degrees", "degrees^-1", "degrees^-1", "degrees", "degrees",
+                               "", "", "", "" };
+
+int status = 0;
+fitsfile* fp;
+if (fits_create_file(&fp, fileName, &status))
+	return status;
+fits_create_tbl(fp, BINARY_TBL, 0, tfields, (char**)ttype, (char**)tform, (char**)tunit, extName, &status);
+long rows = m_energy.size();
+if (rows) {
+	const std::vector<float>* columns[tfields-1] = { &m_energy, &m_theta, &m_phi, &m_norm, &m_normErr,
+	                                                 &m_ang, &m_angErr, &m_gamma, &m_gammaErr, &m_chi2 };
+	for (int col=0; col<tfields-1; ++col)
+		fits_write_col(fp, TFLOAT, col+1, 1, 1, rows, (void*)&(*columns[col])[0], &status);
+	fits_write_col(fp, TINT, tfields, 1, 1, rows, (void*)&m_ndf[0], &status);
+	}
+int closeStatus = 0;
+fits_close_file(fp, &closeStatus);
+return status ? status : closeStatus;
+}
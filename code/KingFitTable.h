@@ -0,0 +1,56 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _KINGFITTABLE_H
+#define _KINGFITTABLE_H
+
+#include <vector>
+
+#include "KingFit.h"
+
+
+/// The King parameters fitted on a grid of (energy, theta, phi), kept by
+/// columns and written as the PSDPARAMS binary table read by AG_createpsd,
+/// with one fits_write_col for each column.
+/// \brief Columnar buffer of the PSF fit results
+class KingFitTable {
+
+public:
+	KingFitTable() {}
+
+	void Reserve(int rows);
+	void Append(float energy, float theta, float phi, const KingFitResult& result);
+	void Append(float energy, float theta, float phi, float norm, float normErr,
+	            float ang, float angErr, float gamma, float gammaErr, float chi2, int ndf);
+	int Size() const { return m_energy.size(); }
+
+	/// Write the table in a new FITS file.
+	/// \return the cfitsio status, 0 on success.
+	int Write(const char* fileName, const char* extName="PSDPARAMS") const;
+
+private:
+	std::vector<float> m_energy;
+	std::vector<float> m_theta;
+	std::vector<float> m_phi;
+	std::vector<float> m_norm;
+	std::vector<float> m_normErr;
+	std::vector<float> m_ang;
+	std::vector<float> m_angErr;
+	std::vector<float> m_gamma;
+	std::vector<float> m_gammaErr;
+	std::vector<float> m_chi2;
+	std::vector<int>   m_ndf;
+};
+
+#endif
@@ -0,0 +1,512 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fitsio.h"
+#include "MapCube.h"
+
+using std::cerr;
+using std::endl;
+
+static const char     c_magic[8] = { 'A', 'G', 'M', 'C', 'U', 'B', 'E', 0 };
+static const uint32_t c_version = 1;
+static const uint64_t c_align = 4096;
+
+
+static uint64_t AlignUp(uint64_t n)
+{
+return (n+c_align-1)/c_align*c_align;
+}
+
+static int FitsDataType(MapCubeType type)
+{
+if (type==CubeInt32)
+	return TINT;
+if (type==CubeFloat32)
+	return TFLOAT;
+return TDOUBLE;
+}
+
+static int FitsBitpix(MapCubeType type)
+{
+if (type==CubeInt32)
+	return LONG_IMG;
+if (type==CubeFloat32)
+	return FLOAT_IMG;
+return DOUBLE_IMG;
+}
+
+static double ReadKey(fitsfile* f, const char* key, double defVal)
+{
+int status = 0;
+double val = defVal;
+fits_read_key(f, TDOUBLE, key, &val, 0, &status);
+return status ? defVal : val;
+}
+
+static void ReadKey(fitsfile* f, const char* key, char* dest, size_t size)
+{
+int status = 0;
+char val[FLEN_VALUE] = "";
+fits_read_key(f, TSTRING, key, val, 0, &status);
+strncpy(dest, status ? "" : val, size-1);
+dest[size-1] = 0;
+}
+
+
+/// Convert the pixels read as double into int32, failing if a pixel is not
+/// an integer in the int32 range, so that the counts are never truncated
+static bool ToInt32(const std::vector<double>& src, std::vector<unsigned char>& buffer)
+{
+int32_t* dest = reinterpret_cast<int32_t*>(&buffer[0]);
+for (size_t k=0; k<src.size(); ++k) {
+	double v = src[k];
+	if (!(v>=-2147483648.0 && v<=2147483647.0) || v!=floor(v))
+		return false;
+	dest[k] = int32_t(v);
+	}
+return true;
+}
+
+/// Read the image of a FITS file into a typed buffer, checking the size
+static bool ReadPlane(const char* fileName, MapCubeType type, long rows, long cols, std::vector<unsigned char>& buffer, fitsfile** keep=0)
+{
+fitsfile* f;
+int status = 0;
+if (fits_open_file(&f, fileName, READONLY, &status)) {
+	cerr << "ERROR " << status << " opening " << fileName << endl;
+	return false;
+	}
+long naxes[2] = { 0, 0 };
+int naxis = 0;
+fits_get_img_dim(f, &naxis, &status);
+fits_get_img_size(f, 2, naxes, &status);
+if (status || naxis!=2 || naxes[0]!=cols || naxes[1]!=rows) {
+	cerr << "ERROR: " << fileName << " is not a " << cols << "x" << rows << " image" << endl;
+	fits_close_file(f, &status);
+	return false;
+	}
+long npixels = rows*cols;
+buffer.resize(npixels*MapCube::TypeSize(type));
+int anynul = 0;
+if (type==CubeInt32) {
+	std::vector<double> values(npixels);
+	fits_read_img(f, TDOUBLE, 1, npixels, 0, &values[0], &anynul, &status);
+	if (!status && !ToInt32(values, buffer)) {
+		cerr << "ERROR: " << fileName << " has pixels that are not integer, use the float32 or float64 type" << endl;
+		fits_close_file(f, &status);
+		return false;
+		}
+	}
+else
+	fits_read_img(f, FitsDataType(type), 1, npixels, 0, &buffer[0], &anynul, &status);
+if (status) {
+	cerr << "ERROR " << status << " reading " << fileName << endl;
+	fits_close_file(f, &status);
+	return false;
+	}
+if (keep)
+	*keep = f;
+else
+	fits_close_file(f, &status);
+return true;
+}
+
+
+/// Check that the tables, the planes and the header cards described by
+/// the header lie inside a file of the given size
+static bool IsConsistent(const MapCubeHeader& header, const char* base, uint64_t size)
+{
+if (!header.count || !header.rows || !header.cols
+    || header.types[CubeCts]==CubeNone || header.types[CubeExp]==CubeNone
+    || header.infoOffset<sizeof(MapCubeHeader) || header.infoOffset>size
+    || header.count>(size-header.infoOffset)/sizeof(MapCubeInfo)
+    || header.dataOffset<header.infoOffset+header.count*sizeof(MapCubeInfo)
+    || header.dataOffset>size || header.dataOffset%sizeof(double)
+    || !header.mapStride || header.mapStride%sizeof(double)
+    || header.count>(size-header.dataOffset)/header.mapStride
+    || header.cardsOffset<header.dataOffset+header.count*header.mapStride
+    || header.cardsOffset>size)
+	return false;
+for (int p=0; p<CubePlanes; ++p) {
+	if (header.types[p]>CubeFloat64)
+		return false;
+	uint64_t planeSize = uint64_t(header.rows)*header.cols*MapCube::TypeSize(MapCubeType(header.types[p]));
+	if (header.planeOffset[p]>header.mapStride || planeSize>header.mapStride-header.planeOffset[p]
+	    || header.planeOffset[p]%sizeof(double))
+		return false;
+	}
+const MapCubeInfo* info = reinterpret_cast<const MapCubeInfo*>(base+header.infoOffset);
+for (uint32_t i=0; i<header.count; ++i)
+	if (info[i].cardOffset<header.cardsOffset || info[i].cardOffset>size
+	    || info[i].cardCount>(size-info[i].cardOffset)/80)
+		return false;
+return true;
+}
+
+
+MapCube::MapCube(): m_base(0), m_size(0), m_header(0), m_info(0)
+{
+}
+
+MapCube::~MapCube()
+{
+Close();
+}
+
+
+int MapCube::TypeSize(MapCubeType type)
+{
+if (type==CubeInt32 || type==CubeFloat32)
+	return 4;
+if (type==CubeFloat64)
+	return 8;
+return 0;
+}
+
+MapCubeType MapCube::TypeFromString(const char* name)
+{
+std::string s(name ? name : "");
+if (s=="int32" || s=="int")
+	return CubeInt32;
+if (s=="float32" || s=="float")
+	return CubeFloat32;
+if (s=="float64" || s=="double")
+	return CubeFloat64;
+return CubeNone;
+}
+
+const char* MapCube::TypeName(MapCubeType type)
+{
+if (type==CubeInt32)
+	return "int32";
+if (type==CubeFloat32)
+	return "float32";
+if (type==CubeFloat64)
+	return "float64";
+return "none";
+}
+
+
+bool MapCube::Build(const MapList& maplist, const char* fileName, MapCubeType ctsType, MapCubeType expType, MapCubeType gasType)
+{
+int count = maplist.Count();
+if (!count || ctsType==CubeNone || expType==CubeNone) {
+	cerr << "ERROR: nothing to convert into " << fileName << endl;
+	return false;
+	}
+
+/// Skip the gas plane when the list has no gas maps
+if (gasType!=CubeNone)
+	for (int i=0; i<count; ++i)
+		if (!maplist.GasName(i) || !*maplist.GasName(i)) {
+			cerr << "WARNING: no gas map in the line " << i+1 << " of the list, the gas plane is skipped" << endl;
+			gasType = CubeNone;
+			break;
+			}
+
+/// The size of the first counts map is the size of the cube
+long rows = 0, cols = 0;
+{
+	fitsfile* f;
+	int status = 0;
+	long naxes[2] = { 0, 0 };
+	fits_open_file(&f, maplist.CtsName(0), READONLY, &status);
+	fits_get_img_size(f, 2, naxes, &status);
+	if (status) {
+		cerr << "ERROR " << status << " opening " << maplist.CtsName(0) << endl;
+		return false;
+		}
+	fits_close_file(f, &status);
+	cols = naxes[0];
+	rows = naxes[1];
+}
+
+MapCubeHeader header;
+memset(&header, 0, sizeof(header));
+memcpy(header.magic, c_magic, sizeof(c_magic));
+header.version = c_version;
+header.count = count;
+header.rows = rows;
+header.cols = cols;
+header.types[CubeCts] = ctsType;
+header.types[CubeExp] = expType;
+header.types[CubeGas] = gasType;
+header.align = c_align;
+header.infoOffset = sizeof(MapCubeHeader);
+header.dataOffset = AlignUp(header.infoOffset + count*sizeof(MapCubeInfo));
+uint64_t offset = 0;
+for (int p=0; p<CubePlanes; ++p) {
+	header.planeOffset[p] = offset;
+	offset += AlignUp(uint64_t(rows)*cols*TypeSize(MapCubeType(header.types[p])));
+	}
+header.mapStride = offset;
+header.cardsOffset = header.dataOffset + count*header.mapStride;
+
+FILE* out = fopen(fileName, "wb");
+if (!out) {
+	cerr << "ERROR creating " << fileName << endl;
+	return false;
+	}
+
+std::vector<MapCubeInfo> info(count);
+std::vector<char> cards;
+std::vector<unsigned char> buffer;
+bool ok = true;
+for (int i=0; i<count && ok; ++i) {
+	MapCubeInfo& mi = info[i];
+	memset(&mi, 0, sizeof(mi));
+	const char* names[CubePlanes] = { maplist.CtsName(i), maplist.ExpName(i), maplist.GasName(i) };
+	for (int p=0; p<CubePlanes && ok; ++p) {
+		MapCubeType type = MapCubeType(header.types[p]);
+		if (type==CubeNone)
+			continue;
+		fitsfile* f = 0;
+		ok = ReadPlane(names[p], type, rows, cols, buffer, p==CubeCts ? &f : 0);
+		if (!ok)
+			break;
+		if (f) {
+			/// Keep the whole primary header of the counts map
+			int status = 0;
+			int nkeys = 0;
+			fits_get_hdrspace(f, &nkeys, 0, &status);
+			mi.cardOffset = header.cardsOffset + cards.size();
+			mi.cardCount = nkeys;
+			for (int k=1; k<=nkeys && !status; ++k) {
+				char card[FLEN_CARD];
+				memset(card, ' ', sizeof(card));
+				fits_read_record(f, k, card, &status);
+				size_t len = strlen(card);
+				if (len<80)
+					memset(card+len, ' ', 80-len);
+				cards.insert(cards.end(), card, card+80);
+				}
+			mi.crval1 = ReadKey(f, "CRVAL1", 0);
+			mi.crval2 = ReadKey(f, "CRVAL2", 0);
+			mi.crpix1 = ReadKey(f, "CRPIX1", 0);
+			mi.crpix2 = ReadKey(f, "CRPIX2", 0);
+			mi.cdelt1 = ReadKey(f, "CDELT1", 0);
+			mi.cdelt2 = ReadKey(f, "CDELT2", 0);
+			mi.lonpole = ReadKey(f, "LONPOLE", 180);
+			mi.emin = ReadKey(f, "MINENG", 0);
+			mi.emax = ReadKey(f, "MAXENG", 0);
+			mi.fovmin = ReadKey(f, "FOVMIN", 0);
+			mi.fovmax = ReadKey(f, "FOV", 0);
+			mi.tstart = ReadKey(f, "TSTART", 0);
+			mi.tstop = ReadKey(f, "TSTOP", 0);
+			mi.albedo = ReadKey(f, "ALBEDO", 0);
+			mi.phasecode = ReadKey(f, "PHASECOD", 0);
+			ReadKey(f, "CTYPE1", mi.ctype1, sizeof(mi.ctype1));
+			ReadKey(f, "CTYPE2", mi.ctype2, sizeof(mi.ctype2));
+			fits_close_file(f, &status);
+			if (status) {
+				cerr << "ERROR " << status << " reading the header of " << names[p] << endl;
+				ok = false;
+				break;
+				}
+			}
+		off_t pos = header.dataOffset + i*header.mapStride + header.planeOffset[p];
+		if (fseeko(out, pos, SEEK_SET) || fwrite(&buffer[0], 1, buffer.size(), out)!=buffer.size()) {
+			cerr << "ERROR writing " << fileName << endl;
+			ok = false;
+			}
+		}
+	}
+
+if (ok) {
+	if (fseeko(out, header.cardsOffset, SEEK_SET)
+	    || (cards.size() && fwrite(&cards[0], 1, cards.size(), out)!=cards.size())
+	    || fseeko(out, 0, SEEK_SET)
+	    || fwrite(&header, sizeof(header), 1, out)!=1
+	    || fwrite(&info[0], sizeof(MapCubeInfo), count, out)!=size_t(count)) {
+		cerr << "ERROR writing " << fileName << endl;
+		ok = false;
+		}
+	}
+if (fclose(out))
+	ok = false;
+if (!ok)
+	remove(fileName);
+return ok;
+}
+
+
+bool MapCube::Open(const char* fileName)
+{
+Close();
+int fd = open(fileName, O_RDONLY);
+if (fd<0) {
+	cerr << "ERROR opening " << fileName << endl;
+	return false;
+	}
+struct stat st;
+if (fstat(fd, &st) || size_t(st.st_size)<sizeof(MapCubeHeader)) {
+	cerr << "ERROR: " << fileName << " is not a map cube" << endl;
+	close(fd);
+	return false;
+	}
+void* base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+close(fd);
+if (base==MAP_FAILED) {
+	cerr << "ERROR mapping " << fileName << " in memory" << endl;
+	return false;
+	}
+const MapCubeHeader* header = static_cast<const MapCubeHeader*>(base);
+if (memcmp(header->magic, c_magic, sizeof(c_magic)) || header->version!=c_version
+    || !IsConsistent(*header, static_cast<const char*>(base), st.st_size)) {
+	cerr << "ERROR: " << fileName << " is not a valid map cube" << endl;
+	munmap(base, st.st_size);
+	return false;
+	}
+/// The accesses to the pixels follow the ROI and not the file order
+madvise(base, st.st_size, MADV_RANDOM);
+
+m_base = base;
+m_size = st.st_size;
+m_header = header;
+m_info = reinterpret_cast<const MapCubeInfo*>(static_cast<const char*>(base)+header->infoOffset);
+m_fileName = fileName;
+return true;
+}
+
+bool MapCube::IsCube(const char* fileName)
+{
+FILE* f = fopen(fileName, "rb");
+if (!f)
+	return false;
+char magic[sizeof(c_magic)];
+bool isCube = fread(magic, 1, sizeof(magic), f)==sizeof(magic) && !memcmp(magic, c_magic, sizeof(c_magic));
+fclose(f);
+return isCube;
+}
+
+void MapCube::Close()
+{
+if (m_base)
+	munmap(m_base, m_size);
+m_base = 0;
+m_size = 0;
+m_header = 0;
+m_info = 0;
+m_fileName.clear();
+}
+
+
+const char* MapCube::Card(int i, int k) const
+{
+return static_cast<const char*>(m_base) + m_info[i].cardOffset + 80*k;
+}
+
+const unsigned char* MapCube::PlaneBase(MapCubePlane plane, int i) const
+{
+return static_cast<const unsigned char*>(m_base) + m_header->dataOffset + i*m_header->mapStride + m_header->planeOffset[plane];
+}
+
+const void* MapCube::Row(MapCubePlane plane, int i, int row) const
+{
+return PlaneBase(plane, i) + size_t(row)*m_header->cols*TypeSize(Type(plane));
+}
+
+double MapCube::Value(MapCubePlane plane, int i, int row, int col) const
+{
+const void* r = Row(plane, i, row);
+switch (Type(plane)) {
+	case CubeInt32:
+		return static_cast<const int32_t*>(r)[col];
+	case CubeFloat32:
+		return static_cast<const float*>(r)[col];
+	case CubeFloat64:
+		return static_cast<const double*>(r)[col];
+	default:
+		return 0;
+	}
+}
+
+bool MapCube::ReadRows(MapCubePlane plane, int i, int rowMin, int rowMax, double* dest) const
+{
+if (!m_header || !HasPlane(plane) || i<0 || i>=Count() || rowMin<0 || rowMax>=Rows() || rowMin>rowMax)
+	return false;
+size_t n = size_t(rowMax-rowMin+1)*m_header->cols;
+const void* src = Row(plane, i, rowMin);
+switch (Type(plane)) {
+	case CubeInt32:
+		for (size_t k=0; k<n; ++k)
+			dest[k] = static_cast<const int32_t*>(src)[k];
+		break;
+	case CubeFloat32:
+		for (size_t k=0; k<n; ++k)
+			dest[k] = static_cast<const float*>(src)[k];
+		break;
+	default:
+		memcpy(dest, src, n*sizeof(double));
+	}
+return true;
+}
+
+void MapCube::WillNeed(int i, int rowMin, int rowMax) const
+{
+if (!m_header || rowMin>rowMax)
+	return;
+uintptr_t page = sysconf(_SC_PAGESIZE);
+for (int p=0; p<CubePlanes; ++p) {
+	if (!HasPlane(MapCubePlane(p)))
+		continue;
+	uintptr_t begin = reinterpret_cast<uintptr_t>(Row(MapCubePlane(p), i, rowMin));
+	uintptr_t end = reinterpret_cast<uintptr_t>(Row(MapCubePlane(p), i, rowMax)) + m_header->cols*TypeSize(Type(MapCubePlane(p)));
+	begin = begin/page*page;
+	madvise(reinterpret_cast<void*>(begin), end-begin, MADV_WILLNEED);
+	}
+}
+
+
+int MapCube::WriteMap(MapCubePlane plane, int i, const char* fileName) const
+{
+if (!m_header || !HasPlane(plane) || i<0 || i>=Count())
+	return BAD_DIMEN;
+std::string name("!");
+name += fileName;
+fitsfile* f;
+int status = 0;
+long naxes[2] = { long(m_header->cols), long(m_header->rows) };
+fits_create_file(&f, name.c_str(), &status);
+fits_create_img(f, FitsBitpix(Type(plane)), 2, naxes, &status);
+if (status)
+	return status;
+for (uint32_t k=0; k<m_info[i].cardCount && !status; ++k) {
+	char card[FLEN_CARD];
+	memcpy(card, Card(i, k), 80);
+	card[80] = 0;
+	/// Structural and checksum keywords are written by cfitsio itself
+	int keyClass = fits_get_keyclass(card);
+	if (keyClass==TYP_STRUC_KEY || keyClass==TYP_CMPRS_KEY || keyClass==TYP_SCAL_KEY || keyClass==TYP_CKSUM_KEY)
+		continue;
+	fits_write_record(f, card, &status);
+	}
+long npixels = long(m_header->rows)*m_header->cols;
+fits_write_img(f, FitsDataType(Type(plane)), 1, npixels, const_cast<unsigned char*>(PlaneBase(plane, i)), &status);
+int closeStatus = 0;
+fits_close_file(f, &closeStatus);
+return status ? status : closeStatus;
+}
@@ -0,0 +1,155 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _MAPCUBE_H
+#define _MAPCUBE_H
+
+#include <string>
+#include <stdint.h>
+
+#include <AlikeData5.h>
+
+
+/// The pixel type of one plane of the cube
+enum MapCubeType { CubeNone=0, CubeInt32=1, CubeFloat32=2, CubeFloat64=3 };
+
+/// The planes stored for each map of the list
+enum MapCubePlane { CubeCts=0, CubeExp=1, CubeGas=2, CubePlanes=3 };
+
+
+/// The fixed size header at the beginning of a cube file
+struct MapCubeHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t types[CubePlanes];
+	uint32_t align;
+	uint64_t infoOffset;
+	uint64_t cardsOffset;
+	uint64_t dataOffset;
+	uint64_t planeOffset[CubePlanes];
+	uint64_t mapStride;
+};
+
+/// The metadata of one map of the list. The complete primary header of
+/// the cts map is kept as FITS cards, the WCS keywords are also decoded
+/// here for a fast access.
+struct MapCubeInfo {
+	uint64_t cardOffset;
+	uint32_t cardCount;
+	uint32_t reserved;
+	double   crval1, crval2;
+	double   crpix1, crpix2;
+	double   cdelt1, cdelt2;
+	double   lonpole;
+	double   emin, emax;
+	double   fovmin, fovmax;
+	double   tstart, tstop;
+	double   albedo;
+	double   phasecode;
+	char     ctype1[16];
+	char     ctype2[16];
+};
+
+
+/// A map list converted once into an uncompressed, page aligned binary
+/// cube and then memory mapped. Only the rows actually accessed are paged
+/// in by the operating system, so very long map lists can be analysed
+/// without keeping all the maps in memory as double arrays.
+/// \brief Memory mapped stack of the cts, exp and gas maps of a map list
+class MapCube {
+
+public:
+	MapCube();
+	~MapCube();
+
+	/// Convert the maps of a map list into a cube file. The maps are read
+	/// one at a time, so the memory needed is the one of a single map.
+	/// \param[in] maplist The map list, all the maps must have the same size.
+	/// \param[in] fileName The name of the cube file to create.
+	/// \param[in] ctsType The pixel type of the counts planes. With int32 the
+	/// conversion fails if a counts map has pixels that are not integer.
+	/// \param[in] expType The pixel type of the exposure planes.
+	/// \param[in] gasType The pixel type of the gas planes, CubeNone to skip them.
+	/// The gas planes are also skipped when the list has no gas maps.
+	/// \return true on success.
+	static bool Build(const MapList& maplist, const char* fileName,
+	                  MapCubeType ctsType=CubeInt32, MapCubeType expType=CubeFloat32,
+	                  MapCubeType gasType=CubeNone);
+
+	/// Map a cube file in memory. The offsets of the header are checked
+	/// against the size of the file.
+	/// \return true on success.
+	bool Open(const char* fileName);
+
+	/// \return true if the file starts as a cube file, without any message.
+	static bool IsCube(const char* fileName);
+	void Close();
+	bool IsOpen() const { return m_base!=0; }
+
+	int Count() const { return m_header ? int(m_header->count) : 0; }
+	int Rows() const { return m_header ? int(m_header->rows) : 0; }
+	int Cols() const { return m_header ? int(m_header->cols) : 0; }
+	bool HasPlane(MapCubePlane plane) const { return m_header && m_header->types[plane]!=CubeNone; }
+	MapCubeType Type(MapCubePlane plane) const { return m_header ? MapCubeType(m_header->types[plane]) : CubeNone; }
+
+	/// The metadata of the i-th map.
+	const MapCubeInfo& Info(int i) const { return m_info[i]; }
+
+	/// The k-th header card (80 characters, not null terminated) of the i-th map.
+	const char* Card(int i, int k) const;
+
+	/// A pointer to the first pixel of a row, of the type given by Type(plane).
+	/// Rows and columns follow the FITS order (NAXIS2, NAXIS1).
+	const void* Row(MapCubePlane plane, int i, int row) const;
+
+	/// The value of a pixel converted to double.
+	double Value(MapCubePlane plane, int i, int row, int col) const;
+	double Cts(int i, int row, int col) const { return Value(CubeCts, i, row, col); }
+	double Exp(int i, int row, int col) const { return Value(CubeExp, i, row, col); }
+	double Gas(int i, int row, int col) const { return Value(CubeGas, i, row, col); }
+
+	/// Copy the rows [rowMin, rowMax] of a plane into a double buffer of
+	/// (rowMax-rowMin+1)*Cols() elements.
+	bool ReadRows(MapCubePlane plane, int i, int rowMin, int rowMax, double* dest) const;
+
+	/// Hint the operating system that the rows [rowMin, rowMax] of all the
+	/// planes of the i-th map will be accessed soon, e.g. the rows of a ROI.
+	void WillNeed(int i, int rowMin, int rowMax) const;
+
+	/// Write one plane of the i-th map as a FITS image, restoring the
+	/// original header keywords.
+	/// \return the cfitsio status, 0 on success.
+	int WriteMap(MapCubePlane plane, int i, const char* fileName) const;
+
+	static int TypeSize(MapCubeType type);
+	static MapCubeType TypeFromString(const char* name);
+	static const char* TypeName(MapCubeType type);
+
+private:
+	MapCube(const MapCube&);
+	MapCube& operator=(const MapCube&);
+
+	const unsigned char* PlaneBase(MapCubePlane plane, int i) const;
+
+	void*                m_base;
+	size_t               m_size;
+	const MapCubeHeader* m_header;
+	const MapCubeInfo*   m_info;
+	std::string          m_fileName;
+};
+
+#endif
@@ -0,0 +1,403 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+#include <fitsio.h>
+
+#include "MapStacker.h"
+
+using std::cerr;
+using std::endl;
+
+
+/// The partial sums of a pairwise tree built while the buffers arrive, as a
+/// binary counter: two partials of the same number of buffers are merged as
+/// soon as they exist, so the shape of the tree depends only on the number
+/// of buffers.
+class PairwiseSum {
+public:
+	PairwiseSum(long size): m_size(size) {}
+
+	void Push(const double* x)
+	{
+	m_partials.push_back(std::vector<double>(x, x+m_size));
+	m_counts.push_back(1);
+	while (m_counts.size()>1 && m_counts[m_counts.size()-1]==m_counts[m_counts.size()-2]) {
+		Merge();
+		}
+	}
+
+	/// Merge the remaining partials, from the smallest, into out.
+	void Finish(double* out)
+	{
+	while (m_counts.size()>1)
+		Merge();
+	if (m_partials.empty())
+		std::fill(out, out+m_size, 0.0);
+	else
+		std::copy(m_partials[0].begin(), m_partials[0].end(), out);
+	}
+
+private:
+	void Merge()
+	{
+	size_t last = m_partials.size()-1;
+	Add(m_size, &m_partials[last][0], &m_partials[last-1][0]);
+	m_counts[last-1] += m_counts[last];
+	m_partials.pop_back();
+	m_counts.pop_back();
+	}
+
+	static void Add(long n, const double* __restrict x, double* __restrict sum)
+	{
+	for (long i=0; i<n; ++i)
+		sum[i] += x[i];
+	}
+
+	long m_size;
+	std::vector<std::vector<double> > m_partials;
+	std::vector<int> m_counts;
+};
+
+
+static void ClampZero(long n, double* x)
+{
+for (long i=0; i<n; ++i)
+	if (x[i]<0)
+		x[i] = 0;
+}
+
+
+/// sum = max(0, sum + sign*x)
+static void AddClamp(long n, int sign, const double* __restrict x, double* __restrict sum)
+{
+const double s = sign;
+for (long i=0; i<n; ++i) {
+	double v = sum[i] + s*x[i];
+	sum[i] = v<0 ? 0 : v;
+	}
+}
+
+/// The same with a Kahan compensation term for each element
+static void AddClampKahan(long n, int sign, const double* __restrict x, double* __restrict sum, double* __restrict comp)
+{
+const double s = sign;
+for (long i=0; i<n; ++i) {
+	double y = s*x[i] - comp[i];
+	double t = sum[i] + y;
+	comp[i] = (t - sum[i]) - y;
+	sum[i] = t;
+	if (t<0) {
+		sum[i] = 0;
+		comp[i] = 0;
+		}
+	}
+}
+
+
+MapStacker::MapStacker(int sign, bool compensated): m_sign(sign<0 ? -1 : 1), m_compensated(compensated),
+	m_count(0), m_emin(0), m_emax(0), m_fovmin(0), m_fovmax(0), m_tstart(0), m_tstop(0)
+{
+}
+
+
+void MapStacker::Extend(const AgileMap& map)
+{
+Extend(map.GetEmin(), map.GetEmax(), map.GetFovMin(), map.GetFovMax(), map.GetTstart(), map.GetTstop());
+}
+
+void MapStacker::Extend(double emin, double emax, double fovmin, double fovmax, double tstart, double tstop)
+{
+if (!m_count) {
+	m_emin = emin;
+	m_emax = emax;
+	m_fovmin = fovmin;
+	m_fovmax = fovmax;
+	m_tstart = tstart;
+	m_tstop = tstop;
+	}
+else {
+	if (emin<m_emin)
+		m_emin = emin;
+	if (emax>m_emax)
+		m_emax = emax;
+	if (fovmin<m_fovmin)
+		m_fovmin = fovmin;
+	if (fovmax>m_fovmax)
+		m_fovmax = fovmax;
+	if (tstart<m_tstart)
+		m_tstart = tstart;
+	if (tstop>m_tstop)
+		m_tstop = tstop;
+	}
+++m_count;
+m_sum.SetEnergy(m_emin, m_emax);
+m_sum.SetFov(m_fovmin, m_fovmax);
+m_sum.SetTT(m_tstart, m_tstop);
+}
+
+
+bool MapStacker::Add(const AgileMap& map)
+{
+if (!m_count) {
+	m_sum = map;
+	if (m_compensated)
+		m_comp.assign(m_sum.Size(), 0.0);
+	}
+else {
+	if (map.Dim(0)!=m_sum.Dim(0) || map.Dim(1)!=m_sum.Dim(1))
+		return false;
+	AddBuffer(map.Buffer());
+	}
+Extend(map);
+return true;
+}
+
+void MapStacker::AddBuffer(const double* buffer)
+{
+if (m_compensated)
+	AddClampKahan(m_sum.Size(), m_sign, buffer, m_sum.Buffer(), &m_comp[0]);
+else
+	AddClamp(m_sum.Size(), m_sign, buffer, m_sum.Buffer());
+}
+
+
+bool MapStacker::Add(const MapCube& cube, MapCubePlane plane, int i)
+{
+if (!m_count) {
+	/// The header of the first map is restored through a FITS file
+	char fileName[] = "/tmp/mapstackerXXXXXX";
+	int fd = mkstemp(fileName);
+	if (fd<0)
+		return false;
+	close(fd);
+	AgileMap map;
+	bool ok = !cube.WriteMap(plane, i, fileName) && !map.Read(fileName);
+	unlink(fileName);
+	return ok && Add(map);
+	}
+if (m_sum.Size()!=long(cube.Rows())*cube.Cols())
+	return false;
+std::vector<double> buffer(m_sum.Size());
+if (!cube.ReadRows(plane, i, 0, cube.Rows()-1, &buffer[0]))
+	return false;
+AddBuffer(&buffer[0]);
+const MapCubeInfo& info = cube.Info(i);
+Extend(info.emin, info.emax, info.fovmin, info.fovmax, info.tstart, info.tstop);
+return true;
+}
+
+bool MapStacker::StackCube(const MapCube& cube, MapStacker& cts, MapStacker& exp)
+{
+for (int i=0; i<cube.Count(); ++i)
+	if (!cts.Add(cube, CubeCts, i) || !exp.Add(cube, CubeExp, i)) {
+		cerr << "Error adding the map " << i << " of the cube" << endl;
+		return false;
+		}
+return true;
+}
+
+
+/// A cts and exp pair of the list and the outcome of its reading
+struct MapPair {
+	AgileMap cts;
+	AgileMap exp;
+	int status;
+};
+
+static void ReadPair(const MapList* maplist, int i, MapPair* pair)
+{
+pair->status = pair->cts.Read(maplist->CtsName(i));
+if (!pair->status)
+	pair->status = pair->exp.Read(maplist->ExpName(i));
+}
+
+
+bool MapStacker::StackList(const MapList& maplist, MapStacker& cts, MapStacker& exp, bool prefetch)
+{
+int count = maplist.Count();
+MapPair pairs[2];
+std::thread reader;
+if (count>0) {
+	if (prefetch)
+		reader = std::thread(ReadPair, &maplist, 0, &pairs[0]);
+	else
+		ReadPair(&maplist, 0, &pairs[0]);
+	}
+bool ok = true;
+for (int i=0; i<count; ++i) {
+	MapPair& pair = pairs[i%2];
+	if (reader.joinable())
+		reader.join();
+	if (i+1<count) {
+		if (prefetch)
+			reader = std::thread(ReadPair, &maplist, i+1, &pairs[(i+1)%2]);
+		}
+	if (pair.status) {
+		cerr << "Error reading " << maplist.CtsName(i) << " or " << maplist.ExpName(i) << endl;
+		ok = false;
+		break;
+		}
+	if (!cts.Add(pair.cts) || !exp.Add(pair.exp)) {
+		cerr << "Error: the maps of " << maplist.CtsName(i) << " have a different size" << endl;
+		ok = false;
+		break;
+		}
+	if (!prefetch && i+1<count)
+		ReadPair(&maplist, i+1, &pairs[(i+1)%2]);
+	}
+if (reader.joinable())
+	reader.join();
+return ok;
+}
+
+
+static void ReadWindow(const MapList* maplist, int first, int count, MapPair* pairs, std::atomic<int>* next)
+{
+for (int k=(*next)++; k<count; k=(*next)++)
+	ReadPair(maplist, first+k, &pairs[k]);
+}
+
+
+bool MapStacker::TreeSumList(const MapList& maplist, MapStacker& cts, MapStacker& exp,
+                             int threads, double* mapsPerSecond)
+{
+std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+int count = maplist.Count();
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1 || !fits_is_reentrant())
+	threads = 1;
+if (threads>count)
+	threads = count;
+
+PairwiseSum* ctsSum = 0;
+PairwiseSum* expSum = 0;
+std::vector<MapPair> pairs(threads);
+bool ok = count>0;
+for (int first=0; first<count && ok; first+=threads) {
+	int window = std::min(threads, count-first);
+	std::atomic<int> next(0);
+	std::vector<std::thread> readers;
+	for (int t=1; t<window; ++t)
+		readers.push_back(std::thread(ReadWindow, &maplist, first, window, &pairs[0], &next));
+	ReadWindow(&maplist, first, window, &pairs[0], &next);
+	for (size_t t=0; t<readers.size(); ++t)
+		readers[t].join();
+	/// The partials are pushed in the order of the list
+	for (int k=0; k<window && ok; ++k) {
+		MapPair& pair = pairs[k];
+		int i = first+k;
+		if (pair.status) {
+			cerr << "Error reading " << maplist.CtsName(i) << " or " << maplist.ExpName(i) << endl;
+			ok = false;
+			break;
+			}
+		if (!i) {
+			cts.m_sum = pair.cts;
+			exp.m_sum = pair.exp;
+			ctsSum = new PairwiseSum(cts.m_sum.Size());
+			expSum = new PairwiseSum(exp.m_sum.Size());
+			}
+		else if (pair.cts.Dim(0)!=cts.m_sum.Dim(0) || pair.cts.Dim(1)!=cts.m_sum.Dim(1)
+		         || pair.exp.Dim(0)!=exp.m_sum.Dim(0) || pair.exp.Dim(1)!=exp.m_sum.Dim(1)) {
+			cerr << "Error: the maps of " << maplist.CtsName(i) << " have a different size" << endl;
+			ok = false;
+			break;
+			}
+		ctsSum->Push(pair.cts.Buffer());
+		expSum->Push(pair.exp.Buffer());
+		cts.Extend(pair.cts);
+		exp.Extend(pair.exp);
+		}
+	}
+if (ok) {
+	ctsSum->Finish(cts.m_sum.Buffer());
+	expSum->Finish(exp.m_sum.Buffer());
+	ClampZero(cts.m_sum.Size(), cts.m_sum.Buffer());
+	ClampZero(exp.m_sum.Size(), exp.m_sum.Buffer());
+	}
+delete ctsSum;
+delete expSum;
+if (mapsPerSecond) {
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	*mapsPerSecond = seconds>0 ? 2*count/seconds : 0;
+	}
+return ok;
+}
+
+
+static void TreeSumRange(const std::vector<const AgileMap*>* maps, long first, long last, double* out)
+{
+PairwiseSum sum(last-first);
+for (size_t i=0; i<maps->size(); ++i)
+	sum.Push((*maps)[i]->Buffer()+first);
+sum.Finish(out+first);
+}
+
+
+bool MapStacker::TreeSum(const std::vector<const AgileMap*>& maps, AgileMap& result, int threads)
+{
+if (maps.empty())
+	return false;
+MapStacker stacker;
+stacker.m_sum = *maps[0];
+if (!TreeSumPixels(maps, stacker.m_sum.Buffer(), threads))
+	return false;
+for (size_t i=0; i<maps.size(); ++i)
+	stacker.Extend(*maps[i]);
+result = stacker.m_sum;
+return true;
+}
+
+
+bool MapStacker::TreeSumPixels(const std::vector<const AgileMap*>& maps, double* out, int threads)
+{
+if (maps.empty())
+	return false;
+const AgileMap& first = *maps[0];
+for (size_t i=1; i<maps.size(); ++i)
+	if (maps[i]->Dim(0)!=first.Dim(0) || maps[i]->Dim(1)!=first.Dim(1))
+		return false;
+long size = first.Size();
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1)
+	threads = 1;
+/// Blocks of whole rows, each summed with the same tree
+long rows = first.Dim(0);
+long cols = size/(rows ? rows : 1);
+if (threads>rows)
+	threads = rows ? rows : 1;
+std::vector<std::thread> workers;
+for (int t=0; t<threads; ++t) {
+	long begin = rows*t/threads*cols;
+	long end = rows*(t+1)/threads*cols;
+	if (t==threads-1)
+		end = size;
+	if (t<threads-1)
+		workers.push_back(std::thread(TreeSumRange, &maps, begin, end, out));
+	else
+		TreeSumRange(&maps, begin, end, out);
+	}
+for (size_t t=0; t<workers.size(); ++t)
+	workers[t].join();
+return true;
+}
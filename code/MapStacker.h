@@ -0,0 +1,116 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _MAPSTACKER_H
+#define _MAPSTACKER_H
+
+#include <vector>
+
+#include <AgileMap.h>
+#include <AlikeData5.h>
+
+#include "MapCube.h"
+
+
+/// Accumulates maps of the same size into a single map, one map at a time,
+/// clamping the partial sums to zero after each map as AG_summapgen always
+/// did. The first map added provides the header of the result, the energy,
+/// field of view and time ranges are extended to cover all the maps.
+/// The compensated mode keeps a Kahan correction term for each pixel, for
+/// the exposures of long map lists.
+/// The sums can also be done with a pairwise tree, always with the same
+/// shape for a given number of maps, so that the result does not depend
+/// on the number of threads used to read and add the maps. In the tree
+/// the partial sums are not clamped, only the result is, so it is used
+/// for the sums of non negative maps.
+/// \brief Streaming sum of maps
+class MapStacker {
+
+public:
+	/// \param[in] sign +1 to add the maps, -1 to subtract them from the first one.
+	/// \param[in] compensated Use the Kahan summation.
+	MapStacker(int sign=1, bool compensated=false);
+
+	/// Add a map. The first map is copied as it is.
+	/// \return false if the map has a different size.
+	bool Add(const AgileMap& map);
+
+	int Count() const { return m_count; }
+
+	/// The accumulated map, with the extended ranges in the header.
+	const AgileMap& Map() const { return m_sum; }
+	AgileMap& Map() { return m_sum; }
+
+	/// Stack the cts and exp maps of a map list, reading one pair of maps
+	/// at a time, so that the memory used does not depend on the length
+	/// of the list.
+	/// \param[in] prefetch Read the next pair on a background thread while
+	/// the current one is added.
+	/// \return false on a reading error or on maps of different sizes.
+	static bool StackList(const MapList& maplist, MapStacker& cts, MapStacker& exp, bool prefetch=true);
+
+	/// Add the i-th map of a plane of a cube. The first map added gets
+	/// the header the cube keeps for it.
+	/// \return false if the map has a different size or cannot be read.
+	bool Add(const MapCube& cube, MapCubePlane plane, int i);
+
+	/// Stack the cts and exp planes of a map cube as StackList does with
+	/// the map list the cube was built from, without reading any FITS map
+	/// but the first one.
+	/// \return false on a reading error.
+	static bool StackCube(const MapCube& cube, MapStacker& cts, MapStacker& exp);
+
+	/// Sum the cts and exp maps of a map list with a pairwise tree. The maps
+	/// are read and decompressed in parallel, threads pairs at a time, and
+	/// the memory used grows with the logarithm of the length of the list.
+	/// If cfitsio is not reentrant the maps are read by a single thread.
+	/// \param[in] threads The number of reading threads, 0 for all the cores.
+	/// \param[out] mapsPerSecond If given, the throughput in maps (cts and exp
+	/// maps counted separately) per second.
+	/// \return false on a reading error or on maps of different sizes.
+	static bool TreeSumList(const MapList& maplist, MapStacker& cts, MapStacker& exp,
+	                        int threads=0, double* mapsPerSecond=0);
+
+	/// Sum maps already in memory with a pairwise tree, the pixels being
+	/// split among the threads.
+	/// \param[out] result A copy of the first map, with the sum and the
+	/// extended ranges.
+	/// \return false if the maps are missing or of different sizes.
+	static bool TreeSum(const std::vector<const AgileMap*>& maps, AgileMap& result, int threads=1);
+
+	/// The pixels only of the TreeSum of the maps, for the callers keeping
+	/// their own headers.
+	/// \param[out] out A buffer of the size of the maps.
+	/// \return false if the maps are missing or of different sizes.
+	static bool TreeSumPixels(const std::vector<const AgileMap*>& maps, double* out, int threads=1);
+
+private:
+	/// Extend the ranges of the header with the ones of a map.
+	void Extend(const AgileMap& map);
+	void Extend(double emin, double emax, double fovmin, double fovmax, double tstart, double tstop);
+
+	/// Add the pixels of a buffer of the same size of the sum
+	void AddBuffer(const double* buffer);
+
+	int m_sign;
+	bool m_compensated;
+	int m_count;
+	AgileMap m_sum;
+	std::vector<double> m_comp;
+	double m_emin, m_emax;
+	double m_fovmin, m_fovmax;
+	double m_tstart, m_tstop;
+};
+
+#endif
@@ -0,0 +1,525 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <fitsio.h>
+
+#include "MosaicBuilder.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+
+MosaicBuilder::MosaicBuilder(const AgileMap& target, MosaicRule rule):
+	m_map(target), m_rule(rule), m_tileBegin(0)
+{
+}
+
+MosaicBuilder::~MosaicBuilder()
+{
+for (size_t i=0; i<m_inputs.size(); ++i)
+	Release(m_inputs[i]);
+}
+
+
+MosaicRule MosaicBuilder::RuleFromString(const char* name)
+{
+string s(name ? name : "");
+if (s=="sum")
+	return MosaicSum;
+if (s=="mean")
+	return MosaicMean;
+if (s=="max")
+	return MosaicMax;
+if (s=="exp" || s=="expweighted")
+	return MosaicExpWeighted;
+return MosaicNone;
+}
+
+const char* MosaicBuilder::RuleName(MosaicRule rule)
+{
+if (rule==MosaicSum)
+	return "sum";
+if (rule==MosaicMean)
+	return "mean";
+if (rule==MosaicMax)
+	return "max";
+if (rule==MosaicExpWeighted)
+	return "exp";
+return "none";
+}
+
+
+void MosaicBuilder::AddInput(const string& mapName, const string& expName)
+{
+Input input;
+input.mapName = mapName;
+input.expName = expName;
+input.map = 0;
+input.exp = 0;
+input.forward = true;
+input.scale = 1.0;
+input.rowMin = input.colMin = 0;
+input.rowMax = input.colMax = -1;
+input.status = 0;
+m_inputs.push_back(input);
+}
+
+int MosaicBuilder::AddList(const char* listName)
+{
+std::ifstream list(listName);
+if (!list.is_open())
+	return -1;
+int count = 0;
+string line;
+while (std::getline(list, line)) {
+	std::istringstream fields(line);
+	string mapName, expName;
+	if (!(fields >> mapName) || mapName[0]=='#')
+		continue;
+	fields >> expName;
+	AddInput(mapName, expName);
+	++count;
+	}
+return count;
+}
+
+
+void MosaicBuilder::Release(Input& input)
+{
+delete input.map;
+delete input.exp;
+input.map = 0;
+input.exp = 0;
+vector<int>().swap(input.targets);
+}
+
+
+void MosaicBuilder::LoadWorker(MosaicBuilder* builder, const vector<int>* inputs, std::atomic<int>* next)
+{
+for (int k=(*next)++; k<int(inputs->size()); k=(*next)++) {
+	Input& input = builder->m_inputs[(*inputs)[k]];
+	input.map = new AgileMap;
+	input.status = input.map->Read(input.mapName.c_str());
+	if (!input.status && !input.expName.empty()) {
+		input.exp = new AgileMap;
+		input.status = input.exp->Read(input.expName.c_str());
+		if (!input.status && (input.exp->Rows()!=input.map->Rows() || input.exp->Cols()!=input.map->Cols()))
+			input.status = -1;
+		}
+	}
+}
+
+bool MosaicBuilder::Load(const vector<int>& inputs, int threads, bool footprint)
+{
+int readers = fits_is_reentrant() ? threads : 1;
+if (readers>int(inputs.size()))
+	readers = inputs.size();
+std::atomic<int> next(0);
+vector<std::thread> workers;
+for (int t=1; t<readers; ++t)
+	workers.push_back(std::thread(LoadWorker, this, &inputs, &next));
+LoadWorker(this, &inputs, &next);
+for (size_t t=0; t<workers.size(); ++t)
+	workers[t].join();
+for (size_t k=0; k<inputs.size(); ++k) {
+	const Input& input = m_inputs[inputs[k]];
+	if (input.status) {
+		cerr << "Error reading " << input.mapName;
+		if (!input.expName.empty())
+			cerr << " or " << input.expName;
+		cerr << endl;
+		return false;
+		}
+	}
+
+/// The projections of AgileMap are not known to be reentrant
+for (size_t k=0; k<inputs.size(); ++k)
+	MapInput(m_inputs[inputs[k]], footprint);
+return true;
+}
+
+
+void MosaicBuilder::MapInput(Input& input, bool footprint)
+{
+const AgileMap& in = *input.map;
+double inArea = fabs(in.GetXbin()*in.GetYbin());
+double outArea = fabs(m_map.GetXbin()*m_map.GetYbin());
+input.forward = inArea<=outArea*(1+1e-9);
+input.scale = (!input.forward && m_rule==MosaicSum) ? outArea/inArea : 1.0;
+if (!input.forward && !footprint)
+	return;
+
+int rows = m_map.Rows();
+int cols = m_map.Cols();
+int inRows = in.Rows();
+int inCols = in.Cols();
+input.targets.assign(long(inRows)*inCols, -1);
+int rowMin = rows, rowMax = -1;
+int colMin = cols, colMax = -1;
+for (int r=0; r<inRows; ++r)
+	for (int c=0; c<inCols; ++c) {
+		double l, b;
+		in.GetCoords(r, c, &l, &b);
+		int row, col;
+		if (!m_map.GetRowCol(l, b, &row, &col) || row<0 || row>=rows || col<0 || col>=cols)
+			continue;
+		input.targets[long(r)*inCols+c] = row*cols+col;
+		if (row<rowMin) rowMin = row;
+		if (row>rowMax) rowMax = row;
+		if (col<colMin) colMin = col;
+		if (col>colMax) colMax = col;
+		}
+if (footprint) {
+	/// The centers of the pixels of a coarser map are farther than one
+	/// target pixel, their target pixels are covered only in part
+	if (!input.forward && rowMin<=rowMax) {
+		int margin = int(ceil(sqrt(inArea/outArea)))+1;
+		rowMin = std::max(0, rowMin-margin);
+		rowMax = std::min(rows-1, rowMax+margin);
+		colMin = std::max(0, colMin-margin);
+		colMax = std::min(cols-1, colMax+margin);
+		}
+	input.rowMin = rowMin;
+	input.rowMax = rowMax;
+	input.colMin = colMin;
+	input.colMax = colMax;
+	}
+if (!input.forward)
+	vector<int>().swap(input.targets);
+}
+
+
+/// The angular distance in degrees between two points
+static double SkyDistance(double l1, double b1, double l2, double b2)
+{
+const double d2r = M_PI/180.0;
+double c = sin(b1*d2r)*sin(b2*d2r)+cos(b1*d2r)*cos(b2*d2r)*cos((l1-l2)*d2r);
+return acos(std::max(-1.0, std::min(1.0, c)))/d2r;
+}
+
+bool MosaicBuilder::HeaderFootprint(Input& input, const vector<EdgePixel>& edge) const
+{
+int status = 0;
+fitsfile* fptr;
+if (fits_open_file(&fptr, input.mapName.c_str(), READONLY, &status))
+	return false;
+long naxis1 = 0, naxis2 = 0;
+double crpix1 = 0, crpix2 = 0, cdelt1 = 0, cdelt2 = 0, crval1 = 0, crval2 = 0;
+fits_read_key(fptr, TLONG, "NAXIS1", &naxis1, NULL, &status);
+fits_read_key(fptr, TLONG, "NAXIS2", &naxis2, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CRPIX1", &crpix1, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CRPIX2", &crpix2, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CDELT1", &cdelt1, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CDELT2", &cdelt2, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CRVAL1", &crval1, NULL, &status);
+fits_read_key(fptr, TDOUBLE, "CRVAL2", &crval2, NULL, &status);
+int closeStatus = 0;
+fits_close_file(fptr, &closeStatus);
+if (status || naxis1<1 || naxis2<1)
+	return false;
+
+int rows = m_map.Rows();
+int cols = m_map.Cols();
+double inArea = fabs(cdelt1*cdelt2);
+double outArea = fabs(m_map.GetXbin()*m_map.GetYbin());
+input.forward = inArea<=outArea*(1+1e-9);
+
+/// The corners of the border pixels on the projection plane. The distances
+/// on the plane are the ones on the sky for the ARC maps and smaller by less
+/// than 12% for the AIT maps. The pixels of both maps are added as margin.
+double radius = 0;
+for (int k=0; k<4; ++k) {
+	double x = ((k&1) ? naxis1+0.5 : 0.5)-crpix1;
+	double y = ((k&2) ? naxis2+0.5 : 0.5)-crpix2;
+	radius = std::max(radius, sqrt(x*cdelt1*x*cdelt1+y*cdelt2*y*cdelt2));
+	}
+double outPixel = sqrt(2*outArea);
+radius = std::min(180.0, radius*1.15+sqrt(2*inArea)+outPixel);
+
+/// The circle, with the samples closer than a target pixel, the poles it
+/// contains and the target border inside it
+const double d2r = M_PI/180.0;
+int rowMin = rows, rowMax = -1;
+int colMin = cols, colMax = -1;
+vector<double> ls, bs;
+int samples = int(std::min(100000.0, std::max(64.0, ceil(2*M_PI*sin(std::min(90.0, radius)*d2r)/(outPixel*d2r)))));
+double sinb0 = sin(crval2*d2r), cosb0 = cos(crval2*d2r);
+double sinr = sin(radius*d2r), cosr = cos(radius*d2r);
+for (int k=0; k<samples; ++k) {
+	double theta = 2*M_PI*k/samples;
+	double sinb = std::max(-1.0, std::min(1.0, sinb0*cosr+cosb0*sinr*cos(theta)));
+	ls.push_back(crval1+atan2(sin(theta)*sinr*cosb0, cosr-sinb0*sinb)/d2r);
+	bs.push_back(asin(sinb)/d2r);
+	}
+if (90-crval2<=radius) {
+	ls.push_back(crval1);
+	bs.push_back(90);
+	}
+if (90+crval2<=radius) {
+	ls.push_back(crval1);
+	bs.push_back(-90);
+	}
+for (size_t k=0; k<ls.size(); ++k) {
+	int row, col;
+	if (!m_map.GetRowCol(ls[k], bs[k], &row, &col))
+		continue;
+	row = std::max(0, std::min(rows-1, row));
+	col = std::max(0, std::min(cols-1, col));
+	rowMin = std::min(rowMin, row);
+	rowMax = std::max(rowMax, row);
+	colMin = std::min(colMin, col);
+	colMax = std::max(colMax, col);
+	}
+for (size_t k=0; k<edge.size(); ++k)
+	if (SkyDistance(crval1, crval2, edge[k].l, edge[k].b)<=radius) {
+		rowMin = std::min(rowMin, edge[k].row);
+		rowMax = std::max(rowMax, edge[k].row);
+		colMin = std::min(colMin, edge[k].col);
+		colMax = std::max(colMax, edge[k].col);
+		}
+if (rowMin<=rowMax) {
+	rowMin = std::max(0, rowMin-1);
+	rowMax = std::min(rows-1, rowMax+1);
+	colMin = std::max(0, colMin-1);
+	colMax = std::min(cols-1, colMax+1);
+	}
+input.rowMin = rowMin;
+input.rowMax = rowMax;
+input.colMin = colMin;
+input.colMax = colMax;
+return true;
+}
+
+
+void MosaicBuilder::TileLinks(const Input& input, int rowBegin, int rowEnd, vector<Link>& links) const
+{
+links.clear();
+int cols = m_map.Cols();
+const AgileMap& in = *input.map;
+if (input.forward) {
+	int first = rowBegin*cols;
+	int last = rowEnd*cols;
+	for (size_t s=0; s<input.targets.size(); ++s) {
+		int t = input.targets[s];
+		if (t>=first && t<last) {
+			Link link = { t, int(s) };
+			links.push_back(link);
+			}
+		}
+	std::sort(links.begin(), links.end());
+	return;
+	}
+int inRows = in.Rows();
+int inCols = in.Cols();
+int rowFirst = std::max(rowBegin, input.rowMin);
+int rowLast = std::min(rowEnd-1, input.rowMax);
+for (int r=rowFirst; r<=rowLast; ++r)
+	for (int c=input.colMin; c<=input.colMax; ++c) {
+		long i = long(r-m_tileBegin)*cols+c;
+		int row, col;
+		if (in.GetRowCol(m_tileL[i], m_tileB[i], &row, &col) && row>=0 && row<inRows && col>=0 && col<inCols) {
+			Link link = { r*cols+c, row*inCols+col };
+			links.push_back(link);
+			}
+		}
+}
+
+void MosaicBuilder::LinkWorker(const MosaicBuilder* builder, const vector<int>* inputs, int rowBegin, int rowEnd,
+                               vector<vector<Link> >* links, std::atomic<int>* next)
+{
+for (int k=(*next)++; k<int(inputs->size()); k=(*next)++) {
+	const Input& input = builder->m_inputs[(*inputs)[k]];
+	if (input.forward)
+		builder->TileLinks(input, rowBegin, rowEnd, (*links)[k]);
+	}
+}
+
+
+void MosaicBuilder::Accumulate(const vector<int>& inputs, const vector<vector<Link> >& links, int rowBegin, int rowEnd)
+{
+int cols = m_map.Cols();
+int first = rowBegin*cols;
+int last = rowEnd*cols;
+double* out = m_map.Buffer();
+long tileFirst = long(m_tileBegin)*cols;
+int* coverage = &m_coverage[0];
+for (size_t k=0; k<inputs.size(); ++k) {
+	const Input& input = m_inputs[inputs[k]];
+	const double* values = input.map->Buffer();
+	const double* exposures = input.exp ? input.exp->Buffer() : 0;
+	double scale = input.scale;
+	Link from = { first, -1 };
+	vector<Link>::const_iterator link = std::lower_bound(links[k].begin(), links[k].end(), from);
+	int previous = -1;
+	for (; link!=links[k].end() && link->target<last; ++link) {
+		int t = link->target;
+		double x = values[link->source]*scale;
+		if (m_rule==MosaicSum)
+			out[t] += x;
+		else if (m_rule==MosaicMean) {
+			out[t] += x;
+			m_weight[t-tileFirst] += 1.0;
+			}
+		else if (m_rule==MosaicMax) {
+			if (!m_weight[t-tileFirst] || x>out[t])
+				out[t] = x;
+			m_weight[t-tileFirst] = 1.0;
+			}
+		else if (m_rule==MosaicExpWeighted) {
+			double e = exposures[link->source];
+			out[t] += x*e;
+			m_weight[t-tileFirst] += e;
+			}
+		if (t!=previous) {
+			++coverage[t];
+			previous = t;
+			}
+		}
+	}
+if (m_rule==MosaicMean || m_rule==MosaicExpWeighted)
+	for (int t=first; t<last; ++t)
+		out[t] = m_weight[t-tileFirst]>0 ? out[t]/m_weight[t-tileFirst] : 0.0;
+}
+
+void MosaicBuilder::AccumulateWorker(MosaicBuilder* builder, const vector<int>* inputs,
+                                     const vector<vector<Link> >* links, int rowBegin, int rowEnd)
+{
+builder->Accumulate(*inputs, *links, rowBegin, rowEnd);
+}
+
+
+bool MosaicBuilder::Build(int tileRows, int threads)
+{
+if (m_rule==MosaicNone || m_inputs.empty())
+	return false;
+if (m_rule==MosaicExpWeighted)
+	for (size_t i=0; i<m_inputs.size(); ++i)
+		if (m_inputs[i].expName.empty()) {
+			cerr << "Error: the exposure map of " << m_inputs[i].mapName << " is missing" << endl;
+			return false;
+			}
+if (threads<1)
+	threads = std::thread::hardware_concurrency();
+if (threads<1)
+	threads = 1;
+int rows = m_map.Rows();
+int cols = m_map.Cols();
+if (tileRows<1 || tileRows>rows)
+	tileRows = rows;
+double* out = m_map.Buffer();
+std::fill(out, out+long(rows)*cols, 0.0);
+m_coverage.assign(long(rows)*cols, 0);
+
+/// With more than one tile the footprints are found first from the
+/// headers, so that only the maps of a tile are read and kept in memory
+bool tiled = tileRows<rows;
+if (tiled) {
+	vector<EdgePixel> edge;
+	for (int r=0; r<rows; ++r) {
+		bool border = r==0 || r==rows-1;
+		for (int c=0; c<cols; c+=(border || c==cols-1) ? 1 : cols-1) {
+			EdgePixel pixel = { r, c, 0.0, 0.0 };
+			m_map.GetCoords(r, c, &pixel.l, &pixel.b);
+			edge.push_back(pixel);
+			}
+		}
+	for (size_t i=0; i<m_inputs.size(); ++i)
+		if (!HeaderFootprint(m_inputs[i], edge)) {
+			cerr << "Error reading the header of " << m_inputs[i].mapName << endl;
+			return false;
+			}
+	}
+else {
+	vector<int> all;
+	for (size_t i=0; i<m_inputs.size(); ++i)
+		all.push_back(i);
+	if (!Load(all, threads, true))
+		return false;
+	}
+
+for (int rowBegin=0; rowBegin<rows; rowBegin+=tileRows) {
+	int rowEnd = std::min(rows, rowBegin+tileRows);
+	vector<int> active;
+	vector<int> missing;
+	bool backward = false;
+	for (size_t i=0; i<m_inputs.size(); ++i) {
+		const Input& input = m_inputs[i];
+		if (input.rowMin>input.rowMax || input.rowMin>=rowEnd || input.rowMax<rowBegin)
+			continue;
+		active.push_back(i);
+		if (!input.map)
+			missing.push_back(i);
+		if (!input.forward)
+			backward = true;
+		}
+	if (!missing.empty() && !Load(missing, threads, false))
+		return false;
+
+	/// The coordinates of the tile pixels, shared by the backward mappings
+	m_tileBegin = rowBegin;
+	if (backward) {
+		m_tileL.resize(long(rowEnd-rowBegin)*cols);
+		m_tileB.resize(long(rowEnd-rowBegin)*cols);
+		for (int r=rowBegin; r<rowEnd; ++r)
+			for (int c=0; c<cols; ++c) {
+				long i = long(r-rowBegin)*cols+c;
+				m_map.GetCoords(r, c, &m_tileL[i], &m_tileB[i]);
+				}
+		}
+	/// The backward links need the coordinate transforms, made on this
+	/// thread, the forward ones are sorted on the threads
+	vector<vector<Link> > links(active.size());
+	for (size_t k=0; k<active.size(); ++k)
+		if (!m_inputs[active[k]].forward)
+			TileLinks(m_inputs[active[k]], rowBegin, rowEnd, links[k]);
+	std::atomic<int> next(0);
+	vector<std::thread> workers;
+	for (int t=1; t<threads && t<int(active.size()); ++t)
+		workers.push_back(std::thread(LinkWorker, this, &active, rowBegin, rowEnd, &links, &next));
+	LinkWorker(this, &active, rowBegin, rowEnd, &links, &next);
+	for (size_t t=0; t<workers.size(); ++t)
+		workers[t].join();
+
+	/// Blocks of rows on the threads, each pixel combines the maps in the
+	/// order of the list whatever the number of threads
+	m_weight.assign(long(rowEnd-rowBegin)*cols, 0.0);
+	int blocks = std::min(threads, rowEnd-rowBegin);
+	workers.clear();
+	for (int t=1; t<blocks; ++t)
+		workers.push_back(std::thread(AccumulateWorker, this, &active, &links,
+		                              rowBegin+(rowEnd-rowBegin)*t/blocks, rowBegin+(rowEnd-rowBegin)*(t+1)/blocks));
+	Accumulate(active, links, rowBegin, rowBegin+(rowEnd-rowBegin)/blocks);
+	for (size_t t=0; t<workers.size(); ++t)
+		workers[t].join();
+
+	/// The maps whose last tile is this one
+	for (size_t k=0; k<active.size(); ++k)
+		if (m_inputs[active[k]].rowMax<rowEnd)
+			Release(m_inputs[active[k]]);
+	}
+m_tileL.clear();
+m_tileB.clear();
+m_weight.clear();
+for (size_t i=0; i<m_inputs.size(); ++i)
+	Release(m_inputs[i]);
+return true;
+}
@@ -0,0 +1,146 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _MOSAICBUILDER_H
+#define _MOSAICBUILDER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <AgileMap.h>
+
+
+/// How the values of overlapping maps are combined
+enum MosaicRule { MosaicNone=0, MosaicSum=1, MosaicMean=2, MosaicMax=3, MosaicExpWeighted=4 };
+
+
+/// Resamples a list of maps of any size, resolution and projection onto
+/// the grid of a target map and combines the overlaps.
+/// A map with pixels not larger than the ones of the target is resampled
+/// forward: each pixel goes into the target pixel containing its center,
+/// so the sums are preserved. A coarser map is resampled backward: each
+/// target pixel takes the value of the pixel containing its center, and
+/// in the sum mode the value is scaled by the ratio of the pixel areas.
+/// The pixel-to-pixel mappings are computed once per map. The coordinate
+/// transforms are done on a single thread, the maps are read, the links
+/// sorted and the values combined on the threads.
+/// The target can be built in tiles of rows: only the maps overlapping the
+/// current tile are kept in memory, each one from the first to the last
+/// tile it touches. The tiles a map touches are found from the WCS
+/// keywords of its header, before any map is read.
+/// \brief Mosaic of maps on a target grid
+class MosaicBuilder {
+
+public:
+	/// \param[in] target The map providing the grid and the header of the
+	/// result, its values are not used.
+	MosaicBuilder(const AgileMap& target, MosaicRule rule=MosaicSum);
+	~MosaicBuilder();
+
+	/// Add a map to the list. The maps are read only by Build.
+	/// \param[in] expName The exposure map on the same grid of the map,
+	/// needed by the exposure weighted rule only.
+	void AddInput(const std::string& mapName, const std::string& expName="");
+
+	/// Read a list file with a map name and optionally an exposure map name
+	/// per line. Empty lines and lines beginning with # are skipped.
+	/// \return the number of maps added, -1 if the file can not be read.
+	int AddList(const char* listName);
+
+	int InputCount() const { return int(m_inputs.size()); }
+
+	/// Resample and combine all the maps.
+	/// \param[in] tileRows The rows of a tile, 0 to build the target at once.
+	/// \param[in] threads The number of threads, 0 for all the cores. The maps
+	/// are read by a single thread if cfitsio is not reentrant.
+	/// \return false on a reading error or on a missing exposure map.
+	bool Build(int tileRows=0, int threads=0);
+
+	/// The mosaic, with the header of the target map.
+	const AgileMap& Map() const { return m_map; }
+
+	/// The number of maps contributing to each pixel of the target.
+	const std::vector<int>& Coverage() const { return m_coverage; }
+
+	static MosaicRule RuleFromString(const char* name);
+	static const char* RuleName(MosaicRule rule);
+
+private:
+	MosaicBuilder(const MosaicBuilder&);
+	MosaicBuilder& operator=(const MosaicBuilder&);
+
+	/// A target pixel and the pixel of an input map it is made of
+	struct Link {
+		int target;
+		int source;
+		bool operator<(const Link& other) const { return target<other.target || (target==other.target && source<other.source); }
+	};
+
+	struct Input {
+		std::string mapName;
+		std::string expName;
+		AgileMap* map;
+		AgileMap* exp;
+		bool forward;
+		double scale;
+		std::vector<int> targets;	/// forward mapping, -1 outside the target
+		int rowMin, rowMax;
+		int colMin, colMax;
+		int status;
+	};
+
+	/// A pixel on the border of the target
+	struct EdgePixel {
+		int row, col;
+		double l, b;
+	};
+
+	/// Read the maps of the given inputs and compute their mappings and,
+	/// if footprint, the range of target pixels they cover.
+	bool Load(const std::vector<int>& inputs, int threads, bool footprint);
+
+	/// The range of target pixels an input may cover, from the circle around
+	/// the reference point of its header containing all its pixels. The
+	/// range is larger than the one Load finds, never smaller.
+	/// \return false if the header can not be read.
+	bool HeaderFootprint(Input& input, const std::vector<EdgePixel>& edge) const;
+	void Release(Input& input);
+	static void LoadWorker(MosaicBuilder* builder, const std::vector<int>* inputs, std::atomic<int>* next);
+	static void LinkWorker(const MosaicBuilder* builder, const std::vector<int>* inputs, int rowBegin, int rowEnd,
+	                       std::vector<std::vector<Link> >* links, std::atomic<int>* next);
+	static void AccumulateWorker(MosaicBuilder* builder, const std::vector<int>* inputs,
+	                             const std::vector<std::vector<Link> >* links, int rowBegin, int rowEnd);
+	void MapInput(Input& input, bool footprint);
+
+	/// The links of an input to the target pixels of the rows [rowBegin, rowEnd),
+	/// sorted by target pixel. The backward links use the coordinate
+	/// transforms of the maps.
+	void TileLinks(const Input& input, int rowBegin, int rowEnd, std::vector<Link>& links) const;
+
+	/// Combine the links of the inputs, in the order of the list, into the
+	/// target rows [rowBegin, rowEnd).
+	void Accumulate(const std::vector<int>& inputs, const std::vector<std::vector<Link> >& links, int rowBegin, int rowEnd);
+
+	AgileMap m_map;
+	MosaicRule m_rule;
+	std::vector<Input> m_inputs;
+	std::vector<int> m_coverage;
+	std::vector<double> m_tileL;
+	std::vector<double> m_tileB;
+	std::vector<double> m_weight;
+	int m_tileBegin;
+};
+
+#endif
@@ -0,0 +1,218 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include "ProfileSearch.h"
+
+using std::vector;
+
+static const double c_deg2rad = M_PI/180.0;
+
+
+double ProfileSearch::BrentRoot(const std::function<double(double)>& f, double a, double b,
+                                double fa, double fb, double tol, int maxIter, int& evals)
+{
+const double eps = std::numeric_limits<double>::epsilon();
+double c = b, fc = fb;
+double d = b-a, e = d;
+for (int iter=0; iter<maxIter; ++iter) {
+	if ((fb>0 && fc>0) || (fb<0 && fc<0)) {
+		c = a;
+		fc = fa;
+		e = d = b-a;
+		}
+	if (fabs(fc)<fabs(fb)) {
+		a = b; b = c; c = a;
+		fa = fb; fb = fc; fc = fa;
+		}
+	double tol1 = 2*eps*fabs(b)+0.5*tol;
+	double xm = 0.5*(c-b);
+	if (fabs(xm)<=tol1 || fb==0)
+		return b;
+	if (fabs(e)>=tol1 && fabs(fa)>fabs(fb)) {
+		/// Inverse quadratic interpolation, or secant when only two points are available
+		double p, q, r;
+		double s = fb/fa;
+		if (a==c) {
+			p = 2*xm*s;
+			q = 1-s;
+			}
+		else {
+			q = fa/fc;
+			r = fb/fc;
+			p = s*(2*xm*q*(q-r)-(b-a)*(r-1));
+			q = (q-1)*(r-1)*(s-1);
+			}
+		if (p>0)
+			q = -q;
+		p = fabs(p);
+		double min1 = 3*xm*q-fabs(tol1*q);
+		double min2 = fabs(e*q);
+		if (2*p<std::min(min1, min2)) {
+			e = d;
+			d = p/q;
+			}
+		else {
+			d = xm;
+			e = d;
+			}
+		}
+	else {
+		d = xm;
+		e = d;
+		}
+	a = b;
+	fa = fb;
+	if (fabs(d)>tol1)
+		b += d;
+	else
+		b += xm>=0 ? tol1 : -tol1;
+	fb = f(b);
+	++evals;
+	}
+return b;
+}
+
+
+bool ProfileSearch::BracketUp(const std::function<double(double)>& f, double a, double fa,
+                              double& b, double& fb, int maxIter, int& evals)
+{
+fb = f(b);
+++evals;
+for (int iter=0; iter<maxIter && (fa<0)==(fb<0); ++iter) {
+	b = a+2*(b-a);
+	fb = f(b);
+	++evals;
+	}
+return (fa<0)!=(fb<0);
+}
+
+
+void ProfileSearch::Offset(double l0, double b0, double angle, double radius, double& l, double& b)
+{
+double lr = l0*c_deg2rad;
+double br = b0*c_deg2rad;
+double th = angle*c_deg2rad;
+double r = radius*c_deg2rad;
+double sinb = sin(br)*cos(r)+cos(br)*sin(r)*cos(th);
+double bb = asin(std::max(-1.0, std::min(1.0, sinb)));
+double ll = lr+atan2(sin(th)*sin(r)*cos(br), cos(r)-sin(br)*sinb);
+l = fmod(ll/c_deg2rad+360.0, 360.0);
+b = bb/c_deg2rad;
+}
+
+
+double ProfileSearch::RayRadius(const std::function<double(int, double, double)>& drop, int thread,
+                                double l0, double b0, double angle, double level,
+                                double step, double maxRadius, int& evals)
+{
+double rPrev = 0;
+double gPrev = -level;
+for (double r=step; r<=maxRadius; r+=step) {
+	double l, b;
+	Offset(l0, b0, angle, r, l, b);
+	double g = drop(thread, l, b)-level;
+	++evals;
+	if (g>=0) {
+		std::function<double(double)> ray = [&](double rr) {
+			double ll, bb;
+			Offset(l0, b0, angle, rr, ll, bb);
+			return drop(thread, ll, bb)-level;
+			};
+		return BrentRoot(ray, rPrev, r, gPrev, g, 0.05*step, 20, evals);
+		}
+	rPrev = r;
+	gPrev = g;
+	}
+return maxRadius;
+}
+
+
+/// Evaluate the rays with the given angles on a pool of threads
+static int EvalRays(const std::function<double(int, double, double)>& drop,
+                    const std::function<double(const std::function<double(int, double, double)>&, int, double, int&)>& ray,
+                    const vector<double>& angles, vector<double>& radii, int threads)
+{
+radii.assign(angles.size(), 0);
+std::atomic<int> next(0);
+std::atomic<int> evals(0);
+auto worker = [&](int t) {
+	int count = 0;
+	for (int i=next++; i<int(angles.size()); i=next++)
+		radii[i] = ray(drop, t, angles[i], count);
+	evals += count;
+	};
+if (threads<2) {
+	worker(0);
+	return evals;
+	}
+vector<std::thread> pool;
+for (int t=0; t<threads; ++t)
+	pool.push_back(std::thread(worker, t));
+for (int t=0; t<threads; ++t)
+	pool[t].join();
+return evals;
+}
+
+
+int ProfileSearch::PolarContour(const std::function<double(int, double, double)>& drop,
+                                double l0, double b0, double level, int rays, double step,
+                                double maxRadius, int threads,
+                                vector<double>& angles, vector<double>& radii)
+{
+if (rays<3)
+	rays = 3;
+auto ray = [&](const std::function<double(int, double, double)>& f, int thread, double angle, int& evals) {
+	return RayRadius(f, thread, l0, b0, angle, level, step, maxRadius, evals);
+	};
+
+angles.resize(rays);
+for (int i=0; i<rays; ++i)
+	angles[i] = 360.0*i/rays;
+int evals = EvalRays(drop, ray, angles, radii, threads);
+
+/// Refine the grid where the contour changes quickly
+vector<double> newAngles;
+for (int i=0; i<rays; ++i) {
+	int j = (i+1)%rays;
+	double rmin = std::min(radii[i], radii[j]);
+	double rmax = std::max(radii[i], radii[j]);
+	if (rmax>1.5*rmin) {
+		double next = j ? angles[j] : 360.0;
+		newAngles.push_back(0.5*(angles[i]+next));
+		}
+	}
+if (newAngles.size()) {
+	vector<double> newRadii;
+	evals += EvalRays(drop, ray, newAngles, newRadii, threads);
+	vector<std::pair<double, double> > all;
+	for (size_t i=0; i<angles.size(); ++i)
+		all.push_back(std::make_pair(angles[i], radii[i]));
+	for (size_t i=0; i<newAngles.size(); ++i)
+		all.push_back(std::make_pair(newAngles[i], newRadii[i]));
+	std::sort(all.begin(), all.end());
+	angles.resize(all.size());
+	radii.resize(all.size());
+	for (size_t i=0; i<all.size(); ++i) {
+		angles[i] = all[i].first;
+		radii[i] = all[i].second;
+		}
+	}
+return evals;
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _PROFILESEARCH_H
+#define _PROFILESEARCH_H
+
+#include <vector>
+#include <functional>
+
+
+/// Root finding and contour search on a likelihood profile. The profile is
+/// evaluated through callbacks, so the same algorithms are used with any
+/// fitter.
+/// \brief Bracketed root finding and polar contour search
+class ProfileSearch {
+
+public:
+	/// Find a root of f in [a, b] with the Brent method.
+	/// \pre fa=f(a) and fb=f(b) have opposite signs.
+	/// \param[in] tol The absolute tolerance on the root.
+	/// \param[in,out] evals Incremented for each evaluation of f.
+	/// \return the root.
+	static double BrentRoot(const std::function<double(double)>& f, double a, double b,
+	                        double fa, double fb, double tol, int maxIter, int& evals);
+
+	/// Expand [a, b] upward until f(b) changes sign with respect to f(a).
+	/// \param[in,out] b The upper end of the bracket.
+	/// \param[out] fb The value of f(b).
+	/// \return true if a bracket has been found within maxIter doublings.
+	static bool BracketUp(const std::function<double(double)>& f, double a, double fa,
+	                      double& b, double& fb, int maxIter, int& evals);
+
+	/// The point at a given angular distance and position angle from (l0, b0).
+	/// \param[in] angle The position angle in degrees, measured from the b axis.
+	/// \param[in] radius The distance in degrees.
+	static void Offset(double l0, double b0, double angle, double radius, double& l, double& b);
+
+	/// The radii of a contour around (l0, b0) where the drop of the profile
+	/// drop(thread, l, b) reaches level. A polar grid of rays is marched
+	/// outward with steps of step degrees up to maxRadius, each crossing is
+	/// refined with the Brent method, and rays are inserted where adjacent
+	/// radii differ by more than 50%. The rays are evaluated on threads
+	/// threads, the first argument of drop is the index of the thread.
+	/// \param[out] angles The position angles of the contour, sorted.
+	/// \param[out] radii The radius for each angle, maxRadius if no crossing.
+	/// \return the number of evaluations of drop.
+	static int PolarContour(const std::function<double(int, double, double)>& drop,
+	                        double l0, double b0, double level, int rays, double step,
+	                        double maxRadius, int threads,
+	                        std::vector<double>& angles, std::vector<double>& radii);
+
+private:
+	static double RayRadius(const std::function<double(int, double, double)>& drop, int thread,
+	                        double l0, double b0, double angle, double level,
+	                        double step, double maxRadius, int& evals);
+};
+
+#endif
@@ -0,0 +1,242 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <thread>
+#include <atomic>
+
+#include <fitsio.h>
+#include <MathUtils.h>
+
+#include "KingFit.h"
+#include "KingFitPlot.h"
+#include "PsfSimFit.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+static const double c_drho = 0.1;
+static const int c_nrhos = 200;
+static const double c_normscale = 1e5;
+static const double c_psfcoeff = M_PI * M_PI / 90.0 * c_drho * c_normscale;
+
+static const int c_nfilters = 3;
+static const char* c_filter[c_nfilters] = { "_FM", "_F4", "_FT3ab" };
+static const int c_nevtypes = 3;
+static const char c_evtype[] = "GLS";
+
+
+/// The energy channel of each event of the .dat file: -1 below and nenergies above the range
+static long ReadChannels(const string& datFileName, const float* energies, int nenergies, vector<int>& evcanals)
+{
+cout << "Reading " << datFileName << endl;
+std::ifstream datfile(datFileName.c_str());
+vector<long> ensum(nenergies, 0);
+cout << "Minimum energy = " << energies[0] << endl;
+cout << "Maximum energy = " << energies[nenergies] << endl;
+long evnum = 0;
+for ( ; !datfile.eof() ; ) {
+	long dummy;
+	float evenergy;
+	string dumstring;
+	datfile >> dummy >> evenergy;
+	if (!datfile.eof()) {
+		getline(datfile, dumstring);
+		evenergy *= 1000;
+		if (evenergy < energies[0])
+			evcanals.push_back(-1);
+		else if (evenergy < energies[nenergies]) {
+			int canal=0;
+			for ( ; evenergy >= energies[canal] ; canal++) {}
+			canal--;
+			evcanals.push_back(canal);
+			ensum[canal]++;
+			}
+		else
+			evcanals.push_back(nenergies);
+		evnum++;
+		}
+	}
+cout << evnum << " events" << endl;
+for (int i=0; i<nenergies; i++)
+	cout << ensum[i] << " events in channel " << i << endl;
+return evnum;
+}
+
+
+/// The THETA, PHI and EVSTATUS columns of a .flg file
+static bool ReadFlg(const string& flgFileName, long evnum, const string& datFileName,
+                    vector<float>& evtheta, vector<float>& evphi, vector<char>& evevtype)
+{
+int status = 0;
+fitsfile* flg;
+cout << "FLG file name = " << flgFileName << endl;
+if (fits_open_table(&flg, flgFileName.c_str(), READONLY, &status) != 0) {
+	cerr << "Could not open " << flgFileName << endl;
+	return false;
+	}
+int thetacol, phicol, evcol;
+fits_get_colnum(flg, CASEINSEN, (char*)"THETA", &thetacol, &status);
+fits_get_colnum(flg, CASEINSEN, (char*)"PHI", &phicol, &status);
+fits_get_colnum(flg, CASEINSEN, (char*)"EVSTATUS", &evcol, &status);
+long testnrows;
+fits_get_num_rows(flg, &testnrows, &status);
+if (evnum != testnrows)
+	cerr << "Warning: " << evnum << " events in " << datFileName << " do not match " << testnrows << " events in " << flgFileName << endl;
+long nrows = testnrows < evnum ? testnrows : evnum;
+evtheta.resize(nrows);
+evphi.resize(nrows);
+evevtype.resize(nrows);
+if (nrows > 0) {
+	fits_read_col(flg, TFLOAT, thetacol, 1, 1, nrows, NULL, &evtheta[0], NULL, &status);
+	fits_read_col(flg, TFLOAT, phicol, 1, 1, nrows, NULL, &evphi[0], NULL, &status);
+	fits_read_col(flg, TBYTE, evcol, 1, 1, nrows, NULL, &evevtype[0], NULL, &status);
+	}
+fits_close_file(flg, &status);
+if (status) {
+	fits_report_error(stderr, status);
+	return false;
+	}
+return true;
+}
+
+
+/// The fit of one profile of the flat array of counts
+struct ProfileFit {
+	double psfsum;
+	double params[6];
+	KingFitResult result;
+};
+
+static void FitWorker(const KingFit& fit, const vector<double>& rhos, const vector<double>& counts,
+                      int nenergies, vector<ProfileFit>& fits, std::atomic<int>& next)
+{
+int count = fits.size();
+for (int index=next++; index<count; index=next++) {
+	ProfileFit& pf = fits[index];
+	const double* profile = &counts[long(index) * c_nrhos];
+	pf.psfsum = 0;
+	for (int i=0; i<c_nrhos; i++)
+		pf.psfsum += profile[i];
+	if (pf.psfsum < 10)
+		continue;
+	int en = index % nenergies;
+	KingFit channelFit(fit);
+	channelFit.SetLimits(0, 0.0, 0.1 * pf.psfsum);
+	double start[6] = { 1e-3 * pf.psfsum, en >= 5 ? 0.1 : 1.0, 1.5, 0.0, 0.1, 0.1 };
+	for (int par=0; par<6; par++)
+		pf.params[par] = start[par];
+	pf.result = channelFit.Fit(&rhos[0], profile, 0, c_nrhos, pf.params);
+	}
+}
+
+
+int PsfSimFit::Run(const string& inPrefix, const string& outPrefix, const string& label,
+                   int theta, int phi, const float* energies, int nenergies, bool plots, int threads)
+{
+vector<int> evcanals;
+string datFileName = inPrefix + ".dat";
+long evnum = ReadChannels(datFileName, energies, nenergies, evcanals);
+
+vector<double> rhos(c_nrhos);
+for (int i=0; i<c_nrhos; i++)
+	rhos[i] = (i+0.5) * c_drho;
+
+/// The events of all the filters are binned in a single pass over the
+/// rows, in a flat array of counts indexed by (filter, event type, channel, rho)
+vector<float> evtheta[c_nfilters];
+vector<float> evphi[c_nfilters];
+vector<char> evevtype[c_nfilters];
+bool present[c_nfilters];
+for (int f=0; f<c_nfilters; f++)
+	present[f] = ReadFlg(inPrefix + c_filter[f] + ".flg", evnum, datFileName, evtheta[f], evphi[f], evevtype[f]);
+
+long profiles = long(c_nfilters) * c_nevtypes * nenergies;
+vector<double> counts(profiles * c_nrhos, 0.0);
+for (long row = 0 ; row < evnum ; row++) {
+	int canal = evcanals[row];
+	if (canal < 0 || canal >= nenergies)
+		continue;
+	for (int f=0; f<c_nfilters; f++) {
+		if (!present[f] || row >= long(evevtype[f].size()))
+			continue;
+		int ev = 0;
+		for ( ; ev < c_nevtypes && c_evtype[ev] != evevtype[f][row]; ev++) {}
+		if (ev == c_nevtypes)
+			continue;
+		if (f == 2 && evtheta[f][row] == (-1.0) && evphi[f][row] == (-1.0) && ev == 2)
+			continue;
+		double dist = SphDistDeg(evphi[f][row], 90.0-evtheta[f][row], phi, 90.0-theta);
+		int bin = int(dist / c_drho);
+		if (bin >= 0 && bin < c_nrhos)
+			counts[((long(f) * c_nevtypes + ev) * nenergies + canal) * c_nrhos + bin] += 1;
+		}
+	}
+
+/// The profiles are fitted in parallel, the outputs are written in order afterwards
+KingFit fit(KingFit::Poisson, c_psfcoeff, true);
+fit.SetLimits(1, 0.0, 12.0);
+fit.SetLimits(2, 0.0, 12.0);
+vector<ProfileFit> fits(profiles);
+if (threads < 1)
+	threads = std::thread::hardware_concurrency();
+if (threads < 1)
+	threads = 1;
+if (threads > profiles)
+	threads = profiles;
+cout << profiles << " profiles on " << threads << " threads" << endl;
+std::atomic<int> next(0);
+vector<std::thread> workers;
+for (int t=0; t<threads; t++)
+	workers.push_back(std::thread(FitWorker, std::cref(fit), std::cref(rhos), std::cref(counts), nenergies, std::ref(fits), std::ref(next)));
+for (int t=0; t<threads; t++)
+	workers[t].join();
+
+for (int f=0; f<c_nfilters; f++) {
+	if (!present[f])
+		continue;
+	for (int ev=0; ev<c_nevtypes; ev++) {
+		string psfFileName = outPrefix + c_filter[f] + c_evtype[ev] + ".psf3";
+		std::ofstream ofout(psfFileName.c_str());
+		cout << "Writing " << psfFileName << endl;
+		for (int en=0; en<nenergies; en++) {
+			long index = (long(f) * c_nevtypes + ev) * nenergies + en;
+			const ProfileFit& pf = fits[index];
+			cout << energies[en] << " MeV = channel " << en << endl;
+			cout << pf.psfsum << " events" << endl;
+			if (pf.psfsum < 10)
+				continue;
+			const KingFitResult& result = pf.result;
+			ofout << energies[en] << " " << " " << c_normscale * result.norm << " " << c_normscale * result.normErr
+			      << " " << result.gamma << " " << result.gammaErr << " " << result.ang << " " << result.angErr
+			      << " " << result.chi2 << " " << result.ndf << endl;
+			if (plots) {
+				std::ostringstream name, title;
+				name << outPrefix << c_filter[f] << c_evtype[ev] << long(energies[en]) << ".eps";
+				title << label << c_filter[f] << c_evtype[ev] << long(energies[en]) << ";#theta (deg)";
+				KingFitPlot::Plot(name.str().c_str(), title.str().c_str(), fit, pf.params,
+				                  &rhos[0], &counts[index * c_nrhos], c_nrhos, c_drho);
+				}
+			}
+		}
+	}
+return 0;
+}
@@ -0,0 +1,43 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _PSFSIMFIT_H
+#define _PSFSIMFIT_H
+
+#include <string>
+
+
+/// The PSF of a simulation at a fixed (theta, phi). The event energies of
+/// the .dat file and the directions of the .flg files of all the filters are
+/// binned in a single pass, in angular deviation for each filter, event type
+/// and energy channel, and the profiles are fitted in parallel with a
+/// Poisson likelihood fit of the King function. The parameters are written in a .psf3 text file for each filter
+/// and event type. This is the engine of AG_fitpsfarray3 and AG_fitpsfarray3_H.
+/// \brief King fits of the simulated PSF profiles
+class PsfSimFit {
+
+public:
+	/// \param[in] inPrefix The input files are inPrefix.dat and inPrefix<filter>.flg.
+	/// \param[in] outPrefix The outputs are outPrefix<filter><evtype>.psf3 and the plots.
+	/// \param[in] label The prefix of the plot titles.
+	/// \param[in] theta, phi The direction of the simulated source.
+	/// \param[in] energies The nenergies+1 edges of the energy channels in MeV.
+	/// \param[in] plots Draw the EPS plot of every fitted profile.
+	/// \param[in] threads The number of fitting threads, 0 for all the cores.
+	/// \return 0 on success.
+	static int Run(const std::string& inPrefix, const std::string& outPrefix, const std::string& label,
+	               int theta, int phi, const float* energies, int nenergies, bool plots, int threads=1);
+};
+
+#endif
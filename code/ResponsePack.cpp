@@ -0,0 +1,403 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fitsio.h"
+#include "Checksum.h"
+#include "ResponsePack.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+
+static const char     c_magic[8] = { 'A', 'G', 'R', 'S', 'P', 'A', 'C', 'K' };
+static const uint32_t c_version = 1;
+static const uint64_t c_align = 4096;
+
+
+static uint64_t AlignUp(uint64_t n)
+{
+return (n+c_align-1)/c_align*c_align;
+}
+
+
+/// An array read from a source, waiting to be written
+struct PackItem {
+	ResponsePackArray    array;
+	vector<unsigned char> data;
+};
+
+
+static uint64_t TypeSize(uint32_t type)
+{
+if (type==PackFloat32)
+	return sizeof(float);
+if (type==PackFloat64)
+	return sizeof(double);
+return 0;
+}
+
+
+/// Test that the tables and the arrays described in the header lie inside
+/// a file of size bytes
+static bool IsConsistent(const ResponsePackHeader& header, const char* base, uint64_t size)
+{
+if (header.size>size || header.sourcesOffset<sizeof(ResponsePackHeader)
+    || header.sourceCount>(size-header.sourcesOffset)/sizeof(ResponsePackSource)
+    || header.arraysOffset<header.sourcesOffset+header.sourceCount*sizeof(ResponsePackSource)
+    || header.arraysOffset>size
+    || header.arrayCount>(size-header.arraysOffset)/sizeof(ResponsePackArray)
+    || header.dataOffset<header.arraysOffset+header.arrayCount*sizeof(ResponsePackArray)
+    || header.dataOffset>header.size)
+	return false;
+const ResponsePackSource* sources = reinterpret_cast<const ResponsePackSource*>(base+header.sourcesOffset);
+for (uint32_t s=0; s<header.sourceCount; ++s)
+	if (!memchr(sources[s].fileName, 0, sizeof(sources[s].fileName)) || !memchr(sources[s].tag, 0, sizeof(sources[s].tag)))
+		return false;
+const ResponsePackArray* arrays = reinterpret_cast<const ResponsePackArray*>(base+header.arraysOffset);
+for (uint32_t i=0; i<header.arrayCount; ++i) {
+	const ResponsePackArray& array = arrays[i];
+	uint64_t typeSize = TypeSize(array.type);
+	if (!typeSize || array.source>=header.sourceCount || array.ndims<1 || array.ndims>uint32_t(c_packMaxDims)
+	    || !memchr(array.name, 0, sizeof(array.name)) || array.offset<header.dataOffset || array.offset>header.size
+	    || array.offset%sizeof(double) || array.count>(header.size-array.offset)/typeSize)
+		return false;
+	}
+return true;
+}
+
+
+static void SetName(char* dest, size_t size, const string& name)
+{
+strncpy(dest, name.c_str(), size-1);
+dest[size-1] = 0;
+}
+
+
+/// Read the images and the numeric columns of all the HDUs of a file
+static bool ReadSource(const char* fileName, int source, const string& tag, vector<PackItem>& items)
+{
+fitsfile* f;
+int status = 0;
+if (fits_open_file(&f, fileName, READONLY, &status)) {
+	cerr << "ERROR " << status << " opening " << fileName << endl;
+	return false;
+	}
+int hdus = 0;
+fits_get_num_hdus(f, &hdus, &status);
+for (int h=1; h<=hdus && !status; ++h) {
+	int hduType = 0;
+	fits_movabs_hdu(f, h, &hduType, &status);
+	char extName[FLEN_VALUE] = "PRIMARY";
+	int keyStatus = 0;
+	if (h>1 && fits_read_key(f, TSTRING, "EXTNAME", extName, 0, &keyStatus)) {
+		char number[16];
+		sprintf(number, "HDU%d", h);
+		strcpy(extName, number);
+		}
+	if (hduType==IMAGE_HDU) {
+		int naxis = 0;
+		fits_get_img_dim(f, &naxis, &status);
+		if (naxis<1 || naxis>c_packMaxDims)
+			continue;
+		long naxes[c_packMaxDims];
+		fits_get_img_size(f, naxis, naxes, &status);
+		/// Keep the precision of the source: double and 32 or 64 bit integer
+		/// images don't fit a float
+		int bitpix = FLOAT_IMG;
+		fits_get_img_equivtype(f, &bitpix, &status);
+		bool wide = bitpix==DOUBLE_IMG || bitpix==LONG_IMG || bitpix==LONGLONG_IMG || bitpix==ULONG_IMG;
+		PackItem item;
+		memset(&item.array, 0, sizeof(item.array));
+		SetName(item.array.name, sizeof(item.array.name), tag+"/"+extName);
+		item.array.source = source;
+		item.array.type = wide ? PackFloat64 : PackFloat32;
+		item.array.ndims = naxis;
+		item.array.count = 1;
+		for (int d=0; d<naxis; ++d) {
+			item.array.dims[d] = naxes[d];
+			item.array.count *= naxes[d];
+			}
+		if (!item.array.count)
+			continue;
+		item.data.resize(item.array.count*(wide ? sizeof(double) : sizeof(float)));
+		fits_read_img(f, wide ? TDOUBLE : TFLOAT, 1, item.array.count, 0, &item.data[0], 0, &status);
+		items.push_back(item);
+		}
+	else {
+		long rows = 0;
+		int cols = 0;
+		fits_get_num_rows(f, &rows, &status);
+		fits_get_num_cols(f, &cols, &status);
+		for (int c=1; c<=cols && !status && rows; ++c) {
+			int typecode = 0;
+			long repeat = 0, width = 0;
+			fits_get_coltype(f, c, &typecode, &repeat, &width, &status);
+			if (typecode==TSTRING || typecode==TLOGICAL || typecode==TBIT || repeat<1)
+				continue;
+			char key[FLEN_KEYWORD];
+			char colName[FLEN_VALUE] = "";
+			sprintf(key, "TTYPE%d", c);
+			keyStatus = 0;
+			if (fits_read_key(f, TSTRING, key, colName, 0, &keyStatus))
+				sprintf(colName, "COL%d", c);
+			PackItem item;
+			memset(&item.array, 0, sizeof(item.array));
+			SetName(item.array.name, sizeof(item.array.name), tag+"/"+extName+"/"+colName);
+			item.array.source = source;
+			item.array.type = PackFloat64;
+			item.array.ndims = repeat>1 ? 2 : 1;
+			item.array.dims[0] = repeat>1 ? repeat : rows;
+			item.array.dims[1] = repeat>1 ? rows : 0;
+			item.array.count = uint64_t(rows)*repeat;
+			item.data.resize(item.array.count*sizeof(double));
+			fits_read_col(f, TDOUBLE, c, 1, 1, item.array.count, 0, &item.data[0], 0, &status);
+			items.push_back(item);
+			}
+		}
+	}
+int closeStatus = 0;
+fits_close_file(f, &closeStatus);
+if (status) {
+	cerr << "ERROR " << status << " reading " << fileName << endl;
+	return false;
+	}
+return true;
+}
+
+
+ResponsePack::ResponsePack(): m_base(0), m_size(0), m_header(0), m_sources(0), m_arrays(0)
+{
+}
+
+ResponsePack::~ResponsePack()
+{
+Close();
+}
+
+
+string ResponsePack::Tag(const char* fileName)
+{
+string name(fileName);
+size_t slash = name.rfind('/');
+if (slash!=string::npos)
+	name = name.substr(slash+1);
+if (name.size()>3 && name.substr(name.size()-3)==".gz")
+	name = name.substr(0, name.size()-3);
+size_t dot = name.rfind('.');
+string tag = dot==string::npos ? name : name.substr(dot+1);
+for (size_t i=0; i<tag.size(); ++i)
+	tag[i] = toupper(tag[i]);
+return tag;
+}
+
+
+bool ResponsePack::Build(const vector<string>& fileNames, const char* packFileName)
+{
+int sourceCount = fileNames.size();
+if (!sourceCount) {
+	cerr << "ERROR: nothing to convert into " << packFileName << endl;
+	return false;
+	}
+vector<ResponsePackSource> sources(sourceCount);
+vector<PackItem> items;
+for (int s=0; s<sourceCount; ++s) {
+	const char* fileName = fileNames[s].c_str();
+	ResponsePackSource& src = sources[s];
+	memset(&src, 0, sizeof(src));
+	struct stat st;
+	if (stat(fileName, &st)) {
+		cerr << "ERROR: " << fileName << " not found" << endl;
+		return false;
+		}
+	SetName(src.fileName, sizeof(src.fileName), fileNames[s]);
+	string tag = Tag(fileName);
+	SetName(src.tag, sizeof(src.tag), tag);
+	src.size = st.st_size;
+	src.mtime = st.st_mtime;
+	src.checksum = Checksum::File(fileName);
+	if (!ReadSource(fileName, s, tag, items))
+		return false;
+	}
+
+ResponsePackHeader header;
+memset(&header, 0, sizeof(header));
+memcpy(header.magic, c_magic, sizeof(c_magic));
+header.version = c_version;
+header.sourceCount = sourceCount;
+header.arrayCount = items.size();
+header.align = c_align;
+header.sourcesOffset = sizeof(ResponsePackHeader);
+header.arraysOffset = header.sourcesOffset + sourceCount*sizeof(ResponsePackSource);
+header.dataOffset = AlignUp(header.arraysOffset + items.size()*sizeof(ResponsePackArray));
+uint64_t offset = header.dataOffset;
+for (size_t i=0; i<items.size(); ++i) {
+	items[i].array.offset = offset;
+	offset = AlignUp(offset + items[i].data.size());
+	}
+header.size = offset;
+
+FILE* out = fopen(packFileName, "wb");
+if (!out) {
+	cerr << "ERROR creating " << packFileName << endl;
+	return false;
+	}
+bool ok = fwrite(&header, sizeof(header), 1, out)==1
+          && fwrite(&sources[0], sizeof(ResponsePackSource), sourceCount, out)==size_t(sourceCount);
+for (size_t i=0; i<items.size() && ok; ++i)
+	ok = fwrite(&items[i].array, sizeof(ResponsePackArray), 1, out)==1;
+for (size_t i=0; i<items.size() && ok; ++i)
+	ok = !fseeko(out, items[i].array.offset, SEEK_SET)
+	     && fwrite(&items[i].data[0], 1, items[i].data.size(), out)==items[i].data.size();
+/// Pad the last array to the full size
+if (ok && header.size>header.dataOffset)
+	ok = !fseeko(out, header.size-1, SEEK_SET) && fputc(0, out)!=EOF;
+if (fclose(out))
+	ok = false;
+if (!ok) {
+	cerr << "ERROR writing " << packFileName << endl;
+	remove(packFileName);
+	}
+return ok;
+}
+
+
+bool ResponsePack::Open(const char* fileName)
+{
+Close();
+int fd = open(fileName, O_RDONLY);
+if (fd<0) {
+	cerr << "ERROR opening " << fileName << endl;
+	return false;
+	}
+struct stat st;
+if (fstat(fd, &st) || size_t(st.st_size)<sizeof(ResponsePackHeader)) {
+	cerr << "ERROR: " << fileName << " is not a response pack" << endl;
+	close(fd);
+	return false;
+	}
+void* base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+close(fd);
+if (base==MAP_FAILED) {
+	cerr << "ERROR mapping " << fileName << " in memory" << endl;
+	return false;
+	}
+const ResponsePackHeader* header = static_cast<const ResponsePackHeader*>(base);
+if (memcmp(header->magic, c_magic, sizeof(c_magic)) || header->version!=c_version
+    || !IsConsistent(*header, static_cast<const char*>(base), st.st_size)) {
+	cerr << "ERROR: " << fileName << " is not a valid response pack" << endl;
+	munmap(base, st.st_size);
+	return false;
+	}
+
+m_base = base;
+m_size = st.st_size;
+m_header = header;
+m_sources = reinterpret_cast<const ResponsePackSource*>(static_cast<const char*>(base)+header->sourcesOffset);
+m_arrays = reinterpret_cast<const ResponsePackArray*>(static_cast<const char*>(base)+header->arraysOffset);
+m_fileName = fileName;
+return true;
+}
+
+void ResponsePack::Close()
+{
+if (m_base)
+	munmap(m_base, m_size);
+m_base = 0;
+m_size = 0;
+m_header = 0;
+m_sources = 0;
+m_arrays = 0;
+m_fileName.clear();
+}
+
+
+int ResponsePack::FindSource(const char* fileName) const
+{
+for (int i=0; i<SourceCount(); ++i)
+	if (!strcmp(m_sources[i].fileName, fileName))
+		return i;
+return -1;
+}
+
+
+bool ResponsePack::IsCurrent(int source, bool deep) const
+{
+const ResponsePackSource& src = m_sources[source];
+struct stat st;
+if (stat(src.fileName, &st) || uint64_t(st.st_size)!=src.size)
+	return false;
+if (!deep)
+	return int64_t(st.st_mtime)==src.mtime;
+return Checksum::File(src.fileName)==src.checksum;
+}
+
+
+const ResponsePackArray* ResponsePack::Find(const char* name) const
+{
+for (int i=0; i<ArrayCount(); ++i)
+	if (!strcmp(m_arrays[i].name, name))
+		return &m_arrays[i];
+return 0;
+}
+
+
+const ResponsePackArray* ResponsePack::Find(int source, const char* suffix) const
+{
+size_t suffixLen = strlen(suffix);
+for (int i=0; i<ArrayCount(); ++i) {
+	const ResponsePackArray& array = m_arrays[i];
+	size_t len = strlen(array.name);
+	if (int(array.source)==source && len>suffixLen && array.name[len-suffixLen-1]=='/'
+	    && !strcmp(array.name+len-suffixLen, suffix))
+		return &array;
+	}
+return 0;
+}
+
+
+const void* ResponsePack::Data(const ResponsePackArray& array) const
+{
+return static_cast<const char*>(m_base) + array.offset;
+}
+
+
+const float* ResponsePack::Float32(const char* name) const
+{
+const ResponsePackArray* array = Find(name);
+if (!array || array->type!=PackFloat32)
+	return 0;
+return static_cast<const float*>(Data(*array));
+}
+
+
+const double* ResponsePack::Float64(const char* name) const
+{
+const ResponsePackArray* array = Find(name);
+if (!array || array->type!=PackFloat64)
+	return 0;
+return static_cast<const double*>(Data(*array));
+}
@@ -0,0 +1,132 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _RESPONSEPACK_H
+#define _RESPONSEPACK_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+/// The element type of an array of the pack
+enum ResponsePackType { PackFloat32=1, PackFloat64=2 };
+
+/// The maximum number of dimensions of an array
+static const int c_packMaxDims = 8;
+
+
+/// The fixed size header at the beginning of a pack file
+struct ResponsePackHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t sourceCount;
+	uint32_t arrayCount;
+	uint32_t align;
+	uint64_t sourcesOffset;
+	uint64_t arraysOffset;
+	uint64_t dataOffset;
+	uint64_t size;
+};
+
+/// A calibration file converted into the pack. Size and modification time
+/// allow a quick staleness test, the checksum a full one.
+struct ResponsePackSource {
+	char     fileName[256];
+	char     tag[16];
+	uint64_t size;
+	int64_t  mtime;
+	uint64_t checksum;
+};
+
+/// A grid or an axis: an image HDU of a source, or a numeric column of
+/// one of its binary tables. The dimensions follow the FITS order, the
+/// first one is the fastest.
+struct ResponsePackArray {
+	char     name[80];
+	uint32_t source;
+	uint32_t type;
+	uint32_t ndims;
+	uint32_t reserved;
+	uint64_t dims[c_packMaxDims];
+	uint64_t count;
+	uint64_t offset;
+};
+
+
+/// The calibration files of an analysis (PSD, SAR, EDP) converted once into
+/// a single binary file, with every image and numeric table column stored
+/// uncompressed and page aligned, then memory mapped. Images are stored as
+/// float64 when the source is double or 32/64 bit integer, as float32
+/// otherwise; columns always as float64. The arrays are named
+/// TAG/EXTNAME for the images and TAG/EXTNAME/COLUMN for the columns, where
+/// TAG is PSD, SAR or EDP from the file extension.
+/// \brief Memory mapped pack of the response grids
+class ResponsePack {
+
+public:
+	ResponsePack();
+	~ResponsePack();
+
+	/// Convert calibration files into a pack file.
+	/// \return true on success.
+	static bool Build(const std::vector<std::string>& fileNames, const char* packFileName);
+
+	/// Map a pack file in memory.
+	/// \return true on success.
+	bool Open(const char* fileName);
+	void Close();
+	bool IsOpen() const { return m_base!=0; }
+
+	int SourceCount() const { return m_header ? int(m_header->sourceCount) : 0; }
+	const ResponsePackSource& Source(int i) const { return m_sources[i]; }
+
+	/// The index of the source converted from a file, -1 if missing.
+	int FindSource(const char* fileName) const;
+
+	/// Test that a source is unchanged since the conversion, by size and
+	/// modification time, and also by checksum if deep.
+	bool IsCurrent(int source, bool deep=false) const;
+
+	int ArrayCount() const { return m_header ? int(m_header->arrayCount) : 0; }
+	const ResponsePackArray& Array(int i) const { return m_arrays[i]; }
+
+	/// The array with a given name, 0 if missing.
+	const ResponsePackArray* Find(const char* name) const;
+
+	/// The first array of a source whose name ends with /suffix, 0 if
+	/// missing, e.g. a column found by its name whatever the EXTNAME.
+	const ResponsePackArray* Find(int source, const char* suffix) const;
+
+	/// The elements of an array, of the type given by its type field.
+	const void* Data(const ResponsePackArray& array) const;
+	const float* Float32(const char* name) const;
+	const double* Float64(const char* name) const;
+
+	/// The tag of a calibration file from its extension, e.g. EDP for a .edp.gz.
+	static std::string Tag(const char* fileName);
+
+private:
+	ResponsePack(const ResponsePack&);
+	ResponsePack& operator=(const ResponsePack&);
+
+	void*                     m_base;
+	size_t                    m_size;
+	const ResponsePackHeader* m_header;
+	const ResponsePackSource* m_sources;
+	const ResponsePackArray*  m_arrays;
+	std::string               m_fileName;
+};
+
+#endif
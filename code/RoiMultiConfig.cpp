@@ -0,0 +1,76 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <cctype>
+
+#include "RoiMultiConfig.h"
+
+
+static std::string Lower(const std::string& s)
+{
+std::string lower(s);
+for (size_t i=0; i<lower.size(); ++i)
+	lower[i] = tolower(lower[i]);
+return lower;
+}
+
+
+RoiMultiConfig::RoiMultiConfig():
+	galmode(1), isomode(1),
+	minimizertype("Minuit"), minimizeralg("Migrad"),
+	minimizerdefstrategy(2), mindefaulttolerance(0.01), integratortype(1),
+	galmode2(0), galmode2fit(0), isomode2(0), isomode2fit(0),
+	edpcorrection(0.75), fluxcorrection(0)
+{
+}
+
+
+void RoiMultiConfig::Load(PilParams& params)
+{
+psdfile = params.GetStrValue("psdfile");
+sarfile = params.GetStrValue("sarfile");
+edpfile = params.GetStrValue("edpfile");
+galmode = params["galmode"];
+isomode = params["isomode"];
+minimizertype = params.GetStrValue("minimizertype");
+minimizeralg = params.GetStrValue("minimizeralg");
+minimizerdefstrategy = params["minimizerdefstrategy"];
+mindefaulttolerance = params["mindefaulttolerance"];
+integratortype = params["integratortype"];
+galmode2 = params["galmode2"];
+galmode2fit = params["galmode2fit"];
+isomode2 = params["isomode2"];
+isomode2fit = params["isomode2fit"];
+edpcorrection = params["edpcorrection"];
+fluxcorrection = params["fluxcorrection"];
+}
+
+
+bool RoiMultiConfig::Setup(RoiMulti& roiMulti, const MapData& mapData) const
+{
+if (!roiMulti.SetPsf(psdfile.c_str(), sarfile.c_str(), edpfile.c_str()))
+	return false;
+if (!roiMulti.SetMaps(mapData, galmode, isomode))
+	return false;
+roiMulti.SetMinimizer(minimizertype.c_str(), minimizeralg.c_str(), minimizerdefstrategy, mindefaulttolerance, integratortype);
+roiMulti.SetCorrections(galmode2, galmode2fit, isomode2, isomode2fit, edpcorrection, fluxcorrection);
+return true;
+}
+
+
+bool RoiMultiConfig::IsReentrant() const
+{
+std::string type = Lower(minimizertype);
+return type!="minuit" && type!="tminuit" && type!="fumili" && type!="tfumili";
+}
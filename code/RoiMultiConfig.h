@@ -0,0 +1,62 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _ROIMULTICONFIG_H
+#define _ROIMULTICONFIG_H
+
+#include <string>
+
+#include "RoiMulti5.h"
+#include "PilParams.h"
+
+
+/// The parameters needed to build and configure a RoiMulti instance, read
+/// once from the PIL parameters. Worker threads use it to set up their own
+/// independent fitter.
+/// \brief Configuration of a RoiMulti fitter
+class RoiMultiConfig {
+
+public:
+	RoiMultiConfig();
+
+	/// Read the configuration from the parameters of a RoiMulti based tool.
+	void Load(PilParams& params);
+
+	/// Set PSF, maps, minimizer and corrections of a RoiMulti instance.
+	/// \return true on success.
+	bool Setup(RoiMulti& roiMulti, const MapData& mapData) const;
+
+	/// True if fits with this minimizer can run in several threads at once.
+	/// TMinuit and TFumili keep their state in a global instance.
+	bool IsReentrant() const;
+
+	std::string psdfile;
+	std::string sarfile;
+	std::string edpfile;
+	int galmode;
+	int isomode;
+	std::string minimizertype;
+	std::string minimizeralg;
+	int minimizerdefstrategy;
+	double mindefaulttolerance;
+	int integratortype;
+	int galmode2;
+	int galmode2fit;
+	int isomode2;
+	int isomode2fit;
+	double edpcorrection;
+	int fluxcorrection;
+};
+
+#endif
@@ -0,0 +1,306 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "RoiProfile.h"
+#include "ProfileSearch.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+/// Bits of fixflag
+enum { FreeFlux=1, FreePosition=2 };
+
+
+RoiProfile::RoiProfile(const RoiMultiConfig& config, const MapData& mapData, double ranal, int threads):
+	m_config(config), m_mapData(mapData), m_ranal(ranal), m_threads(threads<1 ? 1 : threads),
+	m_rays(40), m_step(0.1), m_maxRadius(3.0), m_profiler(0)
+{
+/// The contour fitters run concurrently, TMinuit is not reentrant
+if (m_threads>1 && !m_config.IsReentrant()) {
+	std::cout << "Profile: the " << config.minimizertype << " minimizer is not reentrant, the contours are searched on one thread" << endl;
+	m_threads = 1;
+	}
+}
+
+RoiProfile::~RoiProfile()
+{
+for (size_t i=0; i<m_fitters.size(); ++i)
+	delete m_fitters[i];
+}
+
+
+void RoiProfile::SetContourGrid(int rays, double step, double maxRadius)
+{
+m_rays = rays;
+m_step = step;
+m_maxRadius = maxRadius;
+}
+
+
+bool RoiProfile::MakeFitters(int count)
+{
+while (int(m_fitters.size())<count) {
+	RoiMulti* fitter = new RoiMulti;
+	if (!m_config.Setup(*fitter, m_mapData)) {
+		delete fitter;
+		return false;
+		}
+	m_fitters.push_back(fitter);
+	}
+return true;
+}
+
+
+/// Fit warm with the flags it carries and return the TS of the source label.
+/// The TS is not clamped to 0: the null hypothesis is the same for every
+/// conditional fit, so tsMax-TS is the profile -2 Delta lnL also where the
+/// fixed flux fits worse than no source at all.
+/// The fitted values become the starting point of the next evaluation.
+double RoiProfile::ConditionalTS(int thread, SourceDataArray& warm, const string& label)
+{
+RoiMulti& roiMulti = *m_fitters[thread];
+roiMulti.DoFit(warm, m_ranal, 0, 0, 0);
+SourceDataArray fitArr = roiMulti.GetFitData();
+double ts = fitArr[label].TS;
+for (int i=0; i<fitArr.Count(); ++i)
+	fitArr[i].fixflag = warm[i].fixflag;
+warm = fitArr;
+return ts;
+}
+
+
+/// Refit the sources with the profile fitter, so that the TS the conditional
+/// fits are compared with comes from the same minimizer and settings
+SourceDataArray RoiProfile::ReferenceFit(const SourceDataArray& fitArr)
+{
+RoiMulti& roiMulti = *m_fitters[0];
+roiMulti.DoFit(fitArr, m_ranal, 0, 0, 0);
+SourceDataArray refArr = roiMulti.GetFitData();
+for (int i=0; i<refArr.Count(); ++i)
+	refArr[i].fixflag = fitArr[i].fixflag;
+return refArr;
+}
+
+
+bool RoiProfile::UpperLimit(const SourceDataArray& fitArr, const SourceData& src, double ulcl, Result& result)
+{
+const string& label = src.label;
+double tsMax = src.TS;
+double level = ulcl*ulcl;
+double flux0 = src.flux>0 ? src.flux : 0;
+SourceDataArray warm(fitArr);
+std::function<double(double)> drop = [&](double flux) {
+	warm[label].flux = flux;
+	warm[label].fixflag = 0;
+	return tsMax-ConditionalTS(0, warm, label)-level;
+	};
+int evals = 0;
+double flux1 = flux0>0 ? 2*flux0 : 1e-8;
+double g1;
+if (!ProfileSearch::BracketUp(drop, flux0, -level, flux1, g1, 30, evals)) {
+	result.ulEvals = evals;
+	return false;
+	}
+result.fluxul = ProfileSearch::BrentRoot(drop, flux0, flux1, -level, g1, 1e-3*flux1, 50, evals);
+result.ulEvals = evals;
+return true;
+}
+
+
+bool RoiProfile::Contour(const SourceDataArray& fitArr, const SourceData& src, double loccl, Result& result)
+{
+const string& label = src.label;
+double tsMax = src.TS;
+int flags = src.fixflag;
+vector<SourceDataArray> warm(m_threads, fitArr);
+std::function<double(int, double, double)> drop = [&](int thread, double l, double b) {
+	SourceData& tryData = warm[thread][label];
+	tryData.srcL = l;
+	tryData.srcB = b;
+	tryData.fixflag = flags & ~FreePosition;
+	return tsMax-ConditionalTS(thread, warm[thread], label);
+	};
+vector<double> angles, radii;
+result.locEvals = ProfileSearch::PolarContour(drop, src.srcL, src.srcB, loccl, m_rays, m_step, m_maxRadius, m_threads, angles, radii);
+result.locClosed = true;
+for (size_t i=0; i<angles.size(); ++i) {
+	if (radii[i]>=m_maxRadius)
+		result.locClosed = false;
+	double l, b;
+	ProfileSearch::Offset(src.srcL, src.srcB, angles[i], radii[i], l, b);
+	result.contourL.push_back(l);
+	result.contourB.push_back(b);
+	}
+return true;
+}
+
+
+vector<RoiProfile::Result> RoiProfile::Run(const SourceDataArray& inArr, double ulcl, double loccl)
+{
+vector<Result> results;
+if (!MakeFitters(loccl>0 ? m_threads : 1)) {
+	cerr << "ERROR setting up the profile likelihood fitters" << endl;
+	return results;
+	}
+SourceDataArray fitArr = ReferenceFit(inArr);
+for (int i=0; i<fitArr.Count(); ++i) {
+	const SourceData& src = fitArr[i];
+	int flags = src.fixflag;
+	bool doUl = ulcl>0 && (flags & FreeFlux);
+	bool doLoc = loccl>0 && (flags & FreePosition);
+	if (!doUl && !doLoc)
+		continue;
+	Result result;
+	result.label = src.label;
+	result.l = src.srcL;
+	result.b = src.srcB;
+	result.flux = src.flux;
+	result.TS = src.TS;
+	result.fluxul = -1;
+	result.ulEvals = 0;
+	result.ulConverged = false;
+	result.ulTime = 0;
+	result.locEvals = 0;
+	result.locClosed = false;
+	result.locTime = 0;
+	bool active = FitProfiler::Active(m_profiler);
+	if (doUl) {
+		double start = active ? FitProfiler::Now() : 0;
+		result.ulConverged = UpperLimit(fitArr, src, ulcl, result);
+		if (!result.ulConverged)
+			cerr << "Warning: upper limit of " << src.label << " not bracketed" << endl;
+		if (active) {
+			result.ulTime = FitProfiler::Now()-start;
+			m_profiler->AddTime("ul_search", result.ulTime);
+			m_profiler->AddCount("ul_conditional_fits", result.ulEvals);
+			}
+		}
+	if (doLoc) {
+		double start = active ? FitProfiler::Now() : 0;
+		Contour(fitArr, src, loccl, result);
+		if (active) {
+			result.locTime = FitProfiler::Now()-start;
+			m_profiler->AddTime("contour_search", result.locTime);
+			m_profiler->AddCount("contour_conditional_fits", result.locEvals);
+			}
+		}
+	results.push_back(result);
+	}
+return results;
+}
+
+
+bool RoiProfile::Write(const char* fileName, const char* prefix, const vector<Result>& results,
+                       const char* ulmethod, const char* locmethod)
+{
+std::ofstream outFile(fileName);
+if (!outFile.is_open()) {
+	cerr << "ERROR writing " << fileName << endl;
+	return false;
+	}
+outFile << "! ulmethod " << ulmethod << endl;
+outFile << "! locmethod " << locmethod << endl;
+outFile << "! Label L B Flux TS FluxUL UL_evals Contour_points Contour_evals" << endl;
+outFile << std::setprecision(8);
+for (size_t i=0; i<results.size(); ++i) {
+	const Result& r = results[i];
+	outFile << r.label << " " << r.l << " " << r.b << " " << r.flux << " " << r.TS << " " << r.fluxul << " "
+	        << r.ulEvals << " " << r.contourL.size() << " " << r.locEvals << endl;
+	if (r.contourL.empty())
+		continue;
+	string conName(prefix);
+	conName += "_";
+	conName += r.label;
+	conName += ".polar.con";
+	std::ofstream conFile(conName.c_str());
+	conFile << std::setprecision(8);
+	for (size_t k=0; k<=r.contourL.size(); ++k)
+		conFile << r.contourL[k%r.contourL.size()] << " " << r.contourB[k%r.contourB.size()] << endl;
+	}
+return true;
+}
+
+
+bool RoiProfile::AppendToSources(const char* prefix, const vector<Result>& results,
+                                 const char* ulmethod, const char* locmethod)
+{
+bool ok = true;
+for (size_t i=0; i<results.size(); ++i) {
+	const Result& r = results[i];
+	string srcName(prefix);
+	srcName += "_";
+	srcName += r.label;
+	srcName += ".source";
+	std::ifstream exists(srcName.c_str());
+	if (!exists.is_open()) {
+		cerr << "Warning: " << srcName << " not found, the profile results of " << r.label << " are only in the .ulloc file" << endl;
+		ok = false;
+		continue;
+		}
+	exists.close();
+	std::ofstream srcFile(srcName.c_str(), std::ios::app);
+	srcFile << std::setprecision(8);
+	srcFile << "! Profile likelihood: ulmethod " << ulmethod << ", locmethod " << locmethod << endl;
+	srcFile << "! Flux TS FluxUL UL_evals UL_converged" << endl;
+	srcFile << r.flux << " " << r.TS << " " << r.fluxul << " " << r.ulEvals << " " << r.ulConverged << endl;
+	srcFile << "! Contour_file Contour_points Contour_evals Contour_closed" << endl;
+	if (r.contourL.empty())
+		srcFile << "none 0 " << r.locEvals << " 0" << endl;
+	else
+		srcFile << prefix << "_" << r.label << ".polar.con " << r.contourL.size() << " " << r.locEvals << " " << r.locClosed << endl;
+	if (!srcFile)
+		ok = false;
+	}
+
+string htmlName(prefix);
+htmlName += ".html";
+std::ifstream inHtml(htmlName.c_str());
+if (!inHtml.is_open())
+	return ok;
+std::ostringstream html;
+html << inHtml.rdbuf();
+inHtml.close();
+std::ostringstream table;
+table << std::setprecision(8);
+table << "<h3>Profile likelihood (ulmethod " << ulmethod << ", locmethod " << locmethod << ")</h3>" << endl;
+table << "<table border=1>" << endl;
+table << "<tr><th>Label</th><th>Flux</th><th>TS</th><th>Flux UL</th><th>Contour</th></tr>" << endl;
+for (size_t i=0; i<results.size(); ++i) {
+	const Result& r = results[i];
+	table << "<tr><td>" << r.label << "</td><td>" << r.flux << "</td><td>" << r.TS << "</td><td>" << r.fluxul << "</td><td>";
+	if (r.contourL.empty())
+		table << "-";
+	else
+		table << prefix << "_" << r.label << ".polar.con";
+	table << "</td></tr>" << endl;
+	}
+table << "</table>" << endl;
+string text = html.str();
+size_t pos = text.rfind("</body>");
+if (pos==string::npos)
+	pos = text.rfind("</BODY>");
+if (pos==string::npos)
+	pos = text.size();
+text.insert(pos, table.str());
+std::ofstream outHtml(htmlName.c_str());
+outHtml << text;
+return ok && bool(outHtml);
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _ROIPROFILE_H
+#define _ROIPROFILE_H
+
+#include <string>
+#include <vector>
+
+#include "RoiMultiConfig.h"
+#include "FitProfiler.h"
+
+
+/// Upper limits and location contours computed on the profile likelihood
+/// of a RoiMulti fit. The upper limit is the root of the TS drop found with
+/// the Brent method on conditional fits at fixed flux; the contour is found
+/// on an adaptive polar grid of conditional fits at fixed position,
+/// evaluated in parallel. Each conditional fit is warm started from the
+/// previous one.
+/// \brief Fast profile likelihood upper limits and contours for RoiMulti
+class RoiProfile {
+
+public:
+	/// The upper limit and the contour of one source
+	struct Result {
+		std::string label;
+		double l, b;
+		double flux;
+		double TS;
+		double fluxul;
+		int ulEvals;
+		bool ulConverged;
+		double ulTime;
+		std::vector<double> contourL;
+		std::vector<double> contourB;
+		int locEvals;
+		bool locClosed;
+		double locTime;
+	};
+
+	/// \param[in] threads The number of fitters used for the contour search.
+	/// A minimizer with a global state (TMinuit) is used by one thread.
+	RoiProfile(const RoiMultiConfig& config, const MapData& mapData, double ranal, int threads);
+	~RoiProfile();
+
+	/// Set the polar grid of the contour search.
+	/// \param[in] rays The number of rays of the initial grid.
+	/// \param[in] step The radial step in degrees.
+	/// \param[in] maxRadius The maximum radius in degrees.
+	void SetContourGrid(int rays, double step, double maxRadius);
+
+	/// Record the time and the conditional fits of the searches, and the
+	/// statistics of each source, in profiler. May be null.
+	void SetProfiler(FitProfiler* profiler) { m_profiler = profiler; }
+
+	/// Compute the upper limits (if ulcl>0) of the sources with free flux and
+	/// the contours (if loccl>0) of the sources with free position. The
+	/// sources are refitted first with the profile fitter, the flux and TS
+	/// of the results are the ones of this reference fit.
+	/// \param[in] fitArr The result of the RoiMulti fit, the starting point.
+	std::vector<Result> Run(const SourceDataArray& fitArr, double ulcl, double loccl);
+
+	/// Write the results and the methods used in fileName, and each contour
+	/// in prefix_<label>.polar.con
+	static bool Write(const char* fileName, const char* prefix, const std::vector<Result>& results,
+	                  const char* ulmethod, const char* locmethod);
+
+	/// Append the results and the methods used to the prefix_<label>.source
+	/// files of RoiMulti::WriteSources, and a table of them to the
+	/// prefix.html file of RoiMulti::WriteHtml.
+	/// \return false if a file is missing or cannot be written.
+	static bool AppendToSources(const char* prefix, const std::vector<Result>& results,
+	                            const char* ulmethod, const char* locmethod);
+
+private:
+	RoiProfile(const RoiProfile&);
+	RoiProfile& operator=(const RoiProfile&);
+
+	bool MakeFitters(int count);
+	SourceDataArray ReferenceFit(const SourceDataArray& fitArr);
+	double ConditionalTS(int thread, SourceDataArray& warm, const std::string& label);
+	bool UpperLimit(const SourceDataArray& fitArr, const SourceData& src, double ulcl, Result& result);
+	bool Contour(const SourceDataArray& fitArr, const SourceData& src, double loccl, Result& result);
+
+	RoiMultiConfig         m_config;
+	const MapData&         m_mapData;
+	double                 m_ranal;
+	int                    m_threads;
+	int                    m_rays;
+	double                 m_step;
+	double                 m_maxRadius;
+	FitProfiler*           m_profiler;
+	std::vector<RoiMulti*> m_fitters;
+};
+
+#endif
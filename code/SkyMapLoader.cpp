@@ -0,0 +1,186 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+#include "MathUtils.h"
+#include "SkyMapLoader.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+
+/// #define MORE_KEYWORDS
+
+static const char* const knownKeywords[] = {
+	"XTENSION",
+	"BITPIX",
+	"NAXIS",
+	"NAXIS1",
+	"NAXIS2",
+	"NAXIS3",
+	"NAXIS4",
+	"PCOUNT",
+	"GCOUNT",
+	"BSCALE",
+	"BZERO",
+	"CDELT1",
+	"CRPIX1",
+	"CRVAL1",
+	"CDELT2",
+	"CRPIX2",
+	"CRVAL2",
+	"EXTNAME",
+#ifdef MORE_KEYWORDS
+	"CTYPE1",
+	"CUNIT1",
+	"CTYPE2",
+	"CUNIT2",
+	"PIXCENT",
+	"BUNIT",
+	"PRIMTYPE",
+	"INSTRUME",
+#endif
+	0};
+
+static bool IsUnknownKeyword(const char* keyword)
+{
+for (int i=0; knownKeywords[i]; ++i)
+	if (!strcmp(keyword, knownKeywords[i]))
+		return false;
+return true;
+}
+
+static void ReadFitsKey(fitsfile* fptr, const char* name, float* value, int* status)
+{
+fits_read_key(fptr, TFLOAT, const_cast<char*>(name), value, NULL, status);
+}
+
+
+vector<string> SkyMapLoader::AncillaryKeywords(fitsfile* fptr, int* status)
+{
+vector<string> keywords;
+int count = 0;
+fits_get_hdrspace(fptr, &count, 0, status);
+for (int i=0; i<count && !*status; ++i) {
+	char keyname[FLEN_CARD];
+	char value[FLEN_CARD];
+	fits_read_keyn(fptr, i+1, keyname, value, 0, status);
+	if (!*status && IsUnknownKeyword(keyname)) {
+		char record[FLEN_CARD];
+		fits_read_record(fptr, i+1, record, status);
+		keywords.push_back(record);
+		}
+	}
+return keywords;
+}
+
+
+void SkyMapLoader::SetKeywords(SkyMap& map, const vector<string>& keywords)
+{
+vector<char*> cards(keywords.size()+1, (char*)0);
+vector<vector<char> > texts(keywords.size());
+for (size_t k=0; k<keywords.size(); ++k) {
+	texts[k].assign(keywords[k].begin(), keywords[k].end());
+	texts[k].push_back(0);
+	cards[k] = &texts[k][0];
+	}
+map.SetKeywords(&cards[0]);
+}
+
+
+SkyMap SkyMapLoader::Load(const char* fileName, bool pad, const char* caller)
+{
+SkyMap outmap;
+fitsfile *fptr;
+int status = 0;
+fits_open_image(&fptr, fileName, READONLY, &status);
+if (status) {
+	cerr << caller << ": failed opening file " << fileName << " Fits error: " << status << endl;
+	return outmap;
+	}
+int bitpix, naxis;
+long naxes[4] = { 0, 0, 1, 1 };
+fits_get_img_param(fptr, 4, &bitpix, &naxis, naxes, &status);
+if (status)
+	cerr << caller << ": Could not read the image parameters" << endl;
+long nx = naxes[0];
+long ny = naxes[1];
+vector<float> values;
+if (!status) {
+	values.resize(nx*ny);
+	long fpixel[4] = { 1, 1, 1, 1 };
+	fits_read_pix(fptr, TFLOAT, fpixel, nx*ny, 0, &values[0], 0, &status);
+	if (status)
+		cerr << caller << ": Error reading the image" << endl;
+	}
+float xRes, yRes, xRef, yRef, xPoint, yPoint;
+ReadFitsKey(fptr, "CDELT1", &xRes, &status);
+ReadFitsKey(fptr, "CDELT2", &yRes, &status);
+ReadFitsKey(fptr, "CRPIX1", &xRef, &status);
+ReadFitsKey(fptr, "CRPIX2", &yRef, &status);
+ReadFitsKey(fptr, "CRVAL1", &xPoint, &status);
+ReadFitsKey(fptr, "CRVAL2", &yPoint, &status);
+if (status)
+	cerr << caller << ": Error reading the basic keywords" << endl;
+vector<string> keywords = AncillaryKeywords(fptr, &status);
+if (status)
+	cerr << caller << ": Error reading ancillary keywords" << endl;
+int closeStatus = 0;	/// Close this file in any case
+fits_close_file(fptr, &closeStatus);
+if (status)
+	return outmap;
+
+float* v = &values[0];
+for (long i=0; i<nx*ny; ++i)
+	v[i] = std::isnan(v[i]) ? 0.0f : v[i];
+
+int y_padwidth = 0;
+int x_padwidth = 0;
+if (pad) {
+	y_padwidth = round((20.0 + fabs(yRes)) / fabs(yRes));
+	float new_yRef = yRef + y_padwidth;
+	int new_ny = ny + 2 * y_padwidth;
+	float b_lo = yPoint + yRes * (1 - new_yRef);
+	float b_hi = yPoint + yRes * (new_ny - new_yRef);
+	x_padwidth = round((fabs(xRes) + 20.0 / fmin(cos(b_lo*DEG2RAD),  cos(b_hi*DEG2RAD))) / fabs(xRes));
+	}
+long new_nx = nx + 2 * x_padwidth;
+long new_ny = ny + 2 * y_padwidth;
+float new_xRef = xRef + x_padwidth;
+float new_yRef = yRef + y_padwidth;
+
+const float* rows = v;
+vector<float> padded;
+if (pad) {
+	padded.assign(new_nx*new_ny, 0.0f);
+	for (long j=0; j<ny; ++j)
+		memcpy(&padded[(j+y_padwidth)*new_nx+x_padwidth], v+j*nx, nx*sizeof(float));
+	rows = &padded[0];
+	}
+
+SkyMap map(new_ny, new_nx, xRes, yRes, xPoint, yPoint, new_xRef, new_yRef);
+for (long j=0; j<new_ny; ++j) {
+	const float* row = rows+j*new_nx;
+	for (long i=0; i<new_nx; ++i)
+		map.SetValue(j, i, row[i]);
+	}
+SetKeywords(map, keywords);
+outmap = map;
+return outmap;
+}
@@ -0,0 +1,48 @@
+/***************************************************************************
+    begin                : Oct 18 2026
+    copyright            : (C) 2026 AGILE Team
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software for non commercial purpose              *
+ *   and for public research institutes; you can redistribute it and/or    *
+ *   modify it under the terms of the GNU General Public License.          *
+ *   For commercial purpose see appropriate license terms                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _SKYMAPLOADER_H
+#define _SKYMAPLOADER_H
+
+#include <string>
+#include <vector>
+
+#include <fitsio.h>
+#include "SkyMap.h"
+
+
+/// Reads a FITS image into a SkyMap, optionally padded with zeros, keeping
+/// the ancillary keywords of the header. The image is read with a single
+/// call, the NaN are set to zero and the padded map is built row by row in
+/// a zeroed buffer. This is the loader of AG_padMap and AG_converttoSkyMap.
+/// \brief FITS image to SkyMap loader
+class SkyMapLoader {
+
+public:
+	/// \param[in] fileName The FITS image, only its first plane is read.
+	/// \param[in] pad Add a border of zeros of 20 degrees plus one pixel in
+	/// latitude, and of 20 degrees at the highest latitude in longitude.
+	/// \param[in] caller The prefix of the error messages.
+	/// \return the map, empty on error.
+	static SkyMap Load(const char* fileName, bool pad, const char* caller);
+
+	/// The header records of the current HDU, except the structural and
+	/// WCS keywords that SkyMap writes itself.
+	static std::vector<std::string> AncillaryKeywords(fitsfile* fptr, int* status);
+
+	/// Copy the ancillary keywords into a map.
+	static void SetKeywords(SkyMap& map, const std::vector<std::string>& keywords);
+};
+
+#endif
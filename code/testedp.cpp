@@ -38,6 +38,8 @@
 #include <PilParams.h>
 #include <CalibUtils.h>
 
+#include "EdpCorrection.h"
+
 #include "TNamed.h"
 #include "TVirtualFitter.h"
 #include "TH1.h"
@@ -121,68 +123,26 @@ double UpdateNormLogParabola(double eMin, double eMax, double index, double m_pa
 	return m_normFactor;
 }
 
-double detCorrectionSpectraFactor(EdpGrid &edp, int iMin, int iMax, double index, double par1, double par2, double par3, int typefun) {
+double detCorrectionSpectraFactor(EdpGrid &edp, int iMin, int iMax, double index, double par1, double par2, double par3, int typefun, const char* outfilename=0, int threads=1) {
 	cout << "--------------" << endl;
-	VecF  m_edptrueenergy = edp.TrueEnergies();
-	VecF  m_edpobsenergy = edp.ObsEnergies();
-	VecF  m_edptheta = edp.Thetas();
-	VecF  m_edpphi = edp.Phis();
-	int eneChanCount = m_edptrueenergy.Dim(0);
-
-	cout << m_edptrueenergy[iMin] << " " << m_edptrueenergy[iMax] << endl;
-	double normsumpl=0, normsumple = 0;
-	for (int i=iMin; i<=iMax; i++) {
-		double lastenergy = m_edptrueenergy[i+1];
-		cout << i << endl;
-		double udp1 = 0;
-		if(typefun == 0)
-			udp1 = UpdateNormPL(m_edptrueenergy[i], lastenergy, par1);
-		if(typefun == 1)
-			udp1 = UpdateNormPLExpCutOff(m_edptrueenergy[i], lastenergy, par1, par2, m_edptrueenergy[0], m_edptrueenergy[eneChanCount-1]);
-		if(typefun == 2)
-			udp1 = UpdateNormPLSuperExpCutOff(m_edptrueenergy[i], lastenergy, par1, par2, par3, m_edptrueenergy[0], m_edptrueenergy[eneChanCount-1]);
-		normsumple += udp1;
-
-		udp1 = UpdateNormPL(m_edptrueenergy[i], lastenergy, index);
-		normsumpl += udp1;
-	}
-	cout << "A " << normsumpl << " " << normsumple << endl;
-	VecF edpArr(eneChanCount);
-	edpArr = 0.0f;
-
-	for(int thetaind=0; thetaind<m_edptheta.Dim(0); thetaind++) {
-		for(int phiind=0; phiind<m_edpphi.Dim(0); phiind++){
-			int phiindcor = phiind%2?phiind-1:phiind;
-			float avgValuePL = 0.0f;
-			float avgValuePLE = 0.0f;
-			for (int etrue = 0; etrue < eneChanCount-1; etrue++)  {
-				double lastenergy = m_edptrueenergy[etrue+1];
-				//if(etrue == iMax && GetEmax() == 50000)
-				//	lastenergy = 50000;
-				
-				for (int eobs = iMin;  eobs <= iMax; eobs++) {
-					//cout << "edp: " << m_edptrueenergy[etrue] << " " << m_edpobsenergy[eobs] << " " << m_edptheta[thetaind] << " " << m_edpphi[phiindcor] << " " <<  edp.Val(m_edptrueenergy[etrue], m_edpobsenergy[eobs], m_edptheta[thetaind], m_edpphi[phiindcor]) << endl;
-					edpArr[etrue] += edp.Val(m_edptrueenergy[etrue], m_edpobsenergy[eobs], m_edptheta[thetaind], m_edpphi[phiindcor]); //CORRETTO
-				}
-				avgValuePL += edpArr[etrue] * UpdateNormPL(m_edptrueenergy[etrue], lastenergy, index) * 1;
-				//cout << UpdateNormPL(m_edptrueenergy[etrue], m_edptrueenergy[etrue+1], 2.1) << " " << edpArr[etrue] << endl;
-				if(typefun == 0)
-					avgValuePLE += edpArr[etrue] * UpdateNormPL(m_edptrueenergy[etrue], lastenergy, par1) * 1;
-				if(typefun == 1)
-					avgValuePLE += edpArr[etrue] * UpdateNormPLExpCutOff(m_edptrueenergy[etrue], lastenergy, par1, par2, m_edptrueenergy[0], m_edptrueenergy[eneChanCount-1]) * 1;
-				if(typefun == 2)
-					avgValuePLE += edpArr[etrue] * UpdateNormPLSuperExpCutOff(m_edptrueenergy[etrue], lastenergy, par1, par2, par3,  m_edptrueenergy[0], m_edptrueenergy[eneChanCount-1]) * 1;
-			}
-			double avgpl = 0, avgple = 0;
-			//avgalue dipende da theta e phi
-			avgpl = avgValuePL/normsumpl;
-			avgple = avgValuePLE/normsumple;
-			double corr = avgpl/avgple;
-			cout << "A " << m_edptheta[thetaind] << " " << m_edpphi[phiindcor] << " " << avgpl << " " << avgple << " " << avgpl - avgple << " PL/" << avgpl/avgple << endl;
-			return corr;
+	EdpCorrection correction;
+	if (!correction.Compute(edp, iMin, iMax, index, typefun, par1, par2, par3, threads))
+		return 0;
+	for(int thetaind=0; thetaind<correction.Thetas(); thetaind++) {
+		for(int phiind=0; phiind<correction.Phis(); phiind++){
+			double avgpl = correction.AvgRef(thetaind, phiind);
+			double avgple = correction.AvgSpec(thetaind, phiind);
+			cout << "A " << correction.Theta(thetaind) << " " << correction.Phi(phiind) << " " << avgpl << " " << avgple << " " << avgpl - avgple << " PL/" << correction.Value(thetaind, phiind) << endl;
 		}
 	}
-
+	if (outfilename) {
+		int status = correction.Write(outfilename);
+		if (status)
+			cout << "Error writing " << outfilename << ": " << status << endl;
+		else
+			cout << "Correction table written to " << outfilename << endl;
+	}
+	return correction.Value(0, 0);
 }
 
 double detCorrectionSpectraFactorSimple(EdpGrid &edp, int iMin, int iMax, double index, double par1) {
@@ -360,8 +320,37 @@ int main2(int argc, char *argv[]) {
 
 }
 
+int mainCorrectionTable(int argc, char *argv[])
+{
+	/// testedp edpfile outfile emin emax refindex spectype index par2 par3 [threads]
+	char* edpfilename = argv[1];
+	char* outfilename = argv[2];
+	EdpGrid edp;
+	if (!edp.Read(edpfilename)) {
+		cout << "Error reading " << edpfilename << endl;
+		return 1;
+	}
+	VecF m_energy = edp.TrueEnergies();
+	int iMin, iMax;
+	if (!EdpCorrection::Channels(edp, atof(argv[3]), atof(argv[4]), iMin, iMax)) {
+		cout << "Energy range out of the EDP grid" << endl;
+		return 1;
+	}
+	cout << "Boundaries: " << m_energy[iMin] << " " << m_energy[iMax+1] << endl;
+	double index = atof(argv[5]);
+	int typefun = atoi(argv[6]);
+	double par1 = atof(argv[7]);
+	double par2 = atof(argv[8]);
+	double par3 = atof(argv[9]);
+	int threads = argc > 10 ? atoi(argv[10]) : 0;
+	detCorrectionSpectraFactor(edp, iMin, iMax, index, par1, par2, par3, typefun, outfilename, threads);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
+	if (argc > 9)
+		return mainCorrectionTable(argc, argv);
 	char* edpfilename = argv[1];
 	cout << edpfilename << endl;
 	EdpGrid edp;
@@ -398,7 +387,8 @@ int main(int argc, char *argv[])
 	int eneChanCount = m_edptrueenergy.Dim(0);
 	for (int i=0; i<eneChanCount-1; i++) {
 		double udp1 = UpdateNormPLExpCutOff(m_edptrueenergy[i], m_edptrueenergy[i+1], 1.57, 1678, m_edptrueenergy[0], m_edptrueenergy[m_edptrueenergy.Dim(0)-1]);
-		cout << m_edptrueenergy[i] << " " << m_edptrueenergy[i+1] << " " << UpdateNormPL(m_edptrueenergy[i], m_edptrueenergy[i+1], 2.1) << " " << udp1 << " " << UpdateNormPL(m_edptrueenergy[i], m_edptrueenergy[i+1], 2.1)  -  udp1 << endl;
+		double udp2 = EdpCorrection::Integral(EdpPLExpCutoff, m_edptrueenergy[i], m_edptrueenergy[i+1], 1.57, 1678, 0);
+		cout << m_edptrueenergy[i] << " " << m_edptrueenergy[i+1] << " " << UpdateNormPL(m_edptrueenergy[i], m_edptrueenergy[i+1], 2.1) << " " << udp1 << " " << UpdateNormPL(m_edptrueenergy[i], m_edptrueenergy[i+1], 2.1)  -  udp1 << " GL " << udp2 << endl;
 	}
 
 	int i1=4, i2=8;